@@ -20,6 +20,9 @@ void arch_send_ipi(u32 cpu, u32 ipi)
 int handle_ipi(u32 ipi)
 {
         switch (ipi) {
+        case IPI_RESCHED:
+                /* sched() follows in handle_irq */
+                return 0;
         default:
                 kwarn("Unknow IPI %d\n", ipi);
                 return -1;
@@ -81,7 +81,9 @@ void handle_entry_c(int type, u64 esr, u64 address)
                 return;
         case ESR_EL1_EC_ENFP:
                 kdebug("Access to SVE, Advanced SIMD, or floating-point functionality\n");
-                break;
+                /* FP/SIMD is trapped lazily, see fpu.c */
+                handle_fpu_trap();
+                return;
         case ESR_EL1_EC_ILLEGAL_EXEC:
                 kdebug("Illegal Execution state\n");
                 break;
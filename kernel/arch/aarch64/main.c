@@ -24,6 +24,9 @@
 #include <machine.h>
 #include <irq/irq.h>
 #include <object/thread.h>
+#include <object/object.h>
+#include <sched/context.h>
+#include <common/radix.h>
 
 ALIGN(STACK_ALIGNMENT)
 char kernel_stack[PLAT_CPU_NUM][KERNEL_STACK_SIZE];
@@ -68,6 +71,13 @@ void main(paddr_t boot_flag)
         mm_init();
         kinfo("[ChCore] mm init finished\n");
 
+        /* Typed caches of the hot kernel objects */
+        vmregion_cache_init();
+        radix_cache_init();
+        cap_slot_cache_init();
+        sched_cont_cache_init();
+        arch_fpu_cache_init();
+
 #ifdef CHCORE_KERNEL_TEST
         void test_kmalloc(void);
         test_kmalloc();
@@ -84,8 +94,11 @@ void main(paddr_t boot_flag)
         pmu_init();
         kinfo("[ChCore] pmu init finished\n");
 
+        /* Trap FP/SIMD at EL0 until the first use of each thread */
+        arch_fpu_init();
+
         /* Init scheduler with specified policy */
-        sched_init(&rr);
+        sched_init(&BOOT_SCHED_POLICY);
         kinfo("[ChCore] sched init finished\n");
 
         /* Other cores are busy looping on the addr, wake up those cores */
@@ -117,6 +130,7 @@ void secondary_start(void)
 
         arch_interrupt_init_per_cpu();
         pmu_init();
+        arch_fpu_init();
 
         /**
          * Inform the BSP at last to start cpu one by one
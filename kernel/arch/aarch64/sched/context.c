@@ -33,6 +33,7 @@ void init_thread_ctx(struct thread *thread, u64 stack, u64 func, u32 prio,
 
         /* Set the cpuid and affinity */
         thread->thread_ctx->affinity = aff;
+        thread->thread_ctx->wake_cpu = NO_AFF;
 
         /* Set the budget of the thread */
         if (thread->thread_ctx->sc != NULL) {
@@ -95,6 +96,13 @@ void arch_set_thread_arg1(struct thread *thread, u64 pid)
         thread->thread_ctx->ec.reg[X1] = pid;
 }
 
+/* The idx-th argument in X<idx>, only the first eight are in registers */
+void arch_set_thread_arg(struct thread *thread, u32 idx, u64 arg)
+{
+        BUG_ON(idx > X7);
+        thread->thread_ctx->ec.reg[X0 + idx] = arg;
+}
+
 /* set arch-specific thread state */
 void set_thread_arch_spec_state(struct thread *thread)
 {
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan PSL v1.
+ * You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v1 for more details.
+ */
+
+/*
+ * Lazy FP/SIMD context switching.
+ *
+ * FP/SIMD instructions at EL0 trap until the running thread uses them.
+ * The trap loads the state of the thread into the registers, unless they
+ * still hold it, and lets EL0 use them. Then the state is saved when the
+ * thread is switched out. Threads which never use FP/SIMD pay nothing but
+ * a write of CPACR_EL1 on each switch. Their state is not even allocated,
+ * which keeps it out of thread_ctx at the top of the kernel stack.
+ *
+ * The registers of a CPU hold the state of fpu_owners[cpu] as long as no
+ * other thread loads its state there. So a thread switched back in on the
+ * same CPU gets them at once, without a trap or a restore.
+ */
+#include <arch/sched/arch_sched.h>
+#include <arch/machine/registers.h>
+#include <arch/machine/smp.h>
+#include <common/kprint.h>
+#include <common/util.h>
+#include <object/thread.h>
+#include <sched/sched.h>
+#include <irq/irq.h>
+#include <mm/slab.h>
+#include <machine.h>
+
+void fpu_save(struct fpu_state *fpu);
+void fpu_restore(struct fpu_state *fpu);
+
+/* The thread whose state is in the registers of each CPU */
+static struct thread *fpu_owners[PLAT_CPU_NUM];
+/* Whether EL0 may use FP/SIMD on each CPU, for its owner only */
+static bool fpu_enabled[PLAT_CPU_NUM];
+
+static struct slab_cache *fpu_state_cache;
+
+void arch_fpu_cache_init(void)
+{
+        fpu_state_cache = kmem_cache_create(
+                "fpu_state", sizeof(struct fpu_state), 16, NULL);
+        BUG_ON(!fpu_state_cache);
+}
+
+static void fpu_set_el0_access(bool enable)
+{
+        u64 cpacr = enable ? CPACR_EL1_FPEN_ALL : CPACR_EL1_FPEN_EL1;
+
+        asm volatile("msr cpacr_el1, %0\n isb" ::"r"(cpacr));
+        fpu_enabled[smp_get_cpu_id()] = enable;
+}
+
+/* Called on each CPU at boot */
+void arch_fpu_init(void)
+{
+        fpu_owners[smp_get_cpu_id()] = NULL;
+        fpu_set_el0_access(false);
+}
+
+/* A new thread has no state until it uses FP/SIMD, even if ec is copied */
+void arch_fpu_init_thread(struct thread *thread)
+{
+        thread->thread_ctx->ec.fpu = NULL;
+}
+
+/*
+ * Called when switching to @target on this CPU. The state of the thread
+ * switched out is saved if it has been using FP/SIMD.
+ */
+void arch_fpu_switch(struct thread *target)
+{
+        u32 cpuid = smp_get_cpu_id();
+        struct thread *owner = fpu_owners[cpuid];
+
+        if (fpu_enabled[cpuid] && owner) {
+                if (owner == target)
+                        return;
+                fpu_save(owner->thread_ctx->ec.fpu);
+        }
+        /* Only the owner of the registers has its state allocated */
+        fpu_set_el0_access(owner == target
+                           && target->thread_ctx->ec.fpu->cpuid == cpuid);
+}
+
+/* First FP/SIMD instruction of the current thread since switched in */
+void handle_fpu_trap(void)
+{
+        u32 cpuid = smp_get_cpu_id();
+        struct thread *thread = current_thread;
+        struct fpu_state *fpu = thread->thread_ctx->ec.fpu;
+
+        if (!fpu) {
+                fpu = kmem_cache_alloc(fpu_state_cache);
+                if (!fpu) {
+                        /* The thread cannot go on without the registers */
+                        kwarn("No memory for the FP/SIMD state, exit\n");
+                        thread->thread_ctx->thread_exit_state = TE_EXITING;
+                        sched();
+                        eret_to_thread(switch_context());
+                }
+                memset(fpu, 0, sizeof(*fpu));
+                /* Not loaded anywhere yet */
+                fpu->cpuid = PLAT_CPU_NUM;
+                thread->thread_ctx->ec.fpu = fpu;
+        }
+
+        /* The state may have been loaded and changed on another CPU */
+        if (fpu_owners[cpuid] != thread || fpu->cpuid != cpuid) {
+                fpu_restore(fpu);
+                fpu_owners[cpuid] = thread;
+                fpu->cpuid = cpuid;
+        }
+        fpu_set_el0_access(true);
+}
+
+/* Forget @thread, which is being destroyed, as an owner and free its state */
+void arch_fpu_release(struct thread *thread)
+{
+        int i;
+
+        for (i = 0; i < PLAT_CPU_NUM; i++) {
+                if (fpu_owners[i] == thread) {
+                        fpu_owners[i] = NULL;
+                        fpu_enabled[i] = false;
+                }
+        }
+        if (thread->thread_ctx->ec.fpu) {
+                kmem_cache_free(fpu_state_cache, thread->thread_ctx->ec.fpu);
+                thread->thread_ctx->ec.fpu = NULL;
+        }
+}
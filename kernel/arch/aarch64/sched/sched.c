@@ -34,4 +34,5 @@ void arch_idle_ctx_init(struct thread_ctx *idle_ctx, void (*func)(void))
 
 inline void arch_switch_context(struct thread *target)
 {
+        arch_fpu_switch(target);
 }
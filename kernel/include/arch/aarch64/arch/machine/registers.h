@@ -201,3 +201,10 @@ enum reg_type {
 /* In bytes */
 #define SZ_U64              8
 #define ARCH_EXEC_CONT_SIZE (REG_NUM * SZ_U64)
+
+/*
+ * CPACR_EL1.FPEN: FP/SIMD instructions trap at EL0 only (EL1 is always
+ * allowed, for saving and restoring the state), or do not trap.
+ */
+#define CPACR_EL1_FPEN_EL1 (0b01 << 20)
+#define CPACR_EL1_FPEN_ALL (0b11 << 20)
@@ -15,7 +15,31 @@
 #include <common/types.h>
 #include <arch/machine/registers.h>
 
-/* size in registers.h (to be used in asm) */
+struct thread;
+
+/* FP/SIMD registers, used only by threads which touch them (see fpu.c) */
+struct fpu_state {
+        /* Q0-Q31 */
+        u64 vreg[64];
+        u64 fpsr;
+        u64 fpcr;
+        /* The CPU where this state was last loaded */
+        u32 cpuid;
+} __attribute__((aligned(16)));
+
+/*
+ * size of reg in registers.h (to be used in asm)
+ * Only reg is saved on exceptions, which is the frame at the beginning.
+ */
 typedef struct arch_exec_cont {
         u64 reg[REG_NUM];
+        /* Allocated on the first FP/SIMD trap of the thread */
+        struct fpu_state *fpu;
 } arch_exec_cont_t;
+
+void arch_fpu_cache_init(void);
+void arch_fpu_init(void);
+void arch_fpu_init_thread(struct thread *thread);
+void arch_fpu_switch(struct thread *target);
+void arch_fpu_release(struct thread *thread);
+void handle_fpu_trap(void);
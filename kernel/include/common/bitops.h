@@ -55,6 +55,28 @@ static inline int ctzl(unsigned long x)
         return x == 0 ? sizeof(x) * BITS_PER_BYTE : __builtin_ctzl(x);
 }
 
+/* return the number of zero bits from the highest bit */
+static inline int clzl(unsigned long x)
+{
+        return x == 0 ? sizeof(x) * BITS_PER_BYTE : __builtin_clzl(x);
+}
+
+/*
+ * From highest bit side, this function find the last bit of the slot
+ * pointed by p, one word at a time. It returns size if no bit is set.
+ * Bits beyond size must be zero.
+ */
+static inline int find_last_bit(unsigned long *p, unsigned long size)
+{
+        long i;
+
+        for (i = BITS_TO_LONGS(size) - 1; i >= 0; i--) {
+                if (p[i])
+                        return (i + 1) * BITS_PER_LONG - 1 - clzl(p[i]);
+        }
+        return size;
+}
+
 static inline int find_next_bit_helper(unsigned long *p, unsigned long size,
                                        unsigned long start, int invert)
 {
@@ -37,6 +37,7 @@ struct radix {
 };
 
 /* interfaces */
+void radix_cache_init(void);
 struct radix *new_radix(void);
 void init_radix(struct radix *radix);
 int radix_add(struct radix *radix, u64 key, void *value);
@@ -16,16 +16,53 @@
 
 #define IPC_MAX_CONN_PER_SERVER 32
 #define MAX_CAP_TRANSFER        8
+/* Number of u64 values carried by the register-only IPC path */
+#define IPC_REGS_NUM            6
+/* Shadow threads built eagerly when a server registers */
+#define IPC_SHADOW_POOL_PREALLOC 4
+/* Concurrent calls served for one connection, each takes a shadow thread */
+#define IPC_MAX_SHADOW_PER_CONN  4
+/* Upper bound of a per-connection shared buffer */
+#define IPC_MAX_BUF_SIZE         0x800000
+/* Calls issued by one sys_ipc_call_batch at most */
+#define IPC_MAX_BATCH            16
+
+/*
+ * Zero-copy PMO window in ipc_msg cap slots, which takes IPC_WINDOW_SLOTS:
+ *   slot[0]: IPC_MSG_WINDOW | (IPC_MSG_WINDOW_WRITE) | pmo_cap
+ *   slot[1]: page-aligned offset in the pmo
+ *   slot[2]: page-aligned length of the window
+ * During the call, the window is mapped into the server, and its address
+ * and length are passed in the 3rd and 4th argument registers of the
+ * handler. The slots stay writable by the client, so the server must not
+ * trust them.
+ */
+#define IPC_MSG_WINDOW       (1UL << 63)
+#define IPC_MSG_WINDOW_WRITE (1UL << 62)
+#define IPC_WINDOW_SLOTS     3
 
 /*
  * Used in both server and client register.
  * Stack setting is invalid in client register.
+ *
+ * For a server, buf_size is the default size of a connection's buffer, and
+ * the buffers of all its connections are placed in the buffer area
+ * [buf_base_addr, buf_base_addr + buf_area_size).
+ * For a client, buf_size is the size it requests (0 for the server default)
+ * and is updated to the granted size; buf_area_size is ignored.
  */
 struct ipc_vm_config {
         u64 stack_base_addr;
         u64 stack_size;
         u64 buf_base_addr;
         u64 buf_size;
+        u64 buf_area_size;
+};
+
+struct shared_buf {
+        u64 client_user_addr;
+        u64 server_user_addr;
+        u64 size;
 };
 
 struct server_ipc_config {
@@ -34,13 +71,44 @@ struct server_ipc_config {
         u64 max_client;
         /* bitmap for shared buffer and stack allocation */
         unsigned long *conn_bmp;
+        /* Connections placed in the buffer area, indexed by conn_bmp bits */
+        struct ipc_connection **conns;
         struct ipc_vm_config vm_config;
+
+        /* Idle shadow threads ready for new connections (linked by node) */
+        struct list_head shadow_pool;
+        /* Number of shadow threads in shadow_pool */
+        u64 shadow_pool_cnt;
+        /* Number of shadow threads alive, each owns one stack slot */
+        u64 shadow_cnt;
+        /* The shadow threads alive, indexed by their stack slots */
+        struct thread **shadows;
 };
 
-struct shared_buf {
-        u64 client_user_addr;
-        u64 server_user_addr;
-        u64 size;
+/*
+ * general_ipc_config of a shadow thread.
+ * The shadow thread and its stack outlive connections: they are returned
+ * to the server's shadow_pool in connection_deinit and reused afterwards.
+ * The pool keeps at most IPC_SHADOW_POOL_PREALLOC of them, and the others
+ * are destroyed together with their stacks.
+ * The per-call state lives here, so that a connection can have several
+ * calls in flight, each served by its own shadow thread.
+ */
+struct shadow_ipc_config {
+        u64 callback;
+        struct server_ipc_config *server_config;
+        struct pmobject *stack_pmo;
+        u64 stack_base;
+        u64 stack_size;
+
+        /* The client thread being served and its ipc_msg */
+        struct thread *source;
+        struct ipc_msg *ipc_msg;
+        /* Issued by sys_ipc_call_regs, whose client takes results in regs */
+        bool regs_call;
+        /* PMO window mapped into the server during the current call */
+        struct shared_buf window;
+        struct pmobject *window_pmo;
 };
 
 typedef struct ipc_msg {
@@ -51,23 +119,40 @@ typedef struct ipc_msg {
 } ipc_msg_t;
 
 struct ipc_connection {
-        /* Source Thread */
-        struct thread *source;
-        /* Target Thread */
-        struct thread *target;
+        /* Server thread, which owns the shadow threads */
+        struct thread *server;
+        /* Idle shadow threads of this connection (linked by node) */
+        struct list_head idle_shadows;
+        /* Number of shadow threads taken from the server's pool */
+        u64 shadow_num;
         /* Conn cap in server */
         u64 server_conn_cap;
         /* Target function */
         u64 callback;
 
-        /* Shadow server stack top */
-        u64 server_stack_top;
-        u64 server_stack_size;
-
-        /* Shared buffer */
+        /* Shared buffer, mapped in both the client and the server */
         struct shared_buf buf;
-        /* IPC msg */
-        struct ipc_msg *ipc_msg;
+        struct pmobject *buf_pmo;
+        struct vmspace *client_vmspace;
+
+        /* Slot in the server's conn_bmp */
+        int conn_idx;
+};
+
+/*
+ * State of a sys_ipc_call_batch, owned by the client thread.
+ * When a server returns, the next call is issued in the kernel directly
+ * and the client goes back to EL0 only after the last one.
+ */
+struct ipc_batch {
+        u32 conn_caps[IPC_MAX_BATCH];
+        struct ipc_msg *ipc_msgs[IPC_MAX_BATCH];
+        s64 rets[IPC_MAX_BATCH];
+        u64 n;
+        /* The call being served, or the next one to issue */
+        u64 cur;
+        /* Where rets are copied to when the batch is finished */
+        s64 *user_rets;
 };
 
 /* IPC related system calls */
@@ -75,3 +160,10 @@ u64 sys_register_server(u64 callback, u64 max_client, u64 vm_config_ptr);
 u32 sys_register_client(u32 server_cap, u64 vm_config_ptr);
 u64 sys_ipc_call(u32 conn_cap, struct ipc_msg *ipc_msg, u64 cap_num);
 void sys_ipc_return(u64 ret, u64 cap_num);
+u64 sys_ipc_call_regs(u32 conn_cap, u64 arg0, u64 arg1, u64 arg2, u64 arg3,
+                      u64 arg4, u64 arg5);
+void sys_ipc_return_regs(u64 ret, u64 ret0, u64 ret1, u64 ret2, u64 ret3,
+                         u64 ret4, u64 ret5);
+s64 sys_ipc_call_batch(u64 conn_caps_ptr, u64 ipc_msgs_ptr, u64 rets_ptr,
+                       u64 n);
+int sys_ipc_close_connection(u32 conn_cap);
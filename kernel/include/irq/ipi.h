@@ -19,6 +19,10 @@
 void arch_send_ipi(u32 cpu, u32 ipi);
 int handle_ipi(u32 ipi);
 
+/* IPI vectors, less than 32 */
+/* Reschedule, e.g., to wake up a core whose tick is stopped in idle */
+#define IPI_RESCHED (0)
+
 /* 7 u64 arg and 2 u32 (start/finish, vector) occupy one cacheline */
 #define IPI_DATA_ARG_NUM (7)
 
@@ -26,14 +26,47 @@ struct thread;
 
 extern u64 tick_per_us;
 
+/*
+ * Hierarchical timer wheel of sleeping threads, one per core.
+ * A slot of level l spans TW_SIZE^l units of TW_RES_US, so each level
+ * covers TW_SIZE times the range of the one below. Threads due within the
+ * range of level 0 sit in their exact slot, and the others are cascaded
+ * down when the wheel reaches their slot.
+ */
+#define TW_RES_US (1000)
+#define TW_BITS   (6)
+#define TW_SIZE   (1 << TW_BITS)
+#define TW_MASK   (TW_SIZE - 1)
+#define TW_LEVELS (4)
+
+/* Upper bound of a sleep, beyond which it never ends in practice */
+#define SLEEP_MAX_SEC (1UL << 32)
+
+struct timer_wheel {
+        /* Units before clk are processed */
+        u64 clk;
+        struct list_head slots[TW_LEVELS][TW_SIZE];
+        /* The i-th bit of level l is set iff slots[l][i] is not empty */
+        u64 slot_bmp[TW_LEVELS];
+};
+
 void timer_init(void);
 void plat_timer_init(void);
 void plat_set_next_timer(u64 tick_delta);
 void handle_timer_irq(void);
 void plat_handle_timer_irq(u64 tick_delta);
 
+/* Tickless idle */
+void tick_sched_switch(struct thread *target);
+void tick_kick_cpu(u32 cpuid);
+void tick_kick_idle_cpu(void);
+void timer_sleep_thread(struct thread *thread, u64 expire);
+
 u64 plat_get_mono_time(void);
 u64 plat_get_current_tick(void);
 
 /* Syscalls */
 int sys_clock_gettime(clockid_t clock, struct timespec *ts);
+int sys_clock_nanosleep(clockid_t clock, int flags,
+                        const struct timespec *req, struct timespec *rem);
+int sys_nanosleep(const struct timespec *req, struct timespec *rem);
@@ -14,6 +14,7 @@
 
 #include <common/types.h>
 #include <common/list.h>
+#include <common/lock.h>
 
 /*
  * Supported Order: [0, BUDDY_MAX_ORDER).
@@ -23,6 +24,14 @@
 #define BUDDY_PAGE_SIZE (0x1000)
 #define BUDDY_MAX_ORDER (14UL)
 
+/*
+ * virt_to_page finds the pool of an address by its physical section of
+ * 2^BUDDY_SECTION_SHIFT bytes. Sections are tracked below BUDDY_PHYS_LIMIT.
+ */
+#define BUDDY_SECTION_SHIFT (24)
+#define BUDDY_PHYS_LIMIT    (1UL << 32)
+#define BUDDY_SECTION_NUM   (BUDDY_PHYS_LIMIT >> BUDDY_SECTION_SHIFT)
+
 /* Forward declaration */
 struct phys_mem_pool;
 
@@ -68,6 +77,11 @@ struct phys_mem_pool {
 
         /* The free list of different free-memory-chunk orders. */
         struct free_list free_lists[BUDDY_MAX_ORDER];
+        /* The order-th bit is set iff free_lists[order] is not empty */
+        unsigned long order_bmp;
+
+        /* Protects the free lists, and the allocated/order of free pages */
+        struct lock pool_lock;
 };
 
 extern struct phys_mem_pool global_mem[];
@@ -77,6 +91,8 @@ void init_buddy(struct phys_mem_pool *zone, struct page *start_page,
                 vaddr_t start_addr, u64 page_num);
 
 struct page *buddy_get_pages(struct phys_mem_pool *, u64 order);
+u64 buddy_get_pages_bulk(struct phys_mem_pool *, u64 order, u64 count,
+                         struct list_head *list);
 void buddy_free_pages(struct phys_mem_pool *, struct page *page);
 
 void *page_to_virt(struct page *page);
@@ -24,3 +24,7 @@ void kfree(void *ptr);
 /* return vaddr of (1 << order) continous free physical pages */
 void *get_pages(int order);
 void free_pages(void *addr);
+
+/* per-CPU caches of single pages */
+void init_pcp_lists(void);
+u64 get_free_mem_size_from_pcp(void);
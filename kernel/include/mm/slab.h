@@ -13,6 +13,9 @@
 #pragma once
 
 #include <common/types.h>
+#include <common/list.h>
+#include <common/lock.h>
+#include <machine.h>
 
 #define SLAB_INIT_SIZE (2 * 1024 * 1024) // 2M
 
@@ -20,11 +23,27 @@
 #define SLAB_MIN_ORDER (5)
 #define SLAB_MAX_ORDER (11)
 
+/* Empty slabs kept by a cache, more are given back to the buddy */
+#define SLAB_MAX_EMPTY (1)
+
+/* Typed caches size their slabs to hold at least SLAB_MIN_OBJS objects */
+#define SLAB_MIN_OBJS (64)
+
+/* Objects held by a per-CPU magazine, and moved by one refill or flush */
+#define SLAB_MAG_SIZE  (32)
+#define SLAB_MAG_BATCH (SLAB_MAG_SIZE / 2)
+
+struct slab_cache;
+
+/* At the start of each slab, followed by the objects */
 typedef struct slab_header slab_header_t;
 struct slab_header {
         void *free_list_head;
-        slab_header_t *next_slab;
-        int order;
+        struct slab_cache *cache;
+        /* In the partial, full or empty list of the cache */
+        struct list_head node;
+        u32 nr_free;
+        u32 nr_objs;
 };
 
 typedef struct slab_slot_list slab_slot_list_t;
@@ -32,9 +51,54 @@ struct slab_slot_list {
         void *next_free;
 };
 
+/*
+ * Free objects cached by one CPU. Only the owner CPU accesses it, with
+ * interrupts masked, so it needs no lock.
+ */
+struct slab_magazine {
+        u64 count;
+        void *objs[SLAB_MAG_SIZE];
+} __attribute__((aligned(CACHELINE_SZ)));
+
+/*
+ * The slabs of one object size: either a size class of kmalloc, or a typed
+ * cache created by kmem_cache_create.
+ */
+struct slab_cache {
+        const char *name;
+        u64 obj_size;
+        /* Offset of the first object in a slab, after the header */
+        u64 obj_offset;
+        /* Bytes of each slab, a power of 2 of pages */
+        u64 slab_size;
+        u64 nr_slabs;
+        /* Called on each object returned by kmem_cache_alloc */
+        void (*ctor)(void *obj);
+        /* In the list of all the caches */
+        struct list_head cache_node;
+        /* Slabs with some, no, and all objects free */
+        struct list_head partial;
+        struct list_head full;
+        struct list_head empty;
+        u64 nr_empty;
+        /* Protects the lists and the slabs on them */
+        struct lock lock;
+        struct slab_magazine mags[PLAT_CPU_NUM];
+};
+
 void init_slab(void);
 
 void *alloc_in_slab(u64);
 void free_in_slab(void *addr);
 
+struct slab_cache *kmem_cache_create(const char *name, u64 size, u64 align,
+                                     void (*ctor)(void *obj));
+void *kmem_cache_alloc(struct slab_cache *cache);
+void kmem_cache_free(struct slab_cache *cache, void *obj);
+/* Print the footprint of each cache */
+void kmem_cache_report(void);
+
+/* Give the empty slabs back to the buddy, returns the bytes released */
+u64 slab_shrink(void);
+
 u64 get_free_mem_size_from_slab(void);
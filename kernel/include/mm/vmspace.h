@@ -47,9 +47,17 @@ typedef u64 pmo_type_t;
 #define PMO_SHM          3 /* shared memory */
 #define PMO_DEVICE       5 /* memory mapped device registers */
 #define PMO_DATA_NOCACHE 6 /* non-cacheable immediate allocation */
+#define PMO_HUGE         7 /* lazy allocation in 2M blocks */
 
 #define PMO_FORBID 10 /* Forbidden area: avoid overflow */
 
+/*
+ * A PMO_HUGE is committed and mapped (by L2 block entries) in blocks of
+ * PMO_HUGE_PAGE_SIZE, and its vmregions are aligned to that size.
+ */
+#define PMO_HUGE_PAGE_ORDER (9)
+#define PMO_HUGE_PAGE_SIZE  (0x1000UL << PMO_HUGE_PAGE_ORDER)
+
 struct pmobject {
         struct radix *radix; /* record physical pages */
         paddr_t start;
@@ -69,9 +77,11 @@ int vmspace_unmap_range(struct vmspace *vmspace, vaddr_t va, size_t len);
 int unmap_pmo_in_vmspace(struct vmspace *vmspace, struct pmobject *pmo);
 
 struct vmregion *find_vmr_for_va(struct vmspace *vmspace, vaddr_t addr);
+void vmregion_cache_init(void);
 
 void switch_vmspace_to(struct vmspace *);
 
+/* @index is in pages, or in huge pages for PMO_HUGE */
 void commit_page_to_pmo(struct pmobject *pmo, u64 index, paddr_t pa);
 paddr_t get_page_from_pmo(struct pmobject *pmo, u64 index);
 
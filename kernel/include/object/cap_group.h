@@ -19,6 +19,7 @@
 #include <common/kprint.h>
 #include <common/macro.h>
 #include <arch/sync.h>
+#include <sched/sched.h>
 
 struct object_slot {
         u64 slot_id;
@@ -63,6 +64,10 @@ struct cap_group {
 
         /* Now is used for debugging */
         char cap_group_name[MAX_GROUP_NAME_LEN + 1];
+
+        /* Share of CPU time against other groups under the fair policy */
+        u32 sched_weight;
+        struct fair_group_ent fair_ents[PLAT_CPU_NUM];
 };
 
 #define current_cap_group (current_thread->cap_group)
@@ -72,6 +77,7 @@ struct cap_group {
  * As a cap user, check object.h for interfaces for cap.
  */
 int alloc_slot_id(struct cap_group *cap_group);
+int alloc_slot_ids(struct cap_group *cap_group, int *slot_ids, int n);
 
 static inline void free_slot_id(struct cap_group *cap_group, int slot_id)
 {
@@ -51,12 +51,17 @@ extern const obj_deinit_func obj_deinit_tbl[TYPE_NR];
 void *obj_get(struct cap_group *cap_group, int slot_id, int type);
 void obj_put(void *obj);
 
+void cap_slot_cache_init(void);
+struct object_slot *cap_slot_zalloc(void);
 void *obj_alloc(u64 type, u64 size);
 void obj_free(void *obj);
 int cap_alloc(struct cap_group *cap_group, void *obj, u64 rights);
 int cap_free(struct cap_group *cap_group, int slot_id);
 int cap_copy(struct cap_group *src_cap_group, struct cap_group *dest_cap_group,
              int src_slot_id);
+int cap_copy_n(struct cap_group *src_cap_group,
+               struct cap_group *dest_cap_group, const int *src_slot_ids,
+               int *dest_slot_ids, int n);
 int cap_move(struct cap_group *src_cap_group, struct cap_group *dest_cap_group,
              int src_slot_id);
 
@@ -68,4 +73,5 @@ int sys_cap_copy_from(u64 src_cap_group_cap, u64 src_slot_id);
 int sys_transfer_caps(u64 dest_group_cap, u64 src_caps_buf, int nr_caps,
                       u64 dst_caps_buf);
 int sys_cap_move(u64 dest_cap_group_cap, u64 src_slot_id);
+int sys_cap_free(u64 slot_id);
 int sys_get_all_caps(u64 cap_group_cap);
@@ -30,6 +30,7 @@ struct thread {
         struct list_head node; // link threads in a same cap_group
         struct list_head ready_queue_node; // link threads in a ready queue
         struct list_head sem_queue_node; // semaphore list
+        struct list_head sleep_node; // timer wheel slot while sleeping
         struct thread_ctx *thread_ctx; // thread control block
 
         /*
@@ -53,6 +54,11 @@ struct thread {
          */
         void *general_ipc_config;
         struct ipc_connection *active_conn;
+        /* Only exists for a client thread in sys_ipc_call_batch */
+        struct ipc_batch *ipc_batch;
+
+        /* When to wake up from sleep, in units of the timer wheel */
+        u64 sleep_expire;
 };
 
 void create_root_thread(void);
@@ -28,6 +28,12 @@ struct tm {
         int tm_isds; /* Daylight Savings flag. */
 };
 
+#define CLOCK_REALTIME  0
+#define CLOCK_MONOTONIC 1
+
+/* Flags of clock_nanosleep */
+#define TIMER_ABSTIME 1
+
 struct timespec {
         time_t tv_sec; /* Seconds. */
         time_t tv_nsec; /* Nanoseconds. */
@@ -14,6 +14,7 @@
 
 #include <sched/sched.h>
 
+void sched_cont_cache_init(void);
 struct thread_ctx *create_thread_ctx(u32 type);
 void destroy_thread_ctx(struct thread *thread);
 void init_thread_ctx(struct thread *thread, u64 stack, u64 func, u32 prio,
@@ -27,6 +28,7 @@ u64 arch_get_thread_next_ip(struct thread *thread);
 void arch_set_thread_info_page(struct thread *thread, u64 info_page_addr);
 void arch_set_thread_arg0(struct thread *thread, u64 arg);
 void arch_set_thread_arg1(struct thread *thread, u64 pid);
+void arch_set_thread_arg(struct thread *thread, u32 idx, u64 arg);
 void set_thread_arch_spec_state(struct thread *thread);
 
 void arch_enable_interrupt(struct thread *thread);
@@ -38,6 +38,9 @@ struct thread;
 
 #define NO_AFF -1
 
+/* Timer irqs between two load balances on each CPU */
+#define SCHED_BALANCE_TICKS 10
+
 /* Data structures */
 
 #define STATE_STR_LEN 20
@@ -74,11 +77,84 @@ enum thread_type {
         TYPE_TESTS = 4 /* TESTS thread is used by kernel tests */
 };
 
+/*
+ * Reservation (RSV) class beside RR: rsv_budget ticks in every rsv_period
+ * ticks on rsv_cpu, dispatched by EDF. rsv_period is 0 for best effort.
+ * rsv_deadline is in ticks of plat_get_current_tick.
+ */
 typedef struct sched_cont {
         u32 budget;
-        char pad[pad_to_cache_line(sizeof(u32))];
+        u32 rsv_period;
+        u32 rsv_budget;
+        u32 rsv_left;
+        u64 rsv_deadline;
+        u32 rsv_cpu;
+        char pad[pad_to_cache_line(5 * sizeof(u32) + sizeof(u64))];
 } sched_cont_t;
 
+/* Utilization of the reservations is in 1/RSV_UTIL_SCALE */
+#define RSV_UTIL_SCALE 1000
+/* Admitted utilization of a CPU, the rest is left to best effort */
+#define RSV_MAX_UTIL 900
+
+/* Parameters of sys_set_sched_param, period_ms = 0 for best effort */
+struct sched_rsv_param {
+        u32 period_ms;
+        u32 budget_ms;
+};
+
+/* Weights of cap_groups for the fair policy, in [1, SCHED_WEIGHT_MAX] */
+#define SCHED_WEIGHT_DEFAULT 1024
+#define SCHED_WEIGHT_MAX     (SCHED_WEIGHT_DEFAULT * 64)
+
+/*
+ * Share of a cap_group on one CPU for the fair policy: its threads ready
+ * there, and the virtual runtime charged to the group on the CPU.
+ */
+struct fair_group_ent {
+        /* In the group queue of the CPU while nr_ready > 0 */
+        struct list_head node;
+        /* Ready threads, sorted by vruntime */
+        struct list_head thread_queue;
+        u32 nr_ready;
+        u64 vruntime;
+        /* Lower bound of the vruntime of the threads, for placing them */
+        u64 min_vruntime;
+};
+
+/*
+ * Scheduling statistics of a thread, with times in ticks of
+ * plat_get_current_tick. Also the layout returned to the user.
+ */
+struct sched_stat {
+        u64 enqueue_cnt;
+        u64 dequeue_cnt;
+        /* Times switched in by switch_context */
+        u64 switch_cnt;
+        u64 oncpu_ticks;
+        /* From being enqueued to running: samples, total and max */
+        u64 wakeup_cnt;
+        u64 wakeup_lat_ticks;
+        u64 wakeup_lat_max;
+};
+
+/* Snapshot returned by sys_get_sched_stat */
+#define SCHED_STAT_MAX_CPU 16
+/* thread_cap of sys_get_sched_stat for the calling thread */
+#define SCHED_STAT_SELF    (-1)
+
+struct sched_snapshot {
+        /* The thread */
+        u32 cpuid;
+        u32 state;
+        u32 prio;
+        s32 affinity;
+        struct sched_stat stat;
+        /* Ready threads on each CPU */
+        u32 cpu_num;
+        u32 queue_len[SCHED_STAT_MAX_CPU];
+};
+
 /* Must be 8-byte aligned */
 struct thread_ctx {
         /* Executing Context */
@@ -93,10 +169,17 @@ struct thread_ctx {
         u32 prio;
         /* SMP Affinity */
         s32 affinity;
+        /* CPU preferred when enqueued without affinity, NO_AFF if none */
+        s32 wake_cpu;
         /* Current Assigned CPU */
         u32 cpuid;
         /* Thread exit state */
         volatile u32 thread_exit_state;
+        /* Statistics, and when the thread was enqueued (0 if not ready) */
+        struct sched_stat stat;
+        u64 ready_tick;
+        /* Time on CPU for the fair policy, in ticks of plat_get_current_tick */
+        u64 vruntime;
 } __attribute__((aligned(CACHELINE_SZ)));
 
 /* Debug functions */
@@ -113,6 +196,11 @@ void sched_handle_timer_irq(void);
 
 /* This interface is local to scheduler. */
 int switch_to_thread(struct thread *target);
+void init_idle_threads(const char *name);
+void sched_stat_enqueue(struct thread *thread);
+void sched_stat_dequeue(struct thread *thread);
+u32 sched_pick_cpu(struct thread *thread);
+void sched_charge_oncpu(void);
 
 /* This interface can be used in other places in the kernel. */
 void sched_to_thread(struct thread *target);
@@ -126,12 +214,46 @@ struct sched_ops {
         int (*sched)(void);
         int (*sched_enqueue)(struct thread *thread);
         int (*sched_dequeue)(struct thread *thread);
+        /* Periodic load balance on the current CPU, optional */
+        void (*sched_balance)(void);
+        /* Number of ready threads on @cpuid */
+        u32 (*sched_queue_len)(u32 cpuid);
+        /* Set the reservation in ticks (period 0 for none), optional */
+        int (*sched_set_param)(struct thread *thread, u32 period, u32 budget);
+        /* Charge @delta ticks on the current CPU to @thread, optional */
+        void (*sched_charge)(struct thread *thread, u64 delta);
         /* Debug tools */
         void (*sched_top)(void);
 };
 
 /* Provided Scheduling Policies */
 extern struct sched_ops rr; /* Simple Round Robin */
+extern struct sched_ops pbrr; /* Priority-based Round Robin */
+extern struct sched_ops fair; /* Weighted fair share across cap_groups */
+
+struct cap_group;
+void fair_init_cap_group(struct cap_group *cap_group);
+
+/* Reservation class in policy_rsv.c, which rr dispatches before its own */
+static inline bool sched_is_rsv(sched_cont_t *sc)
+{
+        return sc && sc->rsv_period;
+}
+
+void rsv_init(void);
+int rsv_sched_enqueue(struct thread *thread);
+int rsv_sched_dequeue(struct thread *thread);
+struct thread *rsv_sched_choose_thread(u32 cpuid);
+bool rsv_should_preempt(struct thread *thread, u32 cpuid);
+void rsv_throttle(struct thread *thread);
+int rsv_set_param(struct thread *thread, u32 period, u32 budget);
+void rsv_release(sched_cont_t *sc);
+u32 rsv_queue_len(u32 cpuid);
+
+/* Policy chosen at boot, e.g., -DBOOT_SCHED_POLICY=pbrr */
+#ifndef BOOT_SCHED_POLICY
+#define BOOT_SCHED_POLICY rr
+#endif
 
 /* Chosen Scheduling Policies */
 extern struct sched_ops *cur_sched_ops;
@@ -156,3 +278,6 @@ static inline int sched_dequeue(struct thread *thread)
 /* Syscalls */
 void sys_yield(void);
 void sys_top(void);
+int sys_get_sched_stat(u64 thread_cap, u64 snapshot_ptr);
+int sys_set_sched_param(u64 thread_cap, u64 param_ptr);
+int sys_set_cap_group_weight(u64 cap_group_cap, u32 weight);
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan PSL v1.
+ * You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v1 for more details.
+ */
+
+#pragma once
+
+#include <common/types.h>
+#include <common/macro.h>
+
+struct thread;
+
+/*
+ * Scheduler tracing: each CPU records timestamped events into its own
+ * ring, which sys_sched_trace_drain copies to the user in time order.
+ */
+
+enum sched_trace_type {
+        /* switch_to_thread, arg is the thread switched out (0 if none) */
+        SCHED_TRACE_SWITCH = 0,
+        /* Put into a ready queue, arg is the CPU of the queue */
+        SCHED_TRACE_ENQUEUE,
+        /* Removed from a ready queue, arg is the CPU of the queue */
+        SCHED_TRACE_DEQUEUE,
+        /* Woken up by signal_sem, arg is the signaling thread */
+        SCHED_TRACE_WAKEUP,
+        /* IPC migrates to the shadow thread, arg is the client thread */
+        SCHED_TRACE_MIGRATE,
+        /* Timer irq while the thread runs */
+        SCHED_TRACE_TIMER,
+        SCHED_TRACE_TYPE_NUM,
+};
+
+/*
+ * Also the layout returned to the user. Threads are identified by opaque
+ * ids, which are their kernel addresses.
+ */
+struct sched_trace_event {
+        /* In ticks of plat_get_current_tick */
+        u64 ts;
+        u64 thread;
+        u64 arg;
+        u32 type;
+        u32 cpuid;
+};
+
+/* Events kept on each CPU, a power of 2 */
+#define SCHED_TRACE_ENTRIES 1024
+
+/* ops of sys_sched_trace_ctl */
+#define SCHED_TRACE_OFF   0
+#define SCHED_TRACE_ON    1
+/* Drop the events recorded so far */
+#define SCHED_TRACE_RESET 2
+
+/*
+ * Tracing is off by default, when each trace point costs one load of a
+ * read-mostly flag and a branch predicted not taken.
+ */
+extern bool sched_trace_enabled;
+
+void __sched_trace(u32 type, struct thread *thread, u64 arg);
+
+static inline void sched_trace(u32 type, struct thread *thread, u64 arg)
+{
+        if (unlikely(sched_trace_enabled))
+                __sched_trace(type, thread, arg);
+}
+
+void sched_trace_init(void);
+
+/* Syscalls */
+int sys_sched_trace_ctl(u32 op);
+int sys_sched_trace_drain(u64 events_ptr, u64 count, u64 lost_ptr);
@@ -16,57 +16,293 @@
 #include <mm/mm.h>
 #include <sched/context.h>
 #include <irq/irq.h>
+#include <sched/trace.h>
 
 /* Impl in memory.c */
 int pmo_init(struct pmobject *pmo, pmo_type_t type, size_t len, paddr_t paddr);
-
-void connection_deinit(void *conn)
-{
-        /* For now, no de-initialization is required */
-}
+void pmo_deinit(void *pmo_ptr);
 
 /**
- * Helper function called when an ipc_connection is created
+ * Build a shadow thread for the server together with its stack, which is
+ * placed at the @idx-th stack slot of the server's vm_config.
  */
-static struct thread *create_server_thread(struct thread *src)
+static struct thread *create_shadow_thread(struct thread *server, u64 idx)
 {
         struct thread *new;
-        struct server_ipc_config *new_config;
-        struct server_ipc_config *src_config;
+        struct server_ipc_config *server_config;
+        struct shadow_ipc_config *shadow_config;
+        struct pmobject *stack_pmo;
+        int r;
 
-        new = kmalloc(sizeof(struct thread));
-        BUG_ON(new == NULL);
+        server_config = (struct server_ipc_config *)server->general_ipc_config;
 
-        new->vmspace = obj_get(src->cap_group, VMSPACE_OBJ_ID, TYPE_VMSPACE);
+        new = kzalloc(sizeof(struct thread));
+        if (!new)
+                goto out_fail;
+
+        new->vmspace = obj_get(server->cap_group, VMSPACE_OBJ_ID, TYPE_VMSPACE);
         BUG_ON(!new->vmspace);
+        obj_put(new->vmspace);
 
         // Init the thread ctx
         new->thread_ctx = create_thread_ctx(TYPE_SHADOW);
         if (!new->thread_ctx)
-                goto out_fail;
+                goto out_free_thread;
         memcpy((char *)&(new->thread_ctx->ec),
-               (const char *)&(src->thread_ctx->ec),
+               (const char *)&(server->thread_ctx->ec),
                sizeof(arch_exec_cont_t));
+        arch_fpu_init_thread(new);
         new->thread_ctx->prio = MAX_PRIO - 1;
         new->thread_ctx->state = TS_INIT;
         new->thread_ctx->affinity = NO_AFF;
+        new->thread_ctx->wake_cpu = NO_AFF;
         new->thread_ctx->type = TYPE_SHADOW;
 
-        src_config = (struct server_ipc_config *)src->general_ipc_config;
-        new_config = kzalloc(sizeof(struct server_ipc_config));
-        BUG_ON(new_config == 0);
-        new_config->callback = src_config->callback;
-        new_config->vm_config = src_config->vm_config;
-        new->general_ipc_config = new_config;
-        new->cap_group = src->cap_group;
-        obj_put(new->vmspace);
+        shadow_config = kzalloc(sizeof(struct shadow_ipc_config));
+        if (!shadow_config)
+                goto out_destroy_ctx;
+        shadow_config->callback = server_config->callback;
+        shadow_config->server_config = server_config;
+        shadow_config->stack_size = server_config->vm_config.stack_size;
+        shadow_config->stack_base = server_config->vm_config.stack_base_addr
+                                    + idx * shadow_config->stack_size;
+
+        // Create and map the shadow thread's stack
+        stack_pmo = kmalloc(sizeof(struct pmobject));
+        if (!stack_pmo)
+                goto out_free_config;
+        r = pmo_init(stack_pmo, PMO_DATA, shadow_config->stack_size, 0);
+        if (r < 0)
+                goto out_kfree_stack_pmo;
+        r = vmspace_map_range(new->vmspace,
+                              shadow_config->stack_base,
+                              shadow_config->stack_size,
+                              VMR_READ | VMR_WRITE,
+                              stack_pmo);
+        if (r < 0)
+                goto out_free_stack_pmo;
+        shadow_config->stack_pmo = stack_pmo;
+
+        new->general_ipc_config = shadow_config;
+        new->cap_group = server->cap_group;
+        server_config->shadows[idx] = new;
         return new;
-out_fail:
-        obj_put(new->vmspace);
+
+out_free_stack_pmo:
+        pmo_deinit(stack_pmo);
+out_kfree_stack_pmo:
+        kfree(stack_pmo);
+out_free_config:
+        kfree(shadow_config);
+out_destroy_ctx:
+        destroy_thread_ctx(new);
+out_free_thread:
         kfree(new);
+out_fail:
         return NULL;
 }
 
+static void destroy_shadow_thread(struct thread *shadow)
+{
+        struct shadow_ipc_config *shadow_config;
+        struct server_ipc_config *server_config;
+        u64 idx;
+
+        shadow_config = (struct shadow_ipc_config *)shadow->general_ipc_config;
+        server_config = shadow_config->server_config;
+        idx = (shadow_config->stack_base
+               - server_config->vm_config.stack_base_addr)
+              / shadow_config->stack_size;
+        server_config->shadows[idx] = NULL;
+
+        vmspace_unmap_range(shadow->vmspace,
+                            shadow_config->stack_base,
+                            shadow_config->stack_size);
+        pmo_deinit(shadow_config->stack_pmo);
+        kfree(shadow_config->stack_pmo);
+        kfree(shadow_config);
+        destroy_thread_ctx(shadow);
+        kfree(shadow);
+}
+
+/**
+ * Take an idle shadow thread from the server's pool.
+ * A new one is built only when the pool is empty and the server still has
+ * free stack slots.
+ */
+static struct thread *shadow_pool_get(struct thread *server)
+{
+        struct server_ipc_config *server_config;
+        struct thread *shadow;
+        u64 idx, slot_num;
+
+        server_config = (struct server_ipc_config *)server->general_ipc_config;
+        if (!list_empty(&server_config->shadow_pool)) {
+                shadow = list_entry(
+                        server_config->shadow_pool.next, struct thread, node);
+                list_del(&shadow->node);
+                server_config->shadow_pool_cnt--;
+                return shadow;
+        }
+
+        /* Take the first stack slot freed by destroy_shadow_thread */
+        slot_num = server_config->max_client * IPC_MAX_SHADOW_PER_CONN;
+        for (idx = 0; idx < slot_num; idx++)
+                if (!server_config->shadows[idx])
+                        break;
+        if (idx == slot_num)
+                return NULL;
+        shadow = create_shadow_thread(server, idx);
+        if (shadow)
+                server_config->shadow_cnt++;
+        return shadow;
+}
+
+/**
+ * Give a shadow thread back to its server's pool.
+ * Its stack stays mapped so that the next connection can use it directly,
+ * unless the pool is full, in which case the shadow thread is destroyed.
+ * The shadow thread running now is always kept, since the kernel is still
+ * on its kernel stack (e.g., connection_deinit in thread_migrate_to_client).
+ */
+static void shadow_pool_put(struct thread *shadow)
+{
+        struct shadow_ipc_config *shadow_config;
+        struct server_ipc_config *server_config;
+
+        shadow_config = (struct shadow_ipc_config *)shadow->general_ipc_config;
+        server_config = shadow_config->server_config;
+        if (server_config->shadow_pool_cnt >= IPC_SHADOW_POOL_PREALLOC
+            && shadow != current_thread) {
+                destroy_shadow_thread(shadow);
+                server_config->shadow_cnt--;
+                return;
+        }
+
+        shadow_config->source = NULL;
+        shadow_config->ipc_msg = NULL;
+        shadow->active_conn = NULL;
+        shadow->prev_thread = NULL;
+        shadow->thread_ctx->sc = NULL;
+        shadow->thread_ctx->wake_cpu = NO_AFF;
+        shadow->thread_ctx->state = TS_INIT;
+        list_add(&shadow->node, &server_config->shadow_pool);
+        server_config->shadow_pool_cnt++;
+}
+
+/**
+ * Take an idle shadow thread of @conn for a new call.
+ * The connection grows up to IPC_MAX_SHADOW_PER_CONN shadow threads from
+ * the server's pool, so that its calls are served concurrently.
+ */
+static struct thread *conn_get_shadow(struct ipc_connection *conn)
+{
+        struct thread *shadow;
+
+        if (!list_empty(&conn->idle_shadows)) {
+                shadow = list_entry(
+                        conn->idle_shadows.next, struct thread, node);
+                list_del(&shadow->node);
+                return shadow;
+        }
+
+        if (conn->shadow_num >= IPC_MAX_SHADOW_PER_CONN)
+                return NULL;
+        shadow = shadow_pool_get(conn->server);
+        if (shadow)
+                conn->shadow_num++;
+        return shadow;
+}
+
+/* Give a shadow thread back to @conn once its call is finished */
+static void conn_put_shadow(struct ipc_connection *conn, struct thread *shadow)
+{
+        struct shadow_ipc_config *shadow_config;
+
+        shadow_config = (struct shadow_ipc_config *)shadow->general_ipc_config;
+        shadow_config->source = NULL;
+        shadow_config->ipc_msg = NULL;
+        shadow->active_conn = NULL;
+        shadow->thread_ctx->wake_cpu = NO_AFF;
+        list_add(&shadow->node, &conn->idle_shadows);
+}
+
+/**
+ * Called when the last cap of the connection is freed (e.g., by
+ * sys_ipc_close_connection) and no call is in flight.
+ * All the resources taken in create_connection are given back, so that the
+ * server can accept another client in the slot.
+ */
+void connection_deinit(void *ptr)
+{
+        struct ipc_connection *conn = (struct ipc_connection *)ptr;
+        struct server_ipc_config *server_config;
+        struct thread *shadow, *tmp;
+
+        server_config = (struct server_ipc_config *)
+                                conn->server->general_ipc_config;
+
+        /* A call holds a reference, so all the shadow threads are idle */
+        for_each_in_list_safe (shadow, tmp, node, &conn->idle_shadows) {
+                list_del(&shadow->node);
+                shadow_pool_put(shadow);
+        }
+
+        vmspace_unmap_range(conn->client_vmspace,
+                            conn->buf.client_user_addr,
+                            conn->buf.size);
+        vmspace_unmap_range(conn->server->vmspace,
+                            conn->buf.server_user_addr,
+                            conn->buf.size);
+        pmo_deinit(conn->buf_pmo);
+        kfree(conn->buf_pmo);
+
+        server_config->conns[conn->conn_idx] = NULL;
+        clear_bit(conn->conn_idx, server_config->conn_bmp);
+}
+
+/**
+ * Place a shared buffer of @size in the server's buffer area (first fit).
+ * Returns 0 if there is no room left.
+ */
+static u64 alloc_server_buf(struct server_ipc_config *config, u64 size)
+{
+        struct ipc_vm_config *vm_config = &config->vm_config;
+        struct shadow_ipc_config *shadow_config;
+        struct shared_buf *buf;
+        u64 addr, area_end;
+        int i;
+
+        addr = vm_config->buf_base_addr;
+        area_end = vm_config->buf_base_addr + vm_config->buf_area_size;
+retry:
+        if (addr + size > area_end)
+                return 0;
+        /* Both the shared buffers and the windows take the area */
+        for_each_set_bit (i, config->conn_bmp, config->max_client) {
+                buf = &config->conns[i]->buf;
+                if (addr < buf->server_user_addr + buf->size
+                    && buf->server_user_addr < addr + size) {
+                        /* Overlapped: try right after it */
+                        addr = buf->server_user_addr + buf->size;
+                        goto retry;
+                }
+        }
+        for (i = 0; i < config->max_client * IPC_MAX_SHADOW_PER_CONN; i++) {
+                if (!config->shadows[i])
+                        continue;
+                shadow_config = (struct shadow_ipc_config *)config->shadows[i]
+                                        ->general_ipc_config;
+                buf = &shadow_config->window;
+                if (addr < buf->server_user_addr + buf->size
+                    && buf->server_user_addr < addr + size) {
+                        addr = buf->server_user_addr + buf->size;
+                        goto retry;
+                }
+        }
+        return addr;
+}
+
 /**
  * Helper function to create an ipc_connection by the client thread
  */
@@ -76,12 +312,14 @@ static int create_connection(struct thread *source, struct thread *target,
         struct ipc_connection *conn = NULL;
         int ret = 0;
         int conn_cap = 0, server_conn_cap = 0;
-        struct pmobject *stack_pmo, *buf_pmo;
+        struct pmobject *buf_pmo;
         int conn_idx;
         struct server_ipc_config *server_ipc_config;
+        struct shadow_ipc_config *shadow_config;
+        struct thread *shadow;
         struct ipc_vm_config *vm_config;
-        u64 server_stack_base, server_buf_base, client_buf_base;
-        u64 stack_size, buf_size;
+        u64 server_buf_base, client_buf_base;
+        u64 buf_size;
 
         BUG_ON(source == NULL);
         BUG_ON(target == NULL);
@@ -92,107 +330,241 @@ static int create_connection(struct thread *source, struct thread *target,
                 ret = -ENOMEM;
                 goto out_fail;
         }
-        conn->target = create_server_thread(target);
-        if (!conn->target) {
+        // Take a pre-built shadow thread (and its stack) from the pool,
+        // more are taken on demand when calls are issued concurrently
+        shadow = shadow_pool_get(target);
+        if (!shadow) {
                 ret = -ENOMEM;
-                goto out_fail;
+                goto out_free_obj;
         }
+        shadow_config = (struct shadow_ipc_config *)shadow->general_ipc_config;
+        conn->server = target;
+        init_list_head(&conn->idle_shadows);
+        list_add(&shadow->node, &conn->idle_shadows);
+        conn->shadow_num = 1;
+        conn->callback = shadow_config->callback;
+
         // Get the server's ipc config
         server_ipc_config = target->general_ipc_config;
         vm_config = &server_ipc_config->vm_config;
         conn_idx = find_next_zero_bit(
                 server_ipc_config->conn_bmp, server_ipc_config->max_client, 0);
-        set_bit(conn_idx, server_ipc_config->conn_bmp);
-
-        // Create the server thread's stack
-        server_stack_base =
-                vm_config->stack_base_addr + conn_idx * vm_config->stack_size;
-        stack_size = vm_config->stack_size;
-        stack_pmo = kmalloc(sizeof(struct pmobject));
-        if (!stack_pmo) {
-                ret = -ENOMEM;
-                goto out_free_obj;
+        if (conn_idx >= server_ipc_config->max_client) {
+                ret = -ENOSPC;
+                goto out_put_shadow;
         }
-        pmo_init(stack_pmo, PMO_DATA, stack_size, 0);
-        vmspace_map_range(target->vmspace,
-                          server_stack_base,
-                          stack_size,
-                          VMR_READ | VMR_WRITE,
-                          stack_pmo);
 
-        conn->server_stack_top = server_stack_base + stack_size;
+        // Negotiate the buffer size: the client asks, the kernel caps it
+        buf_size = client_vm_config->buf_size;
+        if (buf_size == 0)
+                buf_size = vm_config->buf_size;
+        buf_size = MIN(buf_size, IPC_MAX_BUF_SIZE);
+        client_vm_config->buf_size = buf_size;
 
-        // Create and map the shared buffer for client and server
-        server_buf_base =
-                vm_config->buf_base_addr + conn_idx * vm_config->buf_size;
+        // Place the shared buffer in the server's buffer area
+        server_buf_base = alloc_server_buf(server_ipc_config, buf_size);
+        if (server_buf_base == 0) {
+                ret = -ENOSPC;
+                goto out_put_shadow;
+        }
         client_buf_base = client_vm_config->buf_base_addr;
-        buf_size = MIN(vm_config->buf_size, client_vm_config->buf_size);
-        client_vm_config->buf_size = buf_size;
 
+        // Create and map the shared buffer for client and server
         buf_pmo = kmalloc(sizeof(struct pmobject));
         if (!buf_pmo) {
                 ret = -ENOMEM;
-                goto out_free_stack_pmo;
+                goto out_put_shadow;
         }
-        pmo_init(buf_pmo, PMO_DATA, buf_size, 0);
-
-        vmspace_map_range(source->vmspace,
-                          client_buf_base,
-                          buf_size,
-                          VMR_READ | VMR_WRITE,
-                          buf_pmo);
-        vmspace_map_range(target->vmspace,
-                          server_buf_base,
-                          buf_size,
-                          VMR_READ | VMR_WRITE,
-                          buf_pmo);
+        /* Up to IPC_MAX_BUF_SIZE of continuous memory, which may run out */
+        ret = pmo_init(buf_pmo, PMO_DATA, buf_size, 0);
+        if (ret < 0)
+                goto out_kfree_buf_pmo;
+
+        ret = vmspace_map_range(source->vmspace,
+                                client_buf_base,
+                                buf_size,
+                                VMR_READ | VMR_WRITE,
+                                buf_pmo);
+        if (ret < 0)
+                goto out_free_buf_pmo;
+        ret = vmspace_map_range(target->vmspace,
+                                server_buf_base,
+                                buf_size,
+                                VMR_READ | VMR_WRITE,
+                                buf_pmo);
+        if (ret < 0)
+                goto out_unmap_client_buf;
 
         conn->buf.client_user_addr = client_buf_base;
         conn->buf.server_user_addr = server_buf_base;
+        conn->buf.size = buf_size;
+        conn->buf_pmo = buf_pmo;
+        conn->client_vmspace = source->vmspace;
+        conn->conn_idx = conn_idx;
+        server_ipc_config->conns[conn_idx] = conn;
+        set_bit(conn_idx, server_ipc_config->conn_bmp);
 
         conn_cap = cap_alloc(current_cap_group, conn, 0);
         if (conn_cap < 0) {
                 ret = conn_cap;
-                goto out_free_obj;
+                goto out_clear_conn_idx;
         }
 
         server_conn_cap =
                 cap_copy(current_cap_group, target->cap_group, conn_cap);
         if (server_conn_cap < 0) {
-                ret = server_conn_cap;
-                goto out_free_obj;
+                /* Freeing the only cap runs connection_deinit, undoing all */
+                cap_free(current_cap_group, conn_cap);
+                return server_conn_cap;
         }
         conn->server_conn_cap = server_conn_cap;
 
         return conn_cap;
-out_free_stack_pmo:
-        kfree(stack_pmo);
+out_clear_conn_idx:
+        server_ipc_config->conns[conn_idx] = NULL;
+        clear_bit(conn_idx, server_ipc_config->conn_bmp);
+        vmspace_unmap_range(target->vmspace, server_buf_base, buf_size);
+out_unmap_client_buf:
+        vmspace_unmap_range(source->vmspace, client_buf_base, buf_size);
+out_free_buf_pmo:
+        pmo_deinit(buf_pmo);
+out_kfree_buf_pmo:
+        kfree(buf_pmo);
+out_put_shadow:
+        list_del(&shadow->node);
+        shadow_pool_put(shadow);
 out_free_obj:
         obj_free(conn);
 out_fail:
         return ret;
 }
 
+/**
+ * Map a window of a client's pmo into the server for the current call.
+ * @slots points to the IPC_WINDOW_SLOTS cap slots describing the window,
+ * and the mapping is recorded in shadow_config->window.
+ * The pages are mapped eagerly so that the server never faults on them.
+ */
+static int ipc_map_window(struct thread *shadow, u64 *slots)
+{
+        struct server_ipc_config *server_config;
+        struct shadow_ipc_config *shadow_config;
+        struct vmspace *vmspace = shadow->vmspace;
+        struct pmobject *pmo;
+        vmr_prop_t perm;
+        u64 offset, len, addr, i;
+        paddr_t pa;
+        void *page;
+        int r;
+
+        shadow_config = (struct shadow_ipc_config *)shadow->general_ipc_config;
+        offset = slots[1];
+        len = slots[2];
+        if (shadow_config->window.size != 0 || len == 0
+            || !IS_ALIGNED(offset, PAGE_SIZE) || !IS_ALIGNED(len, PAGE_SIZE))
+                return -EINVAL;
+
+        pmo = obj_get(current_cap_group,
+                      slots[0] & ~(IPC_MSG_WINDOW | IPC_MSG_WINDOW_WRITE),
+                      TYPE_PMO);
+        if (!pmo)
+                return -ECAPBILITY;
+        /* Windows are mapped by pages, while PMO_HUGE is committed in blocks */
+        if (offset + len < offset || offset + len > pmo->size
+            || pmo->type == PMO_FORBID || pmo->type == PMO_HUGE) {
+                r = -EINVAL;
+                goto out_put_pmo;
+        }
+
+        server_config = shadow_config->server_config;
+        addr = alloc_server_buf(server_config, len);
+        if (addr == 0) {
+                r = -ENOSPC;
+                goto out_put_pmo;
+        }
+
+        perm = VMR_READ | (slots[0] & IPC_MSG_WINDOW_WRITE ? VMR_WRITE : 0);
+        switch (pmo->type) {
+        case PMO_ANONYM:
+        case PMO_SHM:
+                /* Commit the missing pages as the page fault handler does */
+                for (i = 0; i < len; i += PAGE_SIZE) {
+                        pa = get_page_from_pmo(pmo, (offset + i) / PAGE_SIZE);
+                        if (pa == 0) {
+                                page = get_pages(0);
+                                if (!page) {
+                                        r = -ENOMEM;
+                                        goto out_unmap;
+                                }
+                                memset(page, 0, PAGE_SIZE);
+                                pa = virt_to_phys(page);
+                                commit_page_to_pmo(
+                                        pmo, (offset + i) / PAGE_SIZE, pa);
+                        }
+                        map_range_in_pgtbl(
+                                vmspace->pgtbl, addr + i, pa, PAGE_SIZE, perm);
+                }
+                break;
+        default:
+                /* Physically continuous pmos */
+                map_range_in_pgtbl(
+                        vmspace->pgtbl, addr, pmo->start + offset, len, perm);
+                break;
+        }
+
+        shadow_config->window.client_user_addr = 0;
+        shadow_config->window.server_user_addr = addr;
+        shadow_config->window.size = len;
+        shadow_config->window_pmo = pmo;
+        return 0;
+
+out_unmap:
+        unmap_range_in_pgtbl(vmspace->pgtbl, addr, i);
+        flush_tlbs(vmspace, addr, i);
+out_put_pmo:
+        obj_put(pmo);
+        return r;
+}
+
+/* Remove the window mapped by ipc_map_window, if any */
+static void ipc_unmap_window(struct thread *shadow)
+{
+        struct shadow_ipc_config *shadow_config;
+        struct shared_buf *window;
+
+        shadow_config = (struct shadow_ipc_config *)shadow->general_ipc_config;
+        window = &shadow_config->window;
+        if (window->size == 0)
+                return;
+
+        unmap_range_in_pgtbl(
+                shadow->vmspace->pgtbl, window->server_user_addr, window->size);
+        flush_tlbs(shadow->vmspace, window->server_user_addr, window->size);
+        obj_put(shadow_config->window_pmo);
+        shadow_config->window_pmo = NULL;
+        window->server_user_addr = 0;
+        window->size = 0;
+}
+
 /**
  * Client thread calls this function and then return to server thread
  * This function should never return
+ * The shadow thread has been taken for the call by sys_ipc_call, which
+ * keeps the reference of the connection until the call returns.
  */
-static u64 thread_migrate_to_server(struct ipc_connection *conn, u64 arg)
+static u64 thread_migrate_to_server(struct thread *target, u64 arg)
 {
-        struct thread *target = conn->target;
-        struct server_ipc_config *target_ipc_config =
-                (struct server_ipc_config *)(target->general_ipc_config);
+        struct shadow_ipc_config *shadow_config;
+        struct ipc_connection *conn = target->active_conn;
 
-        conn->source = current_thread;
-        conn->callback = target_ipc_config->callback;
-        target->active_conn = conn;
+        shadow_config = (struct shadow_ipc_config *)target->general_ipc_config;
         current_thread->thread_ctx->state = TS_WAITING;
-        obj_put(conn);
 
         /**
          * This command set the sp register
          */
-        arch_set_thread_stack(target, conn->server_stack_top);
+        arch_set_thread_stack(
+                target, shadow_config->stack_base + shadow_config->stack_size);
         /**
          * This command set the ip register
          */
@@ -201,7 +573,16 @@ static u64 thread_migrate_to_server(struct ipc_connection *conn, u64 arg)
          * The argument set by sys_ipc_call;
          */
         arch_set_thread_arg0(target, arg);
-        arch_set_thread_arg1(target, conn->source->cap_group->pid);
+        arch_set_thread_arg1(target, current_thread->cap_group->pid);
+        /**
+         * The window of an ipc_msg call (0 and 0 if none), which is only
+         * written by the kernel, unlike the cap slots in the ipc_msg
+         */
+        if (arg) {
+                arch_set_thread_arg(
+                        target, 2, shadow_config->window.server_user_addr);
+                arch_set_thread_arg(target, 3, shadow_config->window.size);
+        }
 
         /**
          * Passing the scheduling context of the current thread to thread of
@@ -209,6 +590,14 @@ static u64 thread_migrate_to_server(struct ipc_connection *conn, u64 arg)
          */
         target->thread_ctx->sc = current_thread->thread_ctx->sc;
 
+        /**
+         * Wake-affine: if the handler blocks, it is woken up on the CPU of
+         * the client, which shares the IPC buffer in its cache
+         */
+        target->thread_ctx->wake_cpu = smp_get_cpu_id();
+
+        sched_trace(SCHED_TRACE_MIGRATE, target, (u64)current_thread);
+
         /**
          * Switch to the server
          */
@@ -220,14 +609,36 @@ static u64 thread_migrate_to_server(struct ipc_connection *conn, u64 arg)
         return 0;
 }
 
+static s64 ipc_batch_issue(struct ipc_batch *batch);
+
 /**
  * Server thread calls this function and then return to client thread
  * This function should never return
+ * If the client is in a batch, its next call is issued before it goes
+ * back to EL0.
  */
-static int thread_migrate_to_client(struct ipc_connection *conn, u64 ret_value)
+static int thread_migrate_to_client(struct thread *shadow, u64 ret_value)
 {
-        struct thread *source = conn->source;
-        current_thread->active_conn = NULL;
+        struct shadow_ipc_config *shadow_config;
+        struct ipc_connection *conn = shadow->active_conn;
+        struct thread *source;
+        struct ipc_batch *batch;
+        u64 ctx;
+
+        shadow_config = (struct shadow_ipc_config *)shadow->general_ipc_config;
+        source = shadow_config->source;
+
+        /**
+         * The pmo window granted by the client is only valid in the call
+         */
+        ipc_unmap_window(shadow);
+
+        /**
+         * The shadow thread serves the next call of the connection, and the
+         * reference taken by sys_ipc_call is dropped
+         */
+        conn_put_shadow(conn, shadow);
+        obj_put(conn);
 
         /**
          * The return value returned by server thread;
@@ -238,7 +649,18 @@ static int thread_migrate_to_client(struct ipc_connection *conn, u64 ret_value)
          * Switch to the client
          */
         switch_to_thread(source);
-        eret_to_thread(switch_context());
+        ctx = switch_context();
+
+        /**
+         * Now in the client's vmspace, go on with its batch, which never
+         * returns if another call is issued
+         */
+        if (source->ipc_batch) {
+                batch = source->ipc_batch;
+                batch->rets[batch->cur++] = ret_value;
+                arch_set_thread_return(source, ipc_batch_issue(batch));
+        }
+        eret_to_thread(ctx);
 
         /* Function never return */
         BUG_ON(1);
@@ -249,13 +671,18 @@ static int thread_migrate_to_client(struct ipc_connection *conn, u64 ret_value)
  * A helper function to transfer all the ipc_msg's capbilities of client's
  * process to server's process
  */
-int ipc_send_cap(struct ipc_connection *conn)
+int ipc_send_cap(struct thread *shadow)
 {
-        int i, r;
+        int i, r, nr_caps;
         u64 cap_slot_number;
         u64 cap_slots_offset;
-        u64 *cap_buf;
-        ipc_msg_t *ipc_msg = conn->ipc_msg;
+        /* cap_slot_number is bounded, so no kmalloc is needed on this path */
+        u64 cap_buf[MAX_CAP_TRANSFER];
+        int src_caps[MAX_CAP_TRANSFER];
+        int dest_caps[MAX_CAP_TRANSFER];
+        int cap_idx[MAX_CAP_TRANSFER];
+        struct shadow_ipc_config *shadow_config = shadow->general_ipc_config;
+        ipc_msg_t *ipc_msg = shadow_config->ipc_msg;
 
         r = copy_from_user((char *)&cap_slot_number,
                            (char *)&ipc_msg->cap_slot_number,
@@ -276,42 +703,54 @@ int ipc_send_cap(struct ipc_connection *conn)
         if (r < 0)
                 goto out;
 
-        cap_buf = kmalloc(cap_slot_number * sizeof(*cap_buf));
-        if (!cap_buf) {
-                r = -ENOMEM;
-                goto out;
-        }
-
         r = copy_from_user((char *)cap_buf,
                            (char *)ipc_msg + cap_slots_offset,
                            sizeof(*cap_buf) * cap_slot_number);
         if (r < 0)
                 goto out;
 
+        nr_caps = 0;
         for (i = 0; i < cap_slot_number; i++) {
-                u64 dest_cap;
-
-                /* copy the cap to server and update the cap_buf */
-                dest_cap = cap_copy(
-                        current_cap_group, conn->target->cap_group, cap_buf[i]);
-                if (dest_cap < 0)
-                        goto out_free_cap;
-                cap_buf[i] = dest_cap;
+                /* map the pmo window instead of copying a cap */
+                if (cap_buf[i] & IPC_MSG_WINDOW) {
+                        if (i + IPC_WINDOW_SLOTS > cap_slot_number) {
+                                r = -EINVAL;
+                                goto out_unmap_window;
+                        }
+                        r = ipc_map_window(shadow, &cap_buf[i]);
+                        if (r < 0)
+                                goto out_unmap_window;
+                        i += IPC_WINDOW_SLOTS - 1;
+                        continue;
+                }
+                cap_idx[nr_caps] = i;
+                src_caps[nr_caps++] = cap_buf[i];
         }
 
+        /* copy the caps to server at once and update the cap_buf */
+        r = cap_copy_n(current_cap_group,
+                       shadow->cap_group,
+                       src_caps,
+                       dest_caps,
+                       nr_caps);
+        if (r < 0)
+                goto out_unmap_window;
+        for (i = 0; i < nr_caps; i++)
+                cap_buf[cap_idx[i]] = dest_caps[i];
+
         r = copy_to_user((char *)ipc_msg + cap_slots_offset,
                          (char *)cap_buf,
                          sizeof(*cap_buf) * cap_slot_number);
         if (r < 0)
                 goto out_free_cap;
 
-        kfree(cap_buf);
         return 0;
 
 out_free_cap:
-        for (--i; i >= 0; i--)
-                cap_free(conn->target->cap_group, cap_buf[i]);
-        kfree(cap_buf);
+        for (i = 0; i < nr_caps; i++)
+                cap_free(shadow->cap_group, dest_caps[i]);
+out_unmap_window:
+        ipc_unmap_window(shadow);
 out:
         return r;
 }
@@ -320,37 +759,70 @@ out:
  * A helper function to transfer all the ipc_msg's capbilities of server's
  * process to client's process
  */
-static void ipc_send_cap_to_client(struct ipc_connection *conn, u64 cap_num)
+static void ipc_send_cap_to_client(struct thread *shadow, u64 cap_num)
 {
         int r, i;
-        u64 ret_cap;
+        u64 cap_slots_offset, msg_offset;
+        u64 cap_buf[MAX_CAP_TRANSFER];
+        int src_caps[MAX_CAP_TRANSFER];
+        int dest_caps[MAX_CAP_TRANSFER];
         struct ipc_msg *server_ipc_msg;
-        struct ipc_msg *ipc_msg = conn->ipc_msg;
+        struct ipc_connection *conn = shadow->active_conn;
+        struct shadow_ipc_config *shadow_config = shadow->general_ipc_config;
+        struct ipc_msg *ipc_msg = shadow_config->ipc_msg;
 
         if (cap_num == 0)
                 return;
+        if (cap_num >= MAX_CAP_TRANSFER) {
+                kwarn("%s: too many caps %llu\n", __func__, cap_num);
+                return;
+        }
 
         server_ipc_msg =
                 (struct ipc_msg *)((u64)ipc_msg - conn->buf.client_user_addr
                                    + conn->buf.server_user_addr);
 
-        for (i = 0; i < cap_num; ++i) {
-                r = copy_from_user((char *)&ret_cap,
-                                   (char *)server_ipc_msg
-                                           + server_ipc_msg->cap_slots_offset
-                                           + sizeof(ret_cap) * i,
-                                   sizeof(ret_cap));
-                BUG_ON(r < 0);
-
-                ret_cap = cap_copy(
-                        current_cap_group, conn->source->cap_group, ret_cap);
-                BUG_ON(ret_cap < 0);
-                r = copy_to_user((char *)server_ipc_msg
-                                         + server_ipc_msg->cap_slots_offset
-                                         + sizeof(ret_cap) * i,
-                                 (char *)&ret_cap,
-                                 sizeof(ret_cap));
-                BUG_ON(r < 0);
+        r = copy_from_user((char *)&cap_slots_offset,
+                           (char *)&server_ipc_msg->cap_slots_offset,
+                           sizeof(cap_slots_offset));
+        if (r < 0)
+                return;
+        /* Written by the server, so keep the slots in the shared buffer */
+        msg_offset = (u64)ipc_msg - conn->buf.client_user_addr;
+        if (cap_slots_offset > conn->buf.size - msg_offset
+            || sizeof(*cap_buf) * cap_num
+                       > conn->buf.size - msg_offset - cap_slots_offset) {
+                kwarn("%s: cap slots out of the buffer\n", __func__);
+                return;
+        }
+        r = copy_from_user((char *)cap_buf,
+                           (char *)server_ipc_msg + cap_slots_offset,
+                           sizeof(*cap_buf) * cap_num);
+        if (r < 0)
+                return;
+
+        for (i = 0; i < cap_num; ++i)
+                src_caps[i] = cap_buf[i];
+        r = cap_copy_n(current_cap_group,
+                       shadow_config->source->cap_group,
+                       src_caps,
+                       dest_caps,
+                       cap_num);
+        if (r < 0) {
+                kwarn("%s: fail to copy caps (ret: %d)\n", __func__, r);
+                return;
+        }
+        for (i = 0; i < cap_num; ++i)
+                cap_buf[i] = dest_caps[i];
+
+        r = copy_to_user((char *)server_ipc_msg + cap_slots_offset,
+                         (char *)cap_buf,
+                         sizeof(*cap_buf) * cap_num);
+        if (r < 0) {
+                /* The client would never learn the caps */
+                for (i = 0; i < cap_num; ++i)
+                        cap_free(shadow_config->source->cap_group,
+                                 dest_caps[i]);
         }
 }
 
@@ -362,7 +834,8 @@ u64 sys_register_server(u64 callback, u64 max_client, u64 vm_config_ptr)
         struct thread *server = current_thread;
         struct server_ipc_config *server_ipc_config;
         struct ipc_vm_config *vm_config;
-        int r;
+        struct thread *shadow, *tmp;
+        int i, r;
         BUG_ON(server == NULL);
 
         // Create the server ipc_config
@@ -378,33 +851,76 @@ u64 sys_register_server(u64 callback, u64 max_client, u64 vm_config_ptr)
                 goto out_free_server_ipc_config;
         }
         server_ipc_config->max_client = max_client;
+        init_list_head(&server_ipc_config->shadow_pool);
+        server_ipc_config->shadow_pool_cnt = 0;
+        server_ipc_config->shadow_cnt = 0;
         server_ipc_config->conn_bmp =
                 kzalloc(BITS_TO_LONGS(max_client) * sizeof(long));
         if (!server_ipc_config->conn_bmp) {
                 r = -ENOMEM;
                 goto out_free_server_ipc_config;
         }
+        server_ipc_config->conns =
+                kzalloc(max_client * sizeof(struct ipc_connection *));
+        if (!server_ipc_config->conns) {
+                r = -ENOMEM;
+                goto out_free_conn_bmp;
+        }
+        server_ipc_config->shadows = kzalloc(
+                max_client * IPC_MAX_SHADOW_PER_CONN * sizeof(struct thread *));
+        if (!server_ipc_config->shadows) {
+                r = -ENOMEM;
+                goto out_free_conns;
+        }
         // Get and check the parameter vm_config
         vm_config = &server_ipc_config->vm_config;
         r = copy_from_user(
                 (char *)vm_config, (char *)vm_config_ptr, sizeof(*vm_config));
         if (r < 0)
-                goto out_free_conn_bmp;
+                goto out_free_shadows;
+        /* Servers unaware of the buffer area keep the fixed-slot layout */
+        if (vm_config->buf_area_size == 0)
+                vm_config->buf_area_size = max_client * vm_config->buf_size;
         if (!is_user_addr_range(vm_config->stack_base_addr,
-                                vm_config->stack_size)
+                                vm_config->stack_size * max_client
+                                        * IPC_MAX_SHADOW_PER_CONN)
             || !is_user_addr_range(vm_config->buf_base_addr,
-                                   vm_config->buf_size)
+                                   vm_config->buf_area_size)
             || !IS_ALIGNED(vm_config->stack_base_addr, PAGE_SIZE)
             || !IS_ALIGNED(vm_config->stack_size, PAGE_SIZE)
             || !IS_ALIGNED(vm_config->buf_base_addr, PAGE_SIZE)
-            || !IS_ALIGNED(vm_config->buf_size, PAGE_SIZE)) {
+            || !IS_ALIGNED(vm_config->buf_size, PAGE_SIZE)
+            || !IS_ALIGNED(vm_config->buf_area_size, PAGE_SIZE)) {
                 r = -EINVAL;
-                goto out_free_conn_bmp;
+                goto out_free_shadows;
         }
         // Set general_ipc_config means succ register server
         server->general_ipc_config = server_ipc_config;
+
+        // Pre-build shadow threads so that early connections are cheap
+        for (i = 0; i < MIN(max_client, IPC_SHADOW_POOL_PREALLOC); i++) {
+                shadow = create_shadow_thread(server, i);
+                if (!shadow) {
+                        r = -ENOMEM;
+                        goto out_free_shadow_pool;
+                }
+                server_ipc_config->shadow_cnt++;
+                list_add(&shadow->node, &server_ipc_config->shadow_pool);
+                server_ipc_config->shadow_pool_cnt++;
+        }
         return r;
 
+out_free_shadow_pool:
+        server->general_ipc_config = NULL;
+        for_each_in_list_safe (
+                shadow, tmp, node, &server_ipc_config->shadow_pool) {
+                list_del(&shadow->node);
+                destroy_shadow_thread(shadow);
+        }
+out_free_shadows:
+        kfree(server_ipc_config->shadows);
+out_free_conns:
+        kfree(server_ipc_config->conns);
 out_free_conn_bmp:
         kfree(server_ipc_config->conn_bmp);
 out_free_server_ipc_config:
@@ -482,38 +998,74 @@ out_fail:
 void sys_ipc_return(u64 ret, u64 cap_num)
 {
         struct ipc_connection *conn = current_thread->active_conn;
+        struct shadow_ipc_config *shadow_config;
 
         if (conn == NULL) {
                 WARN("An inactive thread calls ipc_return\n");
                 goto out;
         }
+        shadow_config = current_thread->general_ipc_config;
 
         if (cap_num != 0) {
-                ipc_send_cap_to_client(conn, cap_num);
+                /* No ipc_msg carries the caps of a register-only call */
+                if (shadow_config->ipc_msg == NULL)
+                        kwarn("%s: no ipc_msg for caps\n", __func__);
+                else
+                        ipc_send_cap_to_client(current_thread, cap_num);
         }
 
-        conn->source->thread_ctx->sc->budget =
+        shadow_config->source->thread_ctx->sc->budget =
                 current_thread->thread_ctx->sc->budget;
         current_thread->thread_ctx->sc->budget = 0;
         current_thread->thread_ctx->state = TS_WAITING;
 
-        thread_migrate_to_client(conn, ret);
+        thread_migrate_to_client(current_thread, ret);
         BUG("This function should never\n");
 out:
         return;
 }
 
+/**
+ * Take a shadow thread of the connection for a call from current_thread.
+ * Returns -EIPCRETRY if all the shadow threads of @conn are busy.
+ */
+static int ipc_start_call(struct ipc_connection *conn, struct ipc_msg *ipc_msg,
+                          struct thread **shadow_ptr)
+{
+        struct shadow_ipc_config *shadow_config;
+        struct thread *shadow;
+
+        shadow = conn_get_shadow(conn);
+        if (!shadow)
+                return -EIPCRETRY;
+
+        shadow_config = (struct shadow_ipc_config *)shadow->general_ipc_config;
+        shadow_config->source = current_thread;
+        shadow_config->ipc_msg = ipc_msg;
+        shadow_config->regs_call = false;
+        shadow->active_conn = conn;
+        *shadow_ptr = shadow;
+        return 0;
+}
+
 /*
- * Issue an IPC request
+ * Prepare an IPC request for sys_ipc_call and sys_ipc_call_batch
  * 1. Get the conection structure from the cap.
- * 2. If IPC msg contains cap transfer, transfer it to server.
- * 3. IPC-msg is based on shared memory, calculate the correct offset.
- * 4. Migrate to server and set the correct thread states.
+ * 2. Take an idle shadow thread of the connection.
+ * 3. If IPC msg contains cap transfer, transfer it to server.
+ * 4. IPC-msg is based on shared memory, calculate the correct offset.
+ * The caller then migrates to the returned shadow thread with the arg.
+ *
+ * Different threads of the client may have their ipc_msgs at different
+ * offsets in the shared buffer, and their calls run concurrently.
  */
-u64 sys_ipc_call(u32 conn_cap, struct ipc_msg *ipc_msg, u64 cap_num)
+static int ipc_prepare_call(u32 conn_cap, struct ipc_msg *ipc_msg,
+                            bool send_cap, struct thread **shadow_ptr,
+                            u64 *arg_ptr)
 {
         struct ipc_connection *conn = NULL;
-        u64 arg;
+        struct thread *shadow;
+        u64 arg, offset;
         int r = 0;
 
         conn = obj_get(current_thread->cap_group, conn_cap, TYPE_CONNECTION);
@@ -521,27 +1073,190 @@ u64 sys_ipc_call(u32 conn_cap, struct ipc_msg *ipc_msg, u64 cap_num)
                 r = -ECAPBILITY;
                 goto out_fail;
         }
-        conn->ipc_msg = ipc_msg;
+
+        /**
+         * The arg is actually the 64-bit arg for ipc_dispatcher, i.e., the
+         * address of the ipc_msg in the server
+         */
+        arg = 0;
+        if (ipc_msg != 0) {
+                offset = (u64)ipc_msg - conn->buf.client_user_addr;
+                if (offset >= conn->buf.size
+                    || conn->buf.size - offset < sizeof(*ipc_msg)) {
+                        r = -EINVAL;
+                        goto out_obj_put;
+                }
+                arg = conn->buf.server_user_addr + offset;
+        }
+
+        r = ipc_start_call(conn, ipc_msg, &shadow);
+        if (r < 0)
+                goto out_obj_put;
 
         /**
          * Here, you need to transfer all the capbiliies of client thread to
          * capbilities in server thread in the ipc_msg if cap_num > 0
          */
-        if (cap_num > 0) {
-                r = ipc_send_cap(conn);
+        if (send_cap) {
+                r = ipc_send_cap(shadow);
                 if (r < 0)
-                        goto out_obj_put;
+                        goto out_put_shadow;
         }
 
-        if (ipc_msg == 0)
-                thread_migrate_to_server(conn, 0);
+        *shadow_ptr = shadow;
+        *arg_ptr = arg;
+        return 0;
 
-        /**
-         * The arg is actually the 64-bit arg for ipc_dispatcher
-         * */
-        arg = conn->buf.server_user_addr;
+out_put_shadow:
+        conn_put_shadow(conn, shadow);
+out_obj_put:
+        obj_put(conn);
+out_fail:
+        return r;
+}
+
+/*
+ * Issue an IPC request
+ * Migrate to server and set the correct thread states.
+ */
+u64 sys_ipc_call(u32 conn_cap, struct ipc_msg *ipc_msg, u64 cap_num)
+{
+        struct thread *shadow;
+        u64 arg;
+        int r;
+
+        r = ipc_prepare_call(conn_cap, ipc_msg, cap_num > 0, &shadow, &arg);
+        if (r < 0)
+                return r;
+
+        thread_migrate_to_server(shadow, arg);
+
+        BUG("This function should never reach here\n");
+        return 0;
+}
+
+/*
+ * Issue the calls of the batch from batch->cur on.
+ * It migrates to the server of the first call that can be issued and never
+ * returns then. A call that fails to be issued gets its error in rets.
+ * After the last call, the rets are copied to the client, and the return
+ * value of sys_ipc_call_batch is returned.
+ */
+static s64 ipc_batch_issue(struct ipc_batch *batch)
+{
+        struct thread *shadow;
+        u64 arg;
+        s64 r;
+
+        for (; batch->cur < batch->n; batch->cur++) {
+                /* Register-only calls are not batched */
+                if (batch->ipc_msgs[batch->cur] == NULL) {
+                        batch->rets[batch->cur] = -EINVAL;
+                        continue;
+                }
+                r = ipc_prepare_call(batch->conn_caps[batch->cur],
+                                     batch->ipc_msgs[batch->cur],
+                                     true,
+                                     &shadow,
+                                     &arg);
+                if (r < 0) {
+                        batch->rets[batch->cur] = r;
+                        continue;
+                }
+                thread_migrate_to_server(shadow, arg);
+                BUG("This function should never reach here\n");
+        }
+
+        current_thread->ipc_batch = NULL;
+        r = copy_to_user((char *)batch->user_rets,
+                         (char *)batch->rets,
+                         sizeof(*batch->rets) * batch->n);
+        if (r == 0)
+                r = batch->n;
+        kfree(batch);
+        return r;
+}
+
+/*
+ * Issue n IPC requests in one kernel crossing: conn_caps[i] is called
+ * with ipc_msgs[i] in order, and the return value of each call is stored
+ * in rets[i]. The calls must not depend on the results of each other.
+ * A call that cannot be issued gets its error in rets[i], so n is returned
+ * even if no call is issued. A negative error is returned, and rets is left
+ * untouched, only if the batch itself is rejected.
+ */
+s64 sys_ipc_call_batch(u64 conn_caps_ptr, u64 ipc_msgs_ptr, u64 rets_ptr,
+                       u64 n)
+{
+        struct ipc_batch *batch;
+        int r;
+
+        if (n == 0 || n > IPC_MAX_BATCH
+            || !is_user_addr_range(rets_ptr, n * sizeof(s64))) {
+                r = -EINVAL;
+                goto out_fail;
+        }
+        BUG_ON(current_thread->ipc_batch);
+
+        batch = kmalloc(sizeof(*batch));
+        if (!batch) {
+                r = -ENOMEM;
+                goto out_fail;
+        }
+        r = copy_from_user((char *)batch->conn_caps,
+                           (char *)conn_caps_ptr,
+                           sizeof(*batch->conn_caps) * n);
+        if (r < 0)
+                goto out_free_batch;
+        r = copy_from_user((char *)batch->ipc_msgs,
+                           (char *)ipc_msgs_ptr,
+                           sizeof(*batch->ipc_msgs) * n);
+        if (r < 0)
+                goto out_free_batch;
+        batch->n = n;
+        batch->cur = 0;
+        batch->user_rets = (s64 *)rets_ptr;
+
+        current_thread->ipc_batch = batch;
+        return ipc_batch_issue(batch);
+
+out_free_batch:
+        kfree(batch);
+out_fail:
+        return r;
+}
+
+/*
+ * Register-only IPC for small requests.
+ * The arguments are passed to the server handler in its 3rd to 8th argument
+ * registers, while the first one (ipc_msg) is NULL and the second one is
+ * still the client pid. Neither side touches the shared buffer.
+ */
+u64 sys_ipc_call_regs(u32 conn_cap, u64 arg0, u64 arg1, u64 arg2, u64 arg3,
+                      u64 arg4, u64 arg5)
+{
+        struct ipc_connection *conn = NULL;
+        struct shadow_ipc_config *shadow_config;
+        struct thread *shadow;
+        u64 args[IPC_REGS_NUM] = {arg0, arg1, arg2, arg3, arg4, arg5};
+        int i, r = 0;
 
-        thread_migrate_to_server(conn, arg);
+        conn = obj_get(current_thread->cap_group, conn_cap, TYPE_CONNECTION);
+        if (!conn) {
+                r = -ECAPBILITY;
+                goto out_fail;
+        }
+
+        r = ipc_start_call(conn, NULL, &shadow);
+        if (r < 0)
+                goto out_obj_put;
+
+        for (i = 0; i < IPC_REGS_NUM; i++)
+                arch_set_thread_arg(shadow, i + 2, args[i]);
+        shadow_config = (struct shadow_ipc_config *)shadow->general_ipc_config;
+        shadow_config->regs_call = true;
+
+        thread_migrate_to_server(shadow, 0);
 
         BUG("This function should never reach here\n");
 out_obj_put:
@@ -549,3 +1264,49 @@ out_obj_put:
 out_fail:
         return r;
 }
+
+/*
+ * Return from a register-only IPC.
+ * @ret is returned in the client's first return register and ret0 ~ ret5
+ * in the following ones. For the other kinds of calls, whose clients do not
+ * expect their registers to change, only @ret is returned.
+ */
+void sys_ipc_return_regs(u64 ret, u64 ret0, u64 ret1, u64 ret2, u64 ret3,
+                         u64 ret4, u64 ret5)
+{
+        struct ipc_connection *conn = current_thread->active_conn;
+        struct shadow_ipc_config *shadow_config;
+        u64 rets[IPC_REGS_NUM] = {ret0, ret1, ret2, ret3, ret4, ret5};
+        int i;
+
+        if (conn == NULL) {
+                WARN("An inactive thread calls ipc_return_regs\n");
+                return;
+        }
+
+        shadow_config = current_thread->general_ipc_config;
+        if (shadow_config->regs_call) {
+                for (i = 0; i < IPC_REGS_NUM; i++)
+                        arch_set_thread_arg(
+                                shadow_config->source, i + 1, rets[i]);
+        }
+
+        sys_ipc_return(ret, 0);
+}
+
+/**
+ * Close a connection by its cap, from either the client or the server.
+ * All the caps of the connection are revoked at once, and connection_deinit
+ * runs when the calls in flight, which hold references, are finished.
+ */
+int sys_ipc_close_connection(u32 conn_cap)
+{
+        struct ipc_connection *conn;
+
+        conn = obj_get(current_cap_group, conn_cap, TYPE_CONNECTION);
+        if (!conn)
+                return -ECAPBILITY;
+        obj_put(conn);
+
+        return cap_free_all(current_cap_group, conn_cap);
+}
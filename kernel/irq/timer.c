@@ -20,43 +20,282 @@
 #include <posix/time.h>
 #include <mm/uaccess.h>
 #include <sched/context.h>
+#include <irq/ipi.h>
+#include <common/macro.h>
+#include <common/bitops.h>
+#include <common/errno.h>
 
 /* Per-core timer states */
 struct time_state {
-        /* The tick when the next timer irq will occur */
+        /* The tick when the next timer irq will occur, 0 if the timer is off */
         u64 next_expire;
+        /* The tick when the budget of the running thread is charged next */
+        u64 next_sched_tick;
+        /* The periodic tick is stopped since the core is idle */
+        bool tick_stopped;
+        /* Threads sleeping on this core */
+        struct timer_wheel wheel;
 };
 
 struct time_state time_states[PLAT_CPU_NUM];
 
+static inline u64 sched_tick_delta(void)
+{
+        return TICK_MS * 1000 * tick_per_us;
+}
+
+/* Ticks in one unit of the timer wheels */
+static inline u64 tw_unit(void)
+{
+        return TW_RES_US * tick_per_us;
+}
+
+static void timer_wheel_init(struct timer_wheel *tw, u64 clk)
+{
+        int level, idx;
+
+        tw->clk = clk;
+        for (level = 0; level < TW_LEVELS; level++) {
+                for (idx = 0; idx < TW_SIZE; idx++)
+                        init_list_head(&tw->slots[level][idx]);
+                tw->slot_bmp[level] = 0;
+        }
+}
+
+/*
+ * Put @thread into the slot of its sleep_expire, which is not before clk.
+ * The level is chosen by the distance to clk, so it takes O(1).
+ */
+static void timer_wheel_add(struct timer_wheel *tw, struct thread *thread)
+{
+        u64 expire = thread->sleep_expire;
+        u64 delta = expire - tw->clk;
+        u32 level, idx;
+
+        /* Those beyond the range wait in the farthest slot, and cascade */
+        if (delta >= BIT(TW_BITS * TW_LEVELS))
+                expire = tw->clk + BIT(TW_BITS * TW_LEVELS) - 1;
+
+        for (level = 0; level < TW_LEVELS - 1; level++) {
+                if (delta < BIT(TW_BITS * (level + 1)))
+                        break;
+        }
+        idx = (expire >> (TW_BITS * level)) & TW_MASK;
+        list_append(&thread->sleep_node, &tw->slots[level][idx]);
+        tw->slot_bmp[level] |= BIT(idx);
+}
+
+/* Distance from @pos to the next set bit in @bmp (not 0), circularly */
+static inline u32 tw_next_slot(u64 bmp, u32 pos)
+{
+        if (pos)
+                bmp = (bmp >> pos) | (bmp << (TW_SIZE - pos));
+        return ctzl(bmp);
+}
+
+/*
+ * The first unit when the wheel has work to do: a slot of level 0 to
+ * expire, or a slot of an upper level to cascade. -1 if it is empty.
+ */
+static u64 timer_wheel_next(struct timer_wheel *tw)
+{
+        u64 next = (u64)-1, blk;
+        u32 level, shift;
+
+        if (tw->slot_bmp[0])
+                next = tw->clk
+                       + tw_next_slot(tw->slot_bmp[0], tw->clk & TW_MASK);
+
+        for (level = 1; level < TW_LEVELS; level++) {
+                if (!tw->slot_bmp[level])
+                        continue;
+                /*
+                 * The first block not entered yet: clk may land on a block
+                 * start by skipping ahead, and then its slot is not cascaded
+                 */
+                shift = TW_BITS * level;
+                blk = (tw->clk + BIT(shift) - 1) >> shift;
+                blk += tw_next_slot(tw->slot_bmp[level], blk & TW_MASK);
+                next = MIN(next, blk << shift);
+        }
+        return next;
+}
+
+/* Move the threads in slots[level][idx] down by their distance to clk */
+static void timer_wheel_cascade(struct timer_wheel *tw, u32 level, u32 idx)
+{
+        struct thread *thread, *tmp;
+
+        tw->slot_bmp[level] &= ~BIT(idx);
+        for_each_in_list_safe (
+                thread, tmp, sleep_node, &tw->slots[level][idx]) {
+                list_del(&thread->sleep_node);
+                timer_wheel_add(tw, thread);
+        }
+}
+
+/* Wake up the threads in slots[0][idx], all of which expire at clk */
+static void timer_wheel_expire(struct timer_wheel *tw, u32 idx)
+{
+        struct thread *thread, *tmp;
+
+        tw->slot_bmp[0] &= ~BIT(idx);
+        for_each_in_list_safe (thread, tmp, sleep_node, &tw->slots[0][idx]) {
+                list_del(&thread->sleep_node);
+                thread->thread_ctx->state = TS_INTER;
+                BUG_ON(sched_enqueue(thread));
+        }
+}
+
+/*
+ * Process the wheel up to the unit @now.
+ * clk jumps from one slot with work to the next, so an idle wheel costs
+ * nothing however long it has not run.
+ */
+static void timer_wheel_run(struct timer_wheel *tw, u64 now)
+{
+        u32 level, shift;
+        u64 next;
+
+        while ((next = timer_wheel_next(tw)) <= now) {
+                tw->clk = next;
+                /* Entering a block of an upper level cascades its slot */
+                for (level = 1; level < TW_LEVELS; level++) {
+                        shift = TW_BITS * level;
+                        if ((tw->clk >> (shift - TW_BITS)) & TW_MASK)
+                                break;
+                        timer_wheel_cascade(
+                                tw, level, (tw->clk >> shift) & TW_MASK);
+                }
+                timer_wheel_expire(tw, tw->clk & TW_MASK);
+                tw->clk++;
+        }
+        tw->clk = MAX(tw->clk, now + 1);
+}
+
 void timer_init(void)
 {
+        struct time_state *ts;
+        u64 current_tick;
+
         /* Per-core timer init */
         plat_timer_init();
+
+        /* plat_timer_init arms the first tick */
+        ts = &time_states[smp_get_cpu_id()];
+        current_tick = plat_get_current_tick();
+        ts->next_sched_tick = current_tick + sched_tick_delta();
+        ts->next_expire = ts->next_sched_tick;
+        ts->tick_stopped = false;
+        timer_wheel_init(&ts->wheel, current_tick / tw_unit());
 }
 
-static u64 get_next_tick_delta()
+/*
+ * Ticks until the next deadline of this core, 0 if there is none.
+ * The deadline is the next periodic tick, which counts down the budget of
+ * the running thread, or the first sleeper to wake up if earlier.
+ */
+static u64 get_next_tick_delta(struct time_state *ts, u64 current_tick)
 {
-        u64 waiting_tick;
+        u64 expire = (u64)-1, next;
+
+        if (!ts->tick_stopped)
+                expire = ts->next_sched_tick;
+        next = timer_wheel_next(&ts->wheel);
+        if (next != (u64)-1)
+                expire = MIN(expire, next * tw_unit());
+
+        if (expire == (u64)-1)
+                return 0;
+        return expire > current_tick ? expire - current_tick : 1;
+}
+
+/* Arm the timer for the next deadline, or stop it if there is none */
+static void tick_rearm(struct time_state *ts, u64 current_tick)
+{
+        u64 tick_delta;
+
+        tick_delta = get_next_tick_delta(ts, current_tick);
+        if (tick_delta == 0) {
+                if (ts->next_expire) {
+                        plat_disable_timer();
+                        ts->next_expire = 0;
+                }
+                return;
+        }
 
-        /* Default tick */
-        waiting_tick = TICK_MS * 1000 * tick_per_us;
-        return waiting_tick;
+        if (!ts->next_expire)
+                plat_enable_timer();
+        ts->next_expire = current_tick + tick_delta;
+        plat_set_next_timer(tick_delta);
 }
 
 void handle_timer_irq(void)
 {
-        u64 current_tick, tick_delta;
+        struct time_state *ts = &time_states[smp_get_cpu_id()];
+        u64 current_tick;
+        bool sched_tick;
 
-        /* Remove the thread to wakeup from sleep list */
         current_tick = plat_get_current_tick();
 
+        /* Wake up the sleeping threads whose time is up */
+        timer_wheel_run(&ts->wheel, current_tick / tw_unit());
+
+        /* An irq for a sleeper may come before the tick */
+        sched_tick = !ts->tick_stopped && current_tick >= ts->next_sched_tick;
+        if (sched_tick)
+                ts->next_sched_tick = current_tick + sched_tick_delta();
+
         /* Set when the next timer irq will arrive */
-        tick_delta = get_next_tick_delta();
+        tick_rearm(ts, current_tick);
+        if (sched_tick)
+                sched_handle_timer_irq();
+}
+
+/*
+ * Called when @target is switched in: the tick stops as the core goes
+ * idle, and restarts when a thread runs again.
+ */
+void tick_sched_switch(struct thread *target)
+{
+        struct time_state *ts = &time_states[smp_get_cpu_id()];
+        bool idle = target->thread_ctx->type == TYPE_IDLE;
+        u64 current_tick;
+
+        if (idle == ts->tick_stopped)
+                return;
+
+        current_tick = plat_get_current_tick();
+        ts->tick_stopped = idle;
+        if (!idle)
+                ts->next_sched_tick = current_tick + sched_tick_delta();
+        tick_rearm(ts, current_tick);
+}
+
+/*
+ * Wake up @cpuid by IPI if its tick is stopped, e.g., when a thread is
+ * enqueued on it. The big kernel lock keeps tick_stopped from changing.
+ */
+void tick_kick_cpu(u32 cpuid)
+{
+        if (cpuid != smp_get_cpu_id() && time_states[cpuid].tick_stopped)
+                arch_send_ipi(cpuid, IPI_RESCHED);
+}
+
+/*
+ * Wake up one idle core without tick, if any, so that it can steal the
+ * threads waiting on a busy core.
+ */
+void tick_kick_idle_cpu(void)
+{
+        u32 cpuid, self = smp_get_cpu_id();
 
-        time_states[smp_get_cpu_id()].next_expire = current_tick + tick_delta;
-        plat_handle_timer_irq(tick_delta);
-        sched_handle_timer_irq();
+        for (cpuid = 0; cpuid < PLAT_CPU_NUM; cpuid++) {
+                if (cpuid != self && time_states[cpuid].tick_stopped) {
+                        arch_send_ipi(cpuid, IPI_RESCHED);
+                        return;
+                }
+        }
 }
 
 /*
@@ -81,3 +320,83 @@ int sys_clock_gettime(clockid_t clock, struct timespec *ts)
 
         return 0;
 }
+
+/* Convert @ns to ticks, rounding up */
+static u64 ns_to_ticks(u64 ns)
+{
+        return ns / NS_IN_S * (US_IN_S * tick_per_us)
+               + DIV_ROUND_UP(ns % NS_IN_S * tick_per_us, NS_IN_US);
+}
+
+/*
+ * Put @thread, not in any ready queue, to sleep until the tick @expire on
+ * the wheel of this core. It is enqueued again when the time is up.
+ */
+void timer_sleep_thread(struct thread *thread, u64 expire)
+{
+        struct time_state *ts = &time_states[smp_get_cpu_id()];
+        u64 current_tick = plat_get_current_tick();
+
+        /* Catch up, as the wheel is not run without timer irq */
+        timer_wheel_run(&ts->wheel, current_tick / tw_unit());
+
+        thread->sleep_expire = DIV_ROUND_UP(expire, tw_unit());
+        timer_wheel_add(&ts->wheel, thread);
+        thread->thread_ctx->state = TS_WAITING;
+
+        /* The timer may be armed for a later deadline */
+        tick_rearm(ts, current_tick);
+}
+
+/*
+ * Block the current thread until the tick @expire. It returns 0 to the
+ * thread when woken up.
+ * Note that this function never return back.
+ */
+static void sleep_until(u64 expire)
+{
+        timer_sleep_thread(current_thread, expire);
+        arch_set_thread_return(current_thread, 0);
+
+        current_thread = NULL;
+        sched();
+        eret_to_thread(switch_context());
+}
+
+/*
+ * clock_nanosleep:
+ * - both clocks count from the system boot, as in clock_gettime
+ * - the sleep is never interrupted, so @rem is not written
+ */
+int sys_clock_nanosleep(clockid_t clock, int flags,
+                        const struct timespec *req, struct timespec *rem)
+{
+        struct timespec ts_k;
+        u64 req_ns, mono_ns;
+
+        if (clock != CLOCK_REALTIME && clock != CLOCK_MONOTONIC)
+                return -EINVAL;
+        if (!req)
+                return -EFAULT;
+
+        copy_from_user((char *)&ts_k, (char *)req, sizeof(ts_k));
+        if (ts_k.tv_nsec >= NS_IN_S)
+                return -EINVAL;
+
+        /* Longer than a century is as good as forever */
+        req_ns = MIN(ts_k.tv_sec, SLEEP_MAX_SEC) * NS_IN_S + ts_k.tv_nsec;
+        if (flags & TIMER_ABSTIME) {
+                mono_ns = plat_get_mono_time();
+                req_ns = req_ns > mono_ns ? req_ns - mono_ns : 0;
+        }
+        if (req_ns == 0)
+                return 0;
+
+        sleep_until(plat_get_current_tick() + ns_to_ticks(req_ns));
+        return 0;
+}
+
+int sys_nanosleep(const struct timespec *req, struct timespec *rem)
+{
+        return sys_clock_nanosleep(CLOCK_MONOTONIC, 0, req, rem);
+}
@@ -11,11 +11,28 @@
  */
 
 #include <mm/kmalloc.h>
+#include <mm/slab.h>
 #include <common/kprint.h>
 #include <common/macro.h>
 #include <common/radix.h>
 #include <common/errno.h>
 
+static struct slab_cache *radix_node_cache;
+
+static void radix_node_ctor(void *obj)
+{
+        memset(obj, 0, sizeof(struct radix_node));
+}
+
+void radix_cache_init(void)
+{
+        radix_node_cache = kmem_cache_create("radix_node",
+                                             sizeof(struct radix_node),
+                                             0,
+                                             radix_node_ctor);
+        BUG_ON(!radix_node_cache);
+}
+
 struct radix *new_radix(void)
 {
         struct radix *radix;
@@ -28,7 +45,7 @@ struct radix *new_radix(void)
 
 void init_radix(struct radix *radix)
 {
-        radix->root = kzalloc(sizeof(*radix->root));
+        radix->root = kmem_cache_alloc(radix_node_cache);
         BUG_ON(!radix->root);
         radix->value_deleter = NULL;
 
@@ -43,7 +60,7 @@ void init_radix_w_deleter(struct radix *radix, void (*value_deleter)(void *))
 
 static struct radix_node *new_radix_node(void)
 {
-        struct radix_node *n = kzalloc(sizeof(struct radix_node));
+        struct radix_node *n = kmem_cache_alloc(radix_node_cache);
 
         if (!n) {
                 kwarn("run-out-memoroy: cannot allocate radix_new_node whose size is %ld\n",
@@ -178,7 +195,7 @@ static void radix_free_node(struct radix_node *node, int node_level,
                                                 value_deleter);
                 }
         }
-        kfree(node);
+        kmem_cache_free(radix_node_cache, node);
 }
 
 int radix_free(struct radix *radix)
@@ -13,8 +13,33 @@
 #include <common/util.h>
 #include <common/macro.h>
 #include <common/kprint.h>
+#include <common/bitops.h>
+#include <arch/mmu.h>
 #include <mm/buddy.h>
 
+/*
+ * The pool of each physical section, so that virt_to_page does not scan
+ * global_mem. A section shared by more than one pool is marked
+ * SECTION_SHARED and falls back to the scan.
+ */
+#define SECTION_SHARED ((struct phys_mem_pool *)-1)
+static struct phys_mem_pool *pool_sections[BUDDY_SECTION_NUM];
+
+static void register_pool_sections(struct phys_mem_pool *pool)
+{
+        u64 start, end, sec;
+
+        start = virt_to_phys(pool->pool_start_addr) >> BUDDY_SECTION_SHIFT;
+        end = (virt_to_phys(pool->pool_start_addr) + pool->pool_mem_size - 1)
+              >> BUDDY_SECTION_SHIFT;
+        for (sec = start; sec <= end && sec < BUDDY_SECTION_NUM; ++sec) {
+                if (pool_sections[sec] == NULL)
+                        pool_sections[sec] = pool;
+                else
+                        pool_sections[sec] = SECTION_SHARED;
+        }
+}
+
 /*
  * The layout of a phys_mem_pool:
  * | page_metadata are (an array of struct page) | alignment pad | usable memory
@@ -41,6 +66,10 @@ void init_buddy(struct phys_mem_pool *pool, struct page *start_page,
                 pool->free_lists[order].nr_free = 0;
                 init_list_head(&(pool->free_lists[order].free_list));
         }
+        pool->order_bmp = 0;
+        register_pool_sections(pool);
+
+        lock_init(&pool->pool_lock);
 
         /* Clear the page_metadata area. */
         memset((char *)start_page, 0, page_num * sizeof(struct page));
@@ -92,41 +121,42 @@ void list_add_page(struct phys_mem_pool *pool, struct page *page)
 {
         struct free_list *free_list = &pool->free_lists[page->order];
         list_add(&page->node, &free_list->free_list);
-        ++free_list->nr_free;
+        if (free_list->nr_free++ == 0)
+                set_bit_in_slot(pool->order_bmp, page->order);
 }
 
 void list_del_page(struct phys_mem_pool *pool, struct page *page)
 {
         struct free_list *free_list = &pool->free_lists[page->order];
         list_del(&page->node);
-        --free_list->nr_free;
+        if (--free_list->nr_free == 0)
+                clear_bit_in_slot(pool->order_bmp, page->order);
 }
 
+/* Split @page down to @order, and put the upper halves to the free lists */
 static struct page *split_page(struct phys_mem_pool *pool, u64 order,
                                struct page *page)
 {
-        if (page->order == order) {
-                return page;
-        } else {
+        while (page->order > order) {
                 --page->order;
                 list_add_page(pool, get_buddy_chunk(pool, page));
-                return split_page(pool, order, page);
         }
+        return page;
 }
 
-struct page *buddy_get_pages(struct phys_mem_pool *pool, u64 order)
+static struct page *__buddy_get_pages(struct phys_mem_pool *pool, u64 order)
 {
-        u64 free_order = order;
-        while (free_order < BUDDY_MAX_ORDER) {
-                if (pool->free_lists[free_order].nr_free > 0) {
-                        break;
-                } else {
-                        ++free_order;
-                }
-        }
-        if (free_order >= BUDDY_MAX_ORDER) {
+        unsigned long avail;
+        u64 free_order;
+
+        if (order >= BUDDY_MAX_ORDER)
                 return NULL;
-        }
+
+        /* The lowest nonempty order which is not less than order */
+        avail = pool->order_bmp & ~((1UL << order) - 1);
+        if (avail == 0)
+                return NULL;
+        free_order = ctzl(avail);
 
         struct page *page = list_entry(
                 pool->free_lists[free_order].free_list.next, struct page, node);
@@ -136,25 +166,61 @@ struct page *buddy_get_pages(struct phys_mem_pool *pool, u64 order)
         return page;
 }
 
+struct page *buddy_get_pages(struct phys_mem_pool *pool, u64 order)
+{
+        struct page *page;
+
+        lock(&pool->pool_lock);
+        page = __buddy_get_pages(pool, order);
+        unlock(&pool->pool_lock);
+        return page;
+}
+
+/*
+ * Allocate up to @count chunks of @order under one acquisition of the pool
+ * lock, and append them to @list through page->node.
+ * Returns the number of chunks allocated.
+ */
+u64 buddy_get_pages_bulk(struct phys_mem_pool *pool, u64 order, u64 count,
+                         struct list_head *list)
+{
+        struct page *page;
+        u64 i;
+
+        lock(&pool->pool_lock);
+        for (i = 0; i < count; i++) {
+                page = __buddy_get_pages(pool, order);
+                if (!page)
+                        break;
+                list_append(&page->node, list);
+        }
+        unlock(&pool->pool_lock);
+        return i;
+}
+
+/* Coalesce @page with its free buddies as far as possible */
 static struct page *merge_page(struct phys_mem_pool *pool, struct page *page)
 {
-        struct page *buddy = get_buddy_chunk(pool, page);
-        if (page->order == BUDDY_MAX_ORDER - 1 || !buddy || buddy->allocated
-            || buddy->order < page->order) {
-                return page;
-        } else {
+        struct page *buddy;
+
+        while (page->order < BUDDY_MAX_ORDER - 1) {
+                buddy = get_buddy_chunk(pool, page);
+                if (!buddy || buddy->allocated || buddy->order != page->order)
+                        break;
                 list_del_page(pool, buddy);
                 page = page < buddy ? page : buddy;
                 ++page->order;
-                return merge_page(pool, page);
         }
+        return page;
 }
 
 void buddy_free_pages(struct phys_mem_pool *pool, struct page *page)
 {
+        lock(&pool->pool_lock);
         page->allocated = 0;
         page = merge_page(pool, page);
         list_add_page(pool, page);
+        unlock(&pool->pool_lock);
 }
 
 void *page_to_virt(struct page *page)
@@ -177,6 +243,12 @@ struct page *virt_to_page(void *ptr)
         int i;
 
         /* Find the corresponding physical memory pool. */
+        if (virt_to_phys(addr) < BUDDY_PHYS_LIMIT) {
+                pool = pool_sections[virt_to_phys(addr) >> BUDDY_SECTION_SHIFT];
+                if (pool != SECTION_SHARED)
+                        goto found;
+                pool = NULL;
+        }
         for (i = 0; i < physmem_map_num; ++i) {
                 if (addr >= global_mem[i].pool_start_addr
                     && addr < global_mem[i].pool_start_addr
@@ -186,7 +258,9 @@ struct page *virt_to_page(void *ptr)
                 }
         }
 
-        BUG_ON(pool == NULL);
+found:
+        BUG_ON(pool == NULL || addr < pool->pool_start_addr
+               || addr >= pool->pool_start_addr + pool->pool_mem_size);
         page = pool->page_metadata
                + (((u64)addr - pool->pool_start_addr) / BUDDY_PAGE_SIZE);
         return page;
@@ -15,11 +15,40 @@
 #include <common/errno.h>
 #include <common/util.h>
 #include <common/kprint.h>
+#include <common/list.h>
+#include <machine.h>
+#include <arch/machine/smp.h>
 #include <mm/buddy.h>
 #include <mm/slab.h>
+#include <mm/kmalloc.h>
 
 #define _SIZE (1UL << SLAB_MAX_ORDER)
 
+/*
+ * Per-CPU caches of single pages in front of the buddy pools.
+ *
+ * Most allocations are order 0 (page tables, and pages committed to
+ * anonymous PMOs by page faults), so each CPU keeps a list of free pages to
+ * serve them without touching the shared pools. The head of the list is hot:
+ * pages freed on this CPU are put there and are handed out first, as they
+ * are likely still in the cache. Pages fetched from the buddy are appended
+ * at the tail (cold), which is also where the overflow is drained from.
+ * Refill and drain move PCP_BATCH pages at a time to amortize the pool lock.
+ *
+ * A list is only accessed by its own CPU with interrupts masked (always the
+ * case in the kernel), so it needs no lock. Pages in the lists remain
+ * allocated from the view of the buddy.
+ */
+#define PCP_HIGH  64
+#define PCP_BATCH 16
+
+struct per_cpu_pages {
+        struct list_head pages;
+        u64 count;
+} __attribute__((aligned(CACHELINE_SZ)));
+
+static struct per_cpu_pages pcp_lists[PLAT_CPU_NUM];
+
 /* Declaration */
 void *get_pages(int order);
 
@@ -82,21 +111,110 @@ void kfree(void *ptr)
         if (p_page && p_page->slab) {
                 free_in_slab(ptr);
         } else {
-                buddy_free_pages(p_page->pool, p_page);
+                free_pages(ptr);
         }
 }
 
-void *get_pages(int order)
+void init_pcp_lists(void)
+{
+        int i;
+
+        for (i = 0; i < PLAT_CPU_NUM; ++i) {
+                init_list_head(&pcp_lists[i].pages);
+                pcp_lists[i].count = 0;
+        }
+}
+
+/* Fetch PCP_BATCH pages from the pools to the cold end of @pcp */
+static void pcp_refill(struct per_cpu_pages *pcp)
+{
+        u64 want = PCP_BATCH;
+        int i;
+
+        for (i = 0; i < physmem_map_num && want > 0; ++i) {
+                want -= buddy_get_pages_bulk(
+                        &global_mem[i], 0, want, &pcp->pages);
+        }
+        pcp->count += PCP_BATCH - want;
+}
+
+/* Give the PCP_BATCH coldest pages of @pcp back to their pools */
+static void pcp_drain(struct per_cpu_pages *pcp)
+{
+        struct page *page;
+        int i;
+
+        for (i = 0; i < PCP_BATCH; ++i) {
+                page = list_entry(pcp->pages.prev, struct page, node);
+                list_del(&page->node);
+                buddy_free_pages(page->pool, page);
+        }
+        pcp->count -= PCP_BATCH;
+}
+
+static struct page *pcp_get_page(void)
+{
+        struct per_cpu_pages *pcp = &pcp_lists[smp_get_cpu_id()];
+        struct page *page;
+
+        if (pcp->count == 0) {
+                pcp_refill(pcp);
+                if (pcp->count == 0)
+                        return NULL;
+        }
+
+        page = list_entry(pcp->pages.next, struct page, node);
+        list_del(&page->node);
+        pcp->count--;
+        return page;
+}
+
+static void pcp_free_page(struct page *page)
+{
+        struct per_cpu_pages *pcp = &pcp_lists[smp_get_cpu_id()];
+
+        list_add(&page->node, &pcp->pages);
+        pcp->count++;
+        if (pcp->count > PCP_HIGH)
+                pcp_drain(pcp);
+}
+
+/* The number of bytes cached in all the per-CPU lists */
+u64 get_free_mem_size_from_pcp(void)
+{
+        u64 size = 0;
+        int i;
+
+        for (i = 0; i < PLAT_CPU_NUM; ++i)
+                size += pcp_lists[i].count * BUDDY_PAGE_SIZE;
+        return size;
+}
+
+static struct page *__get_pages(int order)
 {
         struct page *p_page = NULL;
         int i;
 
+        if (order == 0)
+                return pcp_get_page();
+
         for (i = 0; i < physmem_map_num; ++i) {
                 p_page = buddy_get_pages(&global_mem[i], order);
                 if (p_page) {
                         break;
                 }
         }
+        return p_page;
+}
+
+void *get_pages(int order)
+{
+        struct page *p_page;
+
+        p_page = __get_pages(order);
+        /* Take the empty slabs back under memory pressure, and retry */
+        if (!p_page && slab_shrink() > 0)
+                p_page = __get_pages(order);
 
         if (!p_page) {
                 kwarn("[OOM] Cannot get page from any memory pool!\n");
@@ -109,7 +227,10 @@ void free_pages(void *addr)
 {
         struct page *p_page;
         p_page = virt_to_page(addr);
-        buddy_free_pages(p_page->pool, p_page);
+        if (p_page->order == 0)
+                pcp_free_page(p_page);
+        else
+                buddy_free_pages(p_page->pool, p_page);
 }
 
 #ifdef CHCORE_KERNEL_TEST
@@ -142,6 +263,31 @@ void test_kmalloc(void)
                 }
                 kfree(p);
         }
+        {
+                /*
+                 * Four slabs of 2048-byte objects. Once they are freed and
+                 * shrunk, only the objects in the magazine of this CPU may
+                 * keep up to two of them.
+                 */
+#define SLAB_TEST_OBJS 4096
+                static u64 *objs[SLAB_TEST_OBJS];
+                u64 free_mem;
+                int i;
+
+                free_mem = get_free_mem_size_from_slab();
+                for (i = 0; i < SLAB_TEST_OBJS; i++) {
+                        objs[i] = kmalloc(2048);
+                        BUG_ON(objs[i] == NULL);
+                        *objs[i] = i;
+                }
+                for (i = 0; i < SLAB_TEST_OBJS; i++) {
+                        lab_assert(*objs[i] == i);
+                        kfree(objs[i]);
+                }
+                slab_shrink();
+                lab_assert(get_free_mem_size_from_slab()
+                           < free_mem + 2 * SLAB_INIT_SIZE);
+        }
         lab_check(ok, "kmalloc");
 }
 #endif /* CHCORE_KERNEL_TEST */
@@ -16,6 +16,7 @@
 #include <common/macro.h>
 #include <mm/buddy.h>
 #include <mm/slab.h>
+#include <mm/kmalloc.h>
 
 extern void parse_mem_map(void);
 
@@ -77,6 +78,9 @@ void mm_init(void)
         test_buddy();
 #endif /* CHCORE_KERNEL_TEST */
 
+        /* per-CPU caches of single pages in front of the buddy */
+        init_pcp_lists();
+
         /* slab alloctor for allocating small memory regions */
         init_slab();
 }
@@ -13,6 +13,7 @@
 #include <mm/mm_check.h>
 #include <mm/buddy.h>
 #include <mm/slab.h>
+#include <mm/kmalloc.h>
 
 /*
  * Note that this function does not return the exact number of free memory in
@@ -26,6 +27,7 @@ u64 get_free_mem_size(void)
         int i;
 
         size = get_free_mem_size_from_slab();
+        size += get_free_mem_size_from_pcp();
         for (i = 0; i < physmem_map_num; ++i) {
                 size += get_free_mem_size_from_buddy(&global_mem[i]);
         }
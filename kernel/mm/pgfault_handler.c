@@ -131,6 +131,45 @@ int handle_trans_fault(struct vmspace *vmspace, vaddr_t fault_addr)
 
                 break;
         }
+        case PMO_HUGE: {
+                void *block;
+
+                /* Populate the whole block around the faulting addr */
+                fault_addr = ROUND_DOWN(fault_addr, PMO_HUGE_PAGE_SIZE);
+                offset = fault_addr - vmr->start;
+                BUG_ON(offset >= pmo->size);
+                index = offset / PMO_HUGE_PAGE_SIZE;
+
+                pa = get_page_from_pmo(pmo, index);
+                if (pa == 0) {
+                        block = get_pages(PMO_HUGE_PAGE_ORDER);
+                        if (!block) {
+                                kwarn("%s: no free huge page\n", __func__);
+                                return -ENOMEM;
+                        }
+                        memset(block, 0, PMO_HUGE_PAGE_SIZE);
+                        pa = (paddr_t)virt_to_phys(block);
+                        commit_page_to_pmo(pmo, index, pa);
+                }
+
+                /* Mapped blocks are shared by the faulting threads as well */
+                ret = map_range_in_pgtbl_huge(vmspace->pgtbl,
+                                              fault_addr,
+                                              pa,
+                                              PMO_HUGE_PAGE_SIZE,
+                                              vmr->perm);
+
+#ifdef CHCORE_ARCH_AARCH64
+                if (vmr->perm & VMR_EXEC) {
+                        extern void arch_flush_cache(u64, s64, int);
+                        BUG_ON(current_thread->vmspace != vmspace);
+                        /* 4 means flush idcache. */
+                        arch_flush_cache(fault_addr, PMO_HUGE_PAGE_SIZE, 4);
+                }
+#endif
+
+                break;
+        }
         case PMO_FORBID: {
                 kinfo("Forbidden memory access (pmo->type is PMO_FORBID).\n");
                 BUG_ON(1);
@@ -10,15 +10,52 @@
  * See the Mulan PSL v1 for more details.
  */
 
+/*
+ * Slab allocator for the small objects of kmalloc.
+ *
+ * There is one slab_cache per power-of-2 object size. Each slab of a cache
+ * is on one of its lists by the number of free objects in it:
+ * - partial: some objects are free, objects are taken from here first;
+ * - full: no object is free;
+ * - empty: all objects are free, at most SLAB_MAX_EMPTY slabs are kept and
+ *   the others are given back to the buddy right away. slab_shrink gives
+ *   back all of them, e.g., when get_pages runs out of memory.
+ *
+ * In front of the slabs, each CPU has a magazine of free objects per cache.
+ * Allocation and free only touch the magazine of the current CPU in the
+ * common case. The slabs, under the lock of the cache, are only accessed
+ * to refill an empty magazine or to flush a full one, by SLAB_MAG_BATCH
+ * objects at a time.
+ *
+ * Besides the size classes of kmalloc, kmem_cache_create makes a cache of
+ * objects of one type, with its own size, alignment and slab size. kfree
+ * works on objects of any cache, since a slab records its cache.
+ */
 #include <common/macro.h>
 #include <common/types.h>
 #include <common/kprint.h>
+#include <common/list.h>
+#include <common/lock.h>
+#include <arch/machine/smp.h>
 #include <mm/kmalloc.h>
 #include <mm/buddy.h>
 #include <mm/slab.h>
 
 /* local variables */
-slab_header_t *slabs[SLAB_MAX_ORDER + 1] = {NULL};
+static struct slab_cache slab_caches[SLAB_MAX_ORDER + 1];
+static const char *slab_cache_names[SLAB_MAX_ORDER + 1] = {
+        [5] = "kmalloc-32",
+        [6] = "kmalloc-64",
+        [7] = "kmalloc-128",
+        [8] = "kmalloc-256",
+        [9] = "kmalloc-512",
+        [10] = "kmalloc-1024",
+        [11] = "kmalloc-2048",
+};
+
+/* All the caches, which are never destroyed */
+static struct list_head slab_cache_list;
+static struct lock slab_cache_list_lock;
 
 /* local functions */
 static inline u64 size_to_order(u64 size)
@@ -41,34 +78,42 @@ static inline u64 order_to_size(u64 order)
         return 1UL << order;
 }
 
+/* Set page->slab of the pages of a slab to @slab */
+static void set_slab_pages(void *addr, u64 size, void *slab)
+{
+        struct page *page;
+        u64 offset;
+
+        for (offset = 0; offset < size; offset += BUDDY_PAGE_SIZE) {
+                page = virt_to_page((void *)((u64)addr + offset));
+                page->slab = slab;
+        }
+}
+
 static void *alloc_slab_memory(u64 size)
 {
-        struct page *p_page, *page;
         void *addr;
-        u64 order, page_num;
-        void *page_addr;
-        int i;
+        u64 order;
 
         order = size_to_order(size / BUDDY_PAGE_SIZE);
         addr = get_pages(order);
-        p_page = virt_to_page(addr);
-        if (p_page == NULL) {
+        if (addr == NULL) {
                 kwarn("failed to alloc_slab_memory: out of memory\n");
-                BUG_ON(1);
-        }
-
-        // BUG_ON(check_alignment((u64)addr, SLAB_INIT_SIZE));
-        page_num = order_to_size(order);
-        for (i = 0; i < page_num; i++) {
-                page_addr = (void *)((u64)addr + i * BUDDY_PAGE_SIZE);
-                page = virt_to_page(page_addr);
-                page->slab = addr;
+                return NULL;
         }
 
+        set_slab_pages(addr, size, addr);
         return addr;
 }
 
-static slab_header_t *init_slab_cache(int order, int size)
+static void free_slab_memory(void *addr, u64 size)
+{
+        /* The pages may be used by kmalloc directly afterwards */
+        set_slab_pages(addr, size, NULL);
+        free_pages(addr);
+}
+
+static slab_header_t *new_slab(struct slab_cache *cache)
 {
         void *addr;
         slab_slot_list_t *slot;
@@ -76,17 +121,19 @@ static slab_header_t *init_slab_cache(int order, int size)
         u64 cnt, obj_size;
         int i;
 
-        addr = alloc_slab_memory(size);
+        addr = alloc_slab_memory(cache->slab_size);
+        if (addr == NULL)
+                return NULL;
         slab = (slab_header_t *)addr;
 
-        obj_size = order_to_size(order);
-        /* the first slot is used as metadata */
-        cnt = size / obj_size - 1;
+        obj_size = cache->obj_size;
+        cnt = (cache->slab_size - cache->obj_offset) / obj_size;
 
-        slot = (slab_slot_list_t *)(addr + obj_size);
+        slot = (slab_slot_list_t *)(addr + cache->obj_offset);
         slab->free_list_head = (void *)slot;
-        slab->next_slab = NULL;
-        slab->order = order;
+        slab->cache = cache;
+        slab->nr_free = cnt;
+        slab->nr_objs = cnt;
 
         /* the last slot has no next one */
         for (i = 0; i < cnt - 1; i++) {
@@ -98,45 +145,169 @@ static slab_header_t *init_slab_cache(int order, int size)
         return slab;
 }
 
-static void *_alloc_in_slab_nolock(slab_header_t *slab_header, int order)
+/* @align is a power of 2, and objects are aligned to it in a slab */
+static void init_cache(struct slab_cache *cache, const char *name, u64 size,
+                       u64 align, void (*ctor)(void *), u64 slab_size)
+{
+        int i;
+
+        cache->name = name;
+        cache->obj_size = ROUND_UP(size, align);
+        /* The header takes the first slot(s) */
+        cache->obj_offset = ROUND_UP(sizeof(slab_header_t), align);
+        cache->slab_size = slab_size;
+        cache->nr_slabs = 0;
+        cache->ctor = ctor;
+        init_list_head(&cache->partial);
+        init_list_head(&cache->full);
+        init_list_head(&cache->empty);
+        cache->nr_empty = 0;
+        lock_init(&cache->lock);
+        for (i = 0; i < PLAT_CPU_NUM; i++)
+                cache->mags[i].count = 0;
+
+        lock(&slab_cache_list_lock);
+        list_append(&cache->cache_node, &slab_cache_list);
+        unlock(&slab_cache_list_lock);
+}
+
+/* Take a free object from the slabs, with the cache lock held */
+static void *slab_take_obj(struct slab_cache *cache)
+{
+        slab_header_t *slab;
+        slab_slot_list_t *slot;
+
+        if (!list_empty(&cache->partial)) {
+                slab = list_entry(cache->partial.next, slab_header_t, node);
+        } else if (!list_empty(&cache->empty)) {
+                slab = list_entry(cache->empty.next, slab_header_t, node);
+                list_del(&slab->node);
+                list_add(&slab->node, &cache->partial);
+                cache->nr_empty--;
+        } else {
+                return NULL;
+        }
+
+        slot = (slab_slot_list_t *)slab->free_list_head;
+        slab->free_list_head = slot->next_free;
+        if (--slab->nr_free == 0) {
+                list_del(&slab->node);
+                list_add(&slab->node, &cache->full);
+        }
+        return slot;
+}
+
+/*
+ * Put an object back to its slab, with the cache lock held.
+ * A slab which becomes empty beyond SLAB_MAX_EMPTY is moved to @release,
+ * to be given back to the buddy after the lock is released.
+ */
+static void slab_put_obj(struct slab_cache *cache, void *obj,
+                         struct list_head *release)
 {
-        slab_slot_list_t *first_slot;
-        void *next_slot;
-        slab_header_t *next_slab;
-        slab_header_t *new_slab;
+        slab_header_t *slab;
+        slab_slot_list_t *slot;
 
-        first_slot = (slab_slot_list_t *)(slab_header->free_list_head);
-        if (likely(first_slot != NULL)) {
-                next_slot = first_slot->next_free;
-                slab_header->free_list_head = next_slot;
-                return first_slot;
+        slab = virt_to_page(obj)->slab;
+        slot = (slab_slot_list_t *)obj;
+        slot->next_free = slab->free_list_head;
+        slab->free_list_head = slot;
+
+        if (slab->nr_free++ == 0) {
+                list_del(&slab->node);
+                list_add(&slab->node, &cache->partial);
         }
+        if (slab->nr_free == slab->nr_objs) {
+                list_del(&slab->node);
+                if (cache->nr_empty < SLAB_MAX_EMPTY) {
+                        list_add(&slab->node, &cache->empty);
+                        cache->nr_empty++;
+                } else {
+                        list_add(&slab->node, release);
+                        cache->nr_slabs--;
+                }
+        }
+}
 
-        next_slab = slab_header->next_slab;
-        while (next_slab != NULL) {
-                first_slot = (slab_slot_list_t *)(next_slab->free_list_head);
-                if (likely(first_slot != NULL)) {
-                        next_slot = first_slot->next_free;
-                        next_slab->free_list_head = next_slot;
-                        return first_slot;
+static void release_slabs(struct list_head *release)
+{
+        slab_header_t *slab, *tmp;
+
+        for_each_in_list_safe (slab, tmp, node, release) {
+                list_del(&slab->node);
+                free_slab_memory(slab, slab->cache->slab_size);
+        }
+}
+
+/* Fill an empty magazine with up to SLAB_MAG_BATCH objects */
+static void mag_refill(struct slab_cache *cache, struct slab_magazine *mag)
+{
+        slab_header_t *slab;
+        void *obj;
+
+        lock(&cache->lock);
+        while (mag->count < SLAB_MAG_BATCH) {
+                obj = slab_take_obj(cache);
+                if (obj) {
+                        mag->objs[mag->count++] = obj;
+                        continue;
                 }
-                next_slab = next_slab->next_slab;
+                if (mag->count > 0)
+                        break;
+
+                /* Grow without the lock as get_pages may call slab_shrink */
+                unlock(&cache->lock);
+                slab = new_slab(cache);
+                lock(&cache->lock);
+                if (!slab)
+                        break;
+                list_add(&slab->node, &cache->empty);
+                cache->nr_empty++;
+                cache->nr_slabs++;
         }
+        unlock(&cache->lock);
+}
+
+/* Give the SLAB_MAG_BATCH oldest objects of a full magazine back */
+static void mag_flush(struct slab_cache *cache, struct slab_magazine *mag)
+{
+        struct list_head release;
+        int i;
+
+        init_list_head(&release);
+        lock(&cache->lock);
+        for (i = 0; i < SLAB_MAG_BATCH; i++)
+                slab_put_obj(cache, mag->objs[i], &release);
+        unlock(&cache->lock);
 
-        /* Allocate a new slab */
-        new_slab = init_slab_cache(order, SLAB_INIT_SIZE);
-        new_slab->next_slab = slab_header;
-        slabs[order] = new_slab;
+        for (i = SLAB_MAG_BATCH; i < mag->count; i++)
+                mag->objs[i - SLAB_MAG_BATCH] = mag->objs[i];
+        mag->count -= SLAB_MAG_BATCH;
 
-        return _alloc_in_slab_nolock(new_slab, order);
+        release_slabs(&release);
 }
 
-static void *_alloc_in_slab(slab_header_t *slab_header, int order)
+static void *cache_alloc(struct slab_cache *cache)
 {
-        void *free_slot;
+        struct slab_magazine *mag;
 
-        free_slot = _alloc_in_slab_nolock(slab_header, order);
-        return free_slot;
+        mag = &cache->mags[smp_get_cpu_id()];
+        if (unlikely(mag->count == 0)) {
+                mag_refill(cache, mag);
+                if (mag->count == 0)
+                        return NULL;
+        }
+        return mag->objs[--mag->count];
+}
+
+static void cache_free(struct slab_cache *cache, void *addr)
+{
+        struct slab_magazine *mag;
+
+        mag = &cache->mags[smp_get_cpu_id()];
+        if (unlikely(mag->count == SLAB_MAG_SIZE))
+                mag_flush(cache, mag);
+        mag->objs[mag->count++] = addr;
 }
 
 /*
@@ -147,9 +318,17 @@ void init_slab()
 {
         int order;
 
+        init_list_head(&slab_cache_list);
+        lock_init(&slab_cache_list_lock);
+
         /* slab obj size: 32, 64, 128, 256, 512, 1024, 2048 */
         for (order = SLAB_MIN_ORDER; order <= SLAB_MAX_ORDER; order++) {
-                slabs[order] = init_slab_cache(order, SLAB_INIT_SIZE);
+                init_cache(&slab_caches[order],
+                           slab_cache_names[order],
+                           order_to_size(order),
+                           order_to_size(order),
+                           NULL,
+                           SLAB_INIT_SIZE);
         }
         kdebug("mm: finish initing slab allocators\n");
 }
@@ -164,54 +343,180 @@ void *alloc_in_slab(u64 size)
         if (order < SLAB_MIN_ORDER)
                 order = SLAB_MIN_ORDER;
 
-        return _alloc_in_slab(slabs[order], order);
+        return cache_alloc(&slab_caches[order]);
 }
 
 void free_in_slab(void *addr)
 {
         struct page *page;
-        slab_header_t *slab;
-        slab_slot_list_t *slot;
 
-        slot = (slab_slot_list_t *)addr;
         page = virt_to_page(addr);
-        BUG_ON(page == NULL);
+        BUG_ON(page == NULL || page->slab == NULL);
 
-        slab = page->slab;
-        slot->next_free = slab->free_list_head;
-        slab->free_list_head = slot;
+        cache_free(((slab_header_t *)page->slab)->cache, addr);
+}
+
+/*
+ * Create a cache of objects of @size bytes aligned to @align (a power of
+ * 2, or 0 for the alignment of a pointer). @ctor, if not NULL, initializes
+ * each object returned by kmem_cache_alloc.
+ * Its slabs are the smallest power of 2 of pages holding SLAB_MIN_OBJS
+ * objects, up to SLAB_INIT_SIZE.
+ */
+struct slab_cache *kmem_cache_create(const char *name, u64 size, u64 align,
+                                     void (*ctor)(void *obj))
+{
+        struct slab_cache *cache;
+        u64 obj_size, obj_offset, slab_size;
+
+        if (align == 0)
+                align = sizeof(void *);
+        if ((align & (align - 1)) != 0 || size == 0)
+                return NULL;
+
+        /* A free object holds the link of the free list */
+        obj_size = ROUND_UP(MAX(size, sizeof(slab_slot_list_t)), align);
+        obj_offset = ROUND_UP(sizeof(slab_header_t), align);
+        slab_size = BUDDY_PAGE_SIZE;
+        while (slab_size < obj_offset + SLAB_MIN_OBJS * obj_size
+               && slab_size < SLAB_INIT_SIZE)
+                slab_size <<= 1;
+        if (obj_offset + obj_size > slab_size)
+                return NULL;
+
+        cache = kzalloc(sizeof(*cache));
+        if (!cache)
+                return NULL;
+        init_cache(cache, name, obj_size, align, ctor, slab_size);
+        return cache;
+}
+
+void *kmem_cache_alloc(struct slab_cache *cache)
+{
+        void *obj;
+
+        obj = cache_alloc(cache);
+        if (obj && cache->ctor)
+                cache->ctor(obj);
+        return obj;
+}
+
+void kmem_cache_free(struct slab_cache *cache, void *obj)
+{
+        struct page *page;
+
+        if (!obj)
+                return;
+        page = virt_to_page(obj);
+        BUG_ON(page == NULL || page->slab == NULL
+               || ((slab_header_t *)page->slab)->cache != cache);
+
+        cache_free(cache, obj);
+}
+
+void kmem_cache_report(void)
+{
+        struct slab_cache *cache;
+        slab_header_t *slab;
+        u64 nr_objs, nr_free;
+        int i;
+
+        printk("\n*****Slab Cache Info*****\n");
+        printk("%-16s %8s %8s %10s %10s %10s\n",
+               "name", "objsize", "slabs", "objs", "active", "bytes");
+        lock(&slab_cache_list_lock);
+        for_each_in_list (cache, struct slab_cache, cache_node,
+                          &slab_cache_list) {
+                nr_objs = 0;
+                nr_free = 0;
+
+                lock(&cache->lock);
+                for_each_in_list (slab, slab_header_t, node, &cache->partial) {
+                        nr_objs += slab->nr_objs;
+                        nr_free += slab->nr_free;
+                }
+                for_each_in_list (slab, slab_header_t, node, &cache->full)
+                        nr_objs += slab->nr_objs;
+                for_each_in_list (slab, slab_header_t, node, &cache->empty) {
+                        nr_objs += slab->nr_objs;
+                        nr_free += slab->nr_free;
+                }
+                unlock(&cache->lock);
+                for (i = 0; i < PLAT_CPU_NUM; i++)
+                        nr_free += cache->mags[i].count;
+
+                printk("%-16s %8lu %8lu %10lu %10lu %10lu\n",
+                       cache->name,
+                       cache->obj_size,
+                       cache->nr_slabs,
+                       nr_objs,
+                       nr_objs - nr_free,
+                       cache->nr_slabs * cache->slab_size);
+        }
+        unlock(&slab_cache_list_lock);
+}
+
+u64 slab_shrink(void)
+{
+        struct slab_cache *cache;
+        struct list_head release;
+        slab_header_t *slab;
+        u64 size = 0;
+
+        init_list_head(&release);
+        lock(&slab_cache_list_lock);
+        for_each_in_list (cache, struct slab_cache, cache_node,
+                          &slab_cache_list) {
+                lock(&cache->lock);
+                while (!list_empty(&cache->empty)) {
+                        slab = list_entry(
+                                cache->empty.next, slab_header_t, node);
+                        list_del(&slab->node);
+                        list_add(&slab->node, &release);
+                        size += cache->slab_size;
+                }
+                cache->nr_slabs -= cache->nr_empty;
+                cache->nr_empty = 0;
+                unlock(&cache->lock);
+        }
+        unlock(&slab_cache_list_lock);
+
+        release_slabs(&release);
+        return size;
 }
 
 /* Get the size of free memory in slab */
 u64 get_free_mem_size_from_slab(void)
 {
-        int order;
-        slab_header_t *current_slab;
-        slab_slot_list_t *slot;
-        u64 current_slot_size;
-        u64 total_size = 0;
+        int i;
+        struct slab_cache *cache;
+        slab_header_t *slab;
         u64 current_slot_num; /* used for debug */
+        u64 total_size = 0;
 
-        for (order = SLAB_MIN_ORDER; order <= SLAB_MAX_ORDER; order++) {
-                current_slab = slabs[order];
-                current_slot_size = order_to_size(order);
+        lock(&slab_cache_list_lock);
+        for_each_in_list (cache, struct slab_cache, cache_node,
+                          &slab_cache_list) {
                 current_slot_num = 0;
-                /* walk throught all the slabs of a certain order */
-                while (current_slab != NULL) {
-                        slot = current_slab->free_list_head;
-
-                        /* walk through all the slots of a certain slab */
-                        while (slot != NULL) {
-                                total_size += current_slot_size;
-                                current_slot_num++;
-                                slot = slot->next_free;
-                        }
-                        current_slab = current_slab->next_slab;
-                }
-                kdebug("slab memory chunk size : 0x%lx, num : %d\n",
-                       current_slot_size,
+
+                lock(&cache->lock);
+                for_each_in_list (slab, slab_header_t, node, &cache->partial)
+                        current_slot_num += slab->nr_free;
+                for_each_in_list (slab, slab_header_t, node, &cache->empty)
+                        current_slot_num += slab->nr_free;
+                unlock(&cache->lock);
+
+                /* Objects in the magazines are free as well */
+                for (i = 0; i < PLAT_CPU_NUM; i++)
+                        current_slot_num += cache->mags[i].count;
+
+                total_size += current_slot_num * cache->obj_size;
+                kdebug("slab cache %s : 0x%lx, num : %d\n",
+                       cache->name,
+                       cache->obj_size,
                        current_slot_num);
         }
+        unlock(&slab_cache_list_lock);
 
         return total_size;
 }
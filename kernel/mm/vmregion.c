@@ -17,22 +17,32 @@
 #include <common/kprint.h>
 #include <mm/vmspace.h>
 #include <mm/kmalloc.h>
+#include <mm/slab.h>
 #include <mm/mm.h>
 #include <arch/mmu.h>
 
+static struct slab_cache *vmregion_cache;
+
+void vmregion_cache_init(void)
+{
+        vmregion_cache = kmem_cache_create(
+                "vmregion", sizeof(struct vmregion), 0, NULL);
+        BUG_ON(!vmregion_cache);
+}
+
 /* Local functions */
 
 static struct vmregion *alloc_vmregion(void)
 {
         struct vmregion *vmr;
 
-        vmr = kmalloc(sizeof(*vmr));
+        vmr = kmem_cache_alloc(vmregion_cache);
         return vmr;
 }
 
 static void free_vmregion(struct vmregion *vmr)
 {
-        kfree((void *)vmr);
+        kmem_cache_free(vmregion_cache, vmr);
 }
 
 /*
@@ -97,6 +107,29 @@ static void del_vmr_from_vmspace(struct vmspace *vmspace, struct vmregion *vmr)
         free_vmregion(vmr);
 }
 
+/* Map the blocks of a PMO_HUGE committed so far, the others on demand */
+static int fill_page_table_huge(struct vmspace *vmspace, struct vmregion *vmr)
+{
+        u64 offset;
+        paddr_t pa;
+        int ret;
+
+        for (offset = 0; offset < MIN(vmr->size, vmr->pmo->size);
+             offset += PMO_HUGE_PAGE_SIZE) {
+                pa = get_page_from_pmo(vmr->pmo, offset / PMO_HUGE_PAGE_SIZE);
+                if (pa == 0)
+                        continue;
+                ret = map_range_in_pgtbl_huge(vmspace->pgtbl,
+                                              vmr->start + offset,
+                                              pa,
+                                              PMO_HUGE_PAGE_SIZE,
+                                              vmr->perm);
+                if (ret < 0)
+                        return ret;
+        }
+        return 0;
+}
+
 static int fill_page_table(struct vmspace *vmspace, struct vmregion *vmr)
 {
         size_t pm_size;
@@ -104,6 +137,9 @@ static int fill_page_table(struct vmspace *vmspace, struct vmregion *vmr)
         vaddr_t va;
         int ret;
 
+        if (vmr->pmo->type == PMO_HUGE)
+                return fill_page_table_huge(vmspace, vmr);
+
         pm_size = vmr->pmo->size;
         pa = vmr->pmo->start;
         va = vmr->start;
@@ -113,10 +149,21 @@ static int fill_page_table(struct vmspace *vmspace, struct vmregion *vmr)
         return ret;
 }
 
+/* Remove the mappings of [va, va + len) in a vmregion of @pmo */
+static void unmap_vmr_range(struct vmspace *vmspace, struct pmobject *pmo,
+                            vaddr_t va, size_t len)
+{
+        if (pmo && pmo->type == PMO_HUGE)
+                unmap_range_in_pgtbl_huge(vmspace->pgtbl, va, len);
+        else
+                unmap_range_in_pgtbl(vmspace->pgtbl, va, len);
+}
+
 static int unmap_vmrs(struct vmspace *vmspace, vaddr_t va, size_t len)
 {
         struct vmregion *vmr;
         struct pmobject *pmo;
+        size_t vmr_size;
 
         if (len == 0)
                 return 0;
@@ -154,16 +201,17 @@ static int unmap_vmrs(struct vmspace *vmspace, vaddr_t va, size_t len)
                 return 0;
         }
 
-        /* delete the vmr from the vmspace */
+        /* delete the vmr from the vmspace, which frees it */
+        vmr_size = vmr->size;
         del_vmr_from_vmspace(vmspace, vmr);
 
         /* Umap a whole vmr */
-        unmap_range_in_pgtbl(vmspace->pgtbl, va, len);
+        unmap_vmr_range(vmspace, pmo, va, vmr_size);
 
-        flush_tlbs(vmspace, va, len);
+        flush_tlbs(vmspace, va, vmr_size);
 
-        va += vmr->size;
-        len -= vmr->size;
+        va += vmr_size;
+        len -= vmr_size;
         return unmap_vmrs(vmspace, va, len);
 }
 
@@ -211,7 +259,17 @@ int vmspace_map_range(struct vmspace *vmspace, vaddr_t va, size_t len,
         /* Check whether the pmo type is supported */
         BUG_ON((pmo->type != PMO_DATA) && (pmo->type != PMO_DATA_NOCACHE)
                && (pmo->type != PMO_ANONYM) && (pmo->type != PMO_DEVICE)
-               && (pmo->type != PMO_SHM) && (pmo->type != PMO_FORBID));
+               && (pmo->type != PMO_SHM) && (pmo->type != PMO_FORBID)
+               && (pmo->type != PMO_HUGE));
+
+        if (pmo->type == PMO_HUGE) {
+                /* Each block is mapped by one L2 entry */
+                if (!IS_ALIGNED(va, PMO_HUGE_PAGE_SIZE)) {
+                        ret = -EINVAL;
+                        goto out_fail;
+                }
+                len = ROUND_UP(len, PMO_HUGE_PAGE_SIZE);
+        }
 
         /* Align a vmr to PAGE_SIZE */
         va = ROUND_DOWN(va, PAGE_SIZE);
@@ -253,9 +311,13 @@ int vmspace_map_range(struct vmspace *vmspace, vaddr_t va, size_t len,
          * Otherwise (for PMO_ANONYM and PMO_SHM), we use on-demand mapping.
          * In this case, lazy mapping reduces the usage of physical memory
          * resource.
+         *
+         * Case-3:
+         * For PMO_HUGE, the blocks already committed (e.g., by another
+         * process or write_pmo) are mapped at once, and the others on demand.
          */
         if ((pmo->type == PMO_DATA) || (pmo->type == PMO_DATA_NOCACHE)
-            || (pmo->type == PMO_DEVICE))
+            || (pmo->type == PMO_DEVICE) || (pmo->type == PMO_HUGE))
                 fill_page_table(vmspace, vmr);
 
         /* On success */
@@ -294,9 +356,10 @@ int vmspace_unmap_range(struct vmspace *vmspace, vaddr_t va, size_t len)
                 BUG_ON(1);
         }
 
+        /* vmr is freed by del_vmr_from_vmspace */
+        pmo = vmr->pmo;
         del_vmr_from_vmspace(vmspace, vmr);
 
-        pmo = vmr->pmo;
         /* No pmo is mapped */
         if (pmo == NULL) {
                 ret = 0;
@@ -312,7 +375,7 @@ int vmspace_unmap_range(struct vmspace *vmspace, vaddr_t va, size_t len)
          */
 
         if (likely(len != 0)) {
-                unmap_range_in_pgtbl(vmspace->pgtbl, va, len);
+                unmap_vmr_range(vmspace, pmo, va, len);
 
                 flush_tlbs(vmspace, va, len);
         }
@@ -362,7 +425,7 @@ int unmap_pmo_in_vmspace(struct vmspace *vmspace, struct pmobject *pmo)
         del_vmr_from_vmspace(vmspace, vmr);
 
         /* Remove the mapping in page table */
-        unmap_range_in_pgtbl(vmspace->pgtbl, flush_va_start, flush_len);
+        unmap_vmr_range(vmspace, pmo, flush_va_start, flush_len);
 
         flush_tlbs(vmspace, flush_va_start, flush_len);
 
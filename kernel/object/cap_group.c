@@ -74,6 +74,7 @@ int cap_group_init(struct cap_group *cap_group, unsigned int size, u64 pid)
         BUG_ON(slot_table_init(slot_table, size));
         init_list_head(&cap_group->thread_list);
         cap_group->pid = pid;
+        fair_init_cap_group(cap_group);
 
         return 0;
 }
@@ -164,6 +165,55 @@ out_fail:
         return r;
 }
 
+/*
+ * Allocate @n slot ids into @slot_ids in one scan of the bitmaps, which goes
+ * on from the last id found rather than restarting for each one.
+ * Either all or none of the ids are allocated.
+ * should only be called when table_guard is held
+ */
+int alloc_slot_ids(struct cap_group *cap_group, int *slot_ids, int n)
+{
+        struct slot_table *slot_table = &cap_group->slot_table;
+        int i = 0, idx = 0, start, word, r;
+        int bmp_size, full_bmp_size;
+
+        while (i < n) {
+                bmp_size = slot_table->slots_size;
+                full_bmp_size = BITS_TO_LONGS(bmp_size);
+
+                word = find_next_zero_bit(slot_table->full_slots_bmp,
+                                          full_bmp_size,
+                                          idx / BITS_PER_LONG);
+                if (word < full_bmp_size) {
+                        start = MAX(idx, word * BITS_PER_LONG);
+                        idx = find_next_zero_bit(
+                                slot_table->slots_bmp, bmp_size, start);
+                } else {
+                        idx = bmp_size;
+                }
+                if (idx >= bmp_size) {
+                        /* the new slots start right after the scanned ones */
+                        r = expand_slot_table(slot_table);
+                        if (r < 0)
+                                goto out_free_ids;
+                        continue;
+                }
+
+                set_bit(idx, slot_table->slots_bmp);
+                if (slot_table->slots_bmp[idx / BITS_PER_LONG]
+                    == ~((unsigned long)0))
+                        set_bit(idx / BITS_PER_LONG,
+                                slot_table->full_slots_bmp);
+                slot_ids[i++] = idx;
+        }
+        return 0;
+
+out_free_ids:
+        while (i-- > 0)
+                free_slot_id(cap_group, slot_ids[i]);
+        return r;
+}
+
 void *get_opaque(struct cap_group *cap_group, int slot_id, bool type_valid,
                  int type)
 {
@@ -312,7 +362,7 @@ struct cap_group *create_root_cap_group(char *name, size_t name_len)
         slot_id = alloc_slot_id(cap_group);
         BUG_ON(slot_id != CAP_GROUP_OBJ_ID);
 
-        slot = kzalloc(sizeof(*slot));
+        slot = cap_slot_zalloc();
         if (!slot) {
                 kfree(cap_group);
                 return NULL;
@@ -15,7 +15,9 @@
 #include <object/cap_group.h>
 #include <object/thread.h>
 #include <mm/kmalloc.h>
+#include <mm/slab.h>
 #include <mm/uaccess.h>
+#include <semaphore/semaphore.h>
 #include <lib/printk.h>
 
 extern void pmo_deinit(void *);
@@ -32,6 +34,29 @@ const obj_deinit_func obj_deinit_tbl[TYPE_NR] = {
         [TYPE_VMSPACE] = vmspace_deinit,
 };
 
+static struct slab_cache *cap_slot_cache;
+
+void cap_slot_cache_init(void)
+{
+        cap_slot_cache = kmem_cache_create(
+                "object_slot", sizeof(struct object_slot), 0, NULL);
+        BUG_ON(!cap_slot_cache);
+}
+
+/*
+ * A zeroed slot for the callers outside this file. Every slot must come from
+ * cap_slot_cache since __cap_free gives it back there.
+ */
+struct object_slot *cap_slot_zalloc(void)
+{
+        struct object_slot *slot;
+
+        slot = kmem_cache_alloc(cap_slot_cache);
+        if (slot)
+                memset(slot, 0, sizeof(*slot));
+        return slot;
+}
+
 /*
  * Usage:
  * obj = obj_alloc(...);
@@ -91,7 +116,7 @@ int cap_alloc(struct cap_group *cap_group, void *obj, u64 rights)
                 goto out_table;
         }
 
-        slot = kmalloc(sizeof(*slot));
+        slot = kmem_cache_alloc(cap_slot_cache);
         if (!slot) {
                 r = -ENOMEM;
                 goto out_free_slot_id;
@@ -155,7 +180,7 @@ int __cap_free(struct cap_group *cap_group, int slot_id)
          * slot */
         object = slot->object;
         list_del(&slot->copies);
-        kfree(slot);
+        kmem_cache_free(cap_slot_cache, slot);
 
         /* Step-3: decrease the refcnt of the object and free it if necessary */
         old_refcount = atomic_fetch_sub_64(&object->refcount, 1);
@@ -192,7 +217,7 @@ int cap_copy(struct cap_group *src_cap_group, struct cap_group *dest_cap_group,
                 goto out;
         }
 
-        dest_slot = kmalloc(sizeof(*dest_slot));
+        dest_slot = kmem_cache_alloc(cap_slot_cache);
         if (!dest_slot) {
                 r = -ENOMEM;
                 goto out_free_slot_id;
@@ -215,6 +240,65 @@ out:
         return r;
 }
 
+/*
+ * Copy @n caps in @src_slot_ids of @src_cap_group to @dest_cap_group, and
+ * store the new slot ids into @dest_slot_ids.
+ * Unlike calling cap_copy n times, the destination slot ids are allocated in
+ * one pass of the slot table. Either all or none of the caps are copied.
+ */
+int cap_copy_n(struct cap_group *src_cap_group,
+               struct cap_group *dest_cap_group, const int *src_slot_ids,
+               int *dest_slot_ids, int n)
+{
+        struct object_slot *src_slot, *dest_slot;
+        int i, r;
+
+        for (i = 0; i < n; i++) {
+                src_slot = get_slot(src_cap_group, src_slot_ids[i]);
+                if (!src_slot || src_slot->isvalid == false) {
+                        r = -ECAPBILITY;
+                        goto out;
+                }
+        }
+
+        r = alloc_slot_ids(dest_cap_group, dest_slot_ids, n);
+        if (r < 0)
+                goto out;
+
+        for (i = 0; i < n; i++) {
+                dest_slot = kmem_cache_alloc(cap_slot_cache);
+                if (!dest_slot) {
+                        r = -ENOMEM;
+                        goto out_free_slots;
+                }
+                install_slot(dest_cap_group, dest_slot_ids[i], dest_slot);
+        }
+
+        /* nothing can fail from now on */
+        for (i = 0; i < n; i++) {
+                src_slot = get_slot(src_cap_group, src_slot_ids[i]);
+                dest_slot = get_slot(dest_cap_group, dest_slot_ids[i]);
+                atomic_fetch_add_64(&src_slot->object->refcount, 1);
+
+                dest_slot->slot_id = dest_slot_ids[i];
+                dest_slot->cap_group = dest_cap_group;
+                dest_slot->isvalid = true;
+                dest_slot->object = src_slot->object;
+
+                list_add(&dest_slot->copies, &src_slot->copies);
+        }
+        return 0;
+
+out_free_slots:
+        while (i-- > 0)
+                kmem_cache_free(cap_slot_cache,
+                                get_slot(dest_cap_group, dest_slot_ids[i]));
+        for (i = 0; i < n; i++)
+                free_slot_id(dest_cap_group, dest_slot_ids[i]);
+out:
+        return r;
+}
+
 int cap_move(struct cap_group *src_cap_group, struct cap_group *dest_cap_group,
              int src_slot_id)
 {
@@ -273,6 +357,39 @@ out_fail:
         return r;
 }
 
+/*
+ * Drop a cap of the current cap_group.
+ * Only caps of pmos and semaphores can be dropped, since the kernel keeps
+ * plain pointers to the other objects while they are in use. A pmo should
+ * be unmapped first, as its mappings hold no reference either.
+ */
+int sys_cap_free(u64 slot_id)
+{
+        struct object_slot *slot;
+        struct object *object;
+        struct semaphore *sem;
+
+        slot = get_slot(current_cap_group, (int)slot_id);
+        if (!slot || slot->isvalid == false)
+                return -ECAPBILITY;
+
+        object = slot->object;
+        switch (object->type) {
+        case TYPE_PMO:
+                break;
+        case TYPE_SEMAPHORE:
+                /* Threads waiting on a semaphore hold no reference to it */
+                sem = (struct semaphore *)object->opaque;
+                if (object->refcount == 1 && sem->waiting_threads_count != 0)
+                        return -EBUSY;
+                break;
+        default:
+                return -EINVAL;
+        }
+
+        return cap_free(current_cap_group, (int)slot_id);
+}
+
 int sys_cap_copy_to(u64 dest_cap_group_cap, u64 src_slot_id)
 {
         struct cap_group *dest_cap_group;
@@ -301,40 +418,65 @@ int sys_cap_copy_from(u64 src_cap_group_cap, u64 src_slot_id)
         return r;
 }
 
+/* Caps copied by each cap_copy_n in sys_transfer_caps */
+#define TRANSFER_CAPS_BATCH 16
+/* Upper bound of nr_caps, so that all the new slots fit in dst_caps */
+#define TRANSFER_CAPS_MAX 64
+
+/*
+ * Copy @nr_caps caps to the cap_group of @dest_group_cap, and write the new
+ * slot ids to @dst_caps_buf. Either all or none of the caps are copied.
+ */
 int sys_transfer_caps(u64 dest_group_cap, u64 src_caps_buf, int nr_caps,
                       u64 dst_caps_buf)
 {
         struct cap_group *dest_cap_group;
-        int i;
-        int *src_caps;
-        int *dst_caps;
-        size_t size;
+        int src_caps[TRANSFER_CAPS_BATCH];
+        int dst_caps[TRANSFER_CAPS_MAX];
+        int i, n, r;
+
+        if (nr_caps < 0 || nr_caps > TRANSFER_CAPS_MAX)
+                return -EINVAL;
 
         dest_cap_group =
                 obj_get(current_cap_group, dest_group_cap, TYPE_CAP_GROUP);
         if (!dest_cap_group)
                 return -ECAPBILITY;
 
-        size = sizeof(int) * nr_caps;
-        src_caps = kmalloc(size);
-        dst_caps = kmalloc(size);
-
-        /* get args from user buffer */
-        copy_from_user((void *)src_caps, (void *)src_caps_buf, size);
-
-        for (i = 0; i < nr_caps; ++i) {
-                dst_caps[i] = cap_copy(
-                        current_cap_group, dest_cap_group, src_caps[i]);
+        /* copy by batches of the on-stack buffers instead of kmalloc */
+        for (i = 0; i < nr_caps; i += n) {
+                n = MIN(nr_caps - i, TRANSFER_CAPS_BATCH);
+
+                /* get args from user buffer */
+                r = copy_from_user((void *)src_caps,
+                                   (void *)src_caps_buf + sizeof(int) * i,
+                                   sizeof(int) * n);
+                if (r < 0)
+                        goto out_free_caps;
+
+                r = cap_copy_n(current_cap_group,
+                               dest_cap_group,
+                               src_caps,
+                               dst_caps + i,
+                               n);
+                if (r < 0)
+                        goto out_free_caps;
         }
 
         /* write results to user buffer */
-        copy_to_user((void *)dst_caps_buf, (void *)dst_caps, size);
-
-        kfree(src_caps);
-        kfree(dst_caps);
-
+        r = copy_to_user(
+                (void *)dst_caps_buf, (void *)dst_caps, sizeof(int) * nr_caps);
+        if (r < 0)
+                goto out_free_caps;
         obj_put(dest_cap_group);
         return 0;
+
+out_free_caps:
+        /* undo the batches already copied */
+        while (i-- > 0)
+                cap_free(dest_cap_group, dst_caps[i]);
+        obj_put(dest_cap_group);
+        return r;
 }
 
 int sys_cap_move(u64 dest_cap_group_cap, u64 src_slot_id)
@@ -151,10 +151,10 @@ static int read_write_pmo(u64 pmo_cap, u64 offset, u64 user_buf, u64 size,
                 goto out_fail;
         }
 
-        /* Only PMO_DATA or PMO_ANONYM is allowed with this inferface. */
+        /* Only PMO_DATA, PMO_ANONYM or PMO_HUGE is allowed here. */
         pmo_type = pmo->type;
         if ((pmo_type != PMO_DATA) && (pmo_type != PMO_DATA_NOCACHE)
-            && (pmo_type != PMO_ANONYM)) {
+            && (pmo_type != PMO_ANONYM) && (pmo_type != PMO_HUGE)) {
                 r = -EINVAL;
                 goto out_obj_put;
         }
@@ -178,24 +178,37 @@ static int read_write_pmo(u64 pmo_cap, u64 offset, u64 user_buf, u64 size,
                 else // op_type == READ
                         r = copy_to_user((char *)user_buf, (char *)kva, size);
         } else {
-                /* PMO_ANONYM */
+                /* PMO_ANONYM or PMO_HUGE */
                 u64 index;
                 u64 pa;
                 u64 to_read_write;
                 u64 offset_in_page;
+                u64 pg_size;
+                int pg_order;
+
+                if (pmo_type == PMO_HUGE) {
+                        pg_order = PMO_HUGE_PAGE_ORDER;
+                        pg_size = PMO_HUGE_PAGE_SIZE;
+                } else {
+                        pg_order = 0;
+                        pg_size = PAGE_SIZE;
+                }
 
                 while (size > 0) {
-                        index = ROUND_DOWN(offset, PAGE_SIZE) / PAGE_SIZE;
+                        index = ROUND_DOWN(offset, pg_size) / pg_size;
                         pa = get_page_from_pmo(pmo, index);
                         if (pa == 0) {
                                 /* Allocate a physical page for the anonymous
                                  * pmo like a page fault happens.
                                  */
-                                kva = (vaddr_t)get_pages(0);
-                                BUG_ON(kva == 0);
+                                kva = (vaddr_t)get_pages(pg_order);
+                                if (kva == 0) {
+                                        r = -ENOMEM;
+                                        goto out_obj_put;
+                                }
 
                                 pa = virt_to_phys((void *)kva);
-                                memset((void *)kva, 0, PAGE_SIZE);
+                                memset((void *)kva, 0, pg_size);
                                 commit_page_to_pmo(pmo, index, pa);
 
                                 /* No need to map the physical page in the page
@@ -208,9 +221,9 @@ static int read_write_pmo(u64 pmo_cap, u64 offset, u64 user_buf, u64 size,
                         }
                         /* Now kva is the beginning of some page, we should add
                          * the offset inside the page. */
-                        offset_in_page = offset - ROUND_DOWN(offset, PAGE_SIZE);
+                        offset_in_page = offset - ROUND_DOWN(offset, pg_size);
                         kva += offset_in_page;
-                        to_read_write = MIN(PAGE_SIZE - offset_in_page, size);
+                        to_read_write = MIN(pg_size - offset_in_page, size);
 
                         if (op_type == WRITE)
                                 r = copy_from_user((char *)kva,
@@ -249,6 +262,21 @@ int sys_read_pmo(u64 pmo_cap, u64 offset, u64 user_ptr, u64 len)
 /**
  * Given a pmo_cap, return its corresponding start physical address.
  */
+/* Size of a pmo, for checking a pmo received from others against its use */
+int sys_get_pmo_size(u64 pmo_cap, u64 user_buf)
+{
+        struct pmobject *pmo;
+        int r;
+
+        pmo = obj_get(current_cap_group, pmo_cap, TYPE_PMO);
+        if (!pmo)
+                return -ECAPBILITY;
+
+        r = copy_to_user((char *)user_buf, (char *)&pmo->size, sizeof(u64));
+        obj_put(pmo);
+        return r;
+}
+
 int sys_get_pmo_paddr(u64 pmo_cap, u64 user_buf)
 {
         struct pmobject *pmo;
@@ -533,6 +561,8 @@ fail1:
  */
 int pmo_init(struct pmobject *pmo, pmo_type_t type, size_t len, paddr_t paddr)
 {
+        void *data;
+
         memset((void *)pmo, 0, sizeof(*pmo));
 
         len = ROUND_UP(len, PAGE_SIZE);
@@ -547,7 +577,10 @@ int pmo_init(struct pmobject *pmo, pmo_type_t type, size_t len, paddr_t paddr)
                  * So, we directly allocate the physical memory.
                  * Note that kmalloc(>2048) returns continous physical pages.
                  */
-                pmo->start = (paddr_t)virt_to_phys(kmalloc(len));
+                data = kmalloc(len);
+                if (!data)
+                        return -ENOMEM;
+                pmo->start = (paddr_t)virt_to_phys(data);
                 break;
         }
         case PMO_ANONYM:
@@ -560,6 +593,13 @@ int pmo_init(struct pmobject *pmo, pmo_type_t type, size_t len, paddr_t paddr)
                 init_radix(pmo->radix);
                 break;
         }
+        case PMO_HUGE: {
+                /* Lazily allocated as PMO_ANONYM, but in 2M blocks */
+                pmo->size = ROUND_UP(len, PMO_HUGE_PAGE_SIZE);
+                pmo->radix = new_radix();
+                init_radix(pmo->radix);
+                break;
+        }
         case PMO_DEVICE: {
                 /*
                  * For device memory (e.g., for DMA).
@@ -587,7 +627,8 @@ void commit_page_to_pmo(struct pmobject *pmo, u64 index, paddr_t pa)
 {
         int ret;
 
-        BUG_ON((pmo->type != PMO_ANONYM) && (pmo->type != PMO_SHM));
+        BUG_ON((pmo->type != PMO_ANONYM) && (pmo->type != PMO_SHM)
+               && (pmo->type != PMO_HUGE));
         /* The radix interfaces are thread-safe */
         ret = radix_add(pmo->radix, index, (void *)pa);
         BUG_ON(ret != 0);
@@ -628,7 +669,8 @@ void pmo_deinit(void *pmo_ptr)
                 break;
         }
         case PMO_ANONYM:
-        case PMO_SHM: {
+        case PMO_SHM:
+        case PMO_HUGE: {
                 struct radix *radix;
 
                 radix = pmo->radix;
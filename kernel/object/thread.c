@@ -50,6 +50,7 @@ static int thread_init(struct thread *thread, struct cap_group *cap_group,
 
         /* The ipc_config will be allocated on demand */
         thread->general_ipc_config = NULL;
+        thread->ipc_batch = NULL;
         return 0;
 }
 
@@ -69,6 +70,8 @@ void thread_deinit(void *thread_ptr)
 
         if (thread->general_ipc_config)
                 kfree(thread->general_ipc_config);
+        if (thread->ipc_batch)
+                kfree(thread->ipc_batch);
 
         destroy_thread_ctx(thread);
 
@@ -433,6 +436,8 @@ void sys_thread_exit(void)
  * Finish the sys_set_affinity
  * You do not need to schedule out current thread immediately,
  * as it is the duty of sys_yield()
+ * An explicit affinity also overrides wake-affine, i.e., the wake_cpu set
+ * by an IPC call is cleared until the next call.
  */
 int sys_set_affinity(u64 thread_cap, s32 aff)
 {
@@ -458,6 +463,7 @@ int sys_set_affinity(u64 thread_cap, s32 aff)
         }
 
         thread->thread_ctx->affinity = aff;
+        thread->thread_ctx->wake_cpu = NO_AFF;
         if (thread_cap != -1)
                 obj_put((void *)thread);
 out:
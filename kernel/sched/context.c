@@ -14,9 +14,30 @@
 #include <object/thread.h>
 #include <sched/sched.h>
 #include <mm/kmalloc.h>
+#include <mm/slab.h>
 #include <common/util.h>
 #include <common/kprint.h>
 
+/*
+ * Scheduling contexts are one cache line each. The thread_ctx itself lives
+ * at the top of the kernel stack (below), which takes a page of its own.
+ */
+static struct slab_cache *sched_cont_cache;
+
+static void sched_cont_ctor(void *obj)
+{
+        memset(obj, 0, sizeof(sched_cont_t));
+}
+
+void sched_cont_cache_init(void)
+{
+        sched_cont_cache = kmem_cache_create("sched_cont",
+                                             sizeof(sched_cont_t),
+                                             CACHELINE_SZ,
+                                             sched_cont_ctor);
+        BUG_ON(!sched_cont_cache);
+}
+
 /*
  * The kernel stack for a thread looks like:
  *
@@ -56,7 +77,7 @@ struct thread_ctx *create_thread_ctx(u32 type)
                 ctx->sc = NULL;
         } else {
                 /* Allocate a scheduling context for threads of other types */
-                sc = kzalloc(sizeof(sched_cont_t));
+                sc = kmem_cache_alloc(sched_cont_cache);
                 if (sc == NULL) {
                         kwarn("create_thread_ctx fails due to lack of memory\n");
                         kfree(kernel_stack);
@@ -77,9 +98,12 @@ void destroy_thread_ctx(struct thread *thread)
         /* Register or shadow threads do not have scheduling contexts */
         if (thread->thread_ctx->type != TYPE_SHADOW) {
                 BUG_ON(!thread->thread_ctx->sc);
-                kfree(thread->thread_ctx->sc);
+                rsv_release(thread->thread_ctx->sc);
+                kmem_cache_free(sched_cont_cache, thread->thread_ctx->sc);
         }
 
+        arch_fpu_release(thread);
+
         kernel_stack = (void *)thread->thread_ctx - DEFAULT_KERNEL_STACK_SZ
                        + sizeof(struct thread_ctx);
         kfree(kernel_stack);
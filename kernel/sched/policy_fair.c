@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan PSL v1.
+ * You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v1 for more details.
+ */
+
+/*
+ * Weighted fair share (FAIR) policy, in the spirit of CFS with groups.
+ * CPU time is shared among cap_groups first and then among the threads of
+ * a group, so that a process with many threads gets no more than one with
+ * a single thread of the same weight.
+ *
+ * Each CPU queues the groups with ready threads there by their virtual
+ * runtime, i.e., the time on this CPU scaled by SCHED_WEIGHT_DEFAULT /
+ * sched_weight. The group of the least vruntime runs its thread of the
+ * least vruntime for DEFAULT_BUDGET ticks at most. A group or thread which
+ * becomes ready again starts from the least vruntime of its queue, so that
+ * it cannot save up time while sleeping.
+ *
+ * Weights apply on each CPU separately: a group ready on several CPUs is
+ * not split among them.
+ */
+#include <sched/sched.h>
+#include <arch/machine/smp.h>
+#include <common/kprint.h>
+#include <machine.h>
+#include <common/list.h>
+#include <common/util.h>
+#include <common/macro.h>
+#include <common/errno.h>
+#include <common/types.h>
+#include <common/lock.h>
+#include <object/thread.h>
+#include <object/cap_group.h>
+#include <sched/context.h>
+#include <irq/timer.h>
+
+/* Ready groups of one CPU */
+struct fair_rq {
+        /* fair_group_ent, sorted by vruntime */
+        struct list_head group_queue;
+        /* Ready threads of all the groups */
+        u32 queue_len;
+        /* Lower bound of the vruntime of the groups, for placing them */
+        u64 min_vruntime;
+        struct lock queue_lock;
+} __attribute__((aligned(CACHELINE_SZ)));
+
+struct fair_rq fair_rqs[PLAT_CPU_NUM];
+
+/* Idle threads (in sched.c) are chosen when all the queues are empty */
+extern struct thread idle_threads[PLAT_CPU_NUM];
+
+void fair_init_cap_group(struct cap_group *cap_group)
+{
+        struct fair_group_ent *ent;
+        int i;
+
+        cap_group->sched_weight = SCHED_WEIGHT_DEFAULT;
+        for (i = 0; i < PLAT_CPU_NUM; i++) {
+                ent = &cap_group->fair_ents[i];
+                init_list_head(&ent->node);
+                init_list_head(&ent->thread_queue);
+                ent->nr_ready = 0;
+                ent->vruntime = 0;
+                ent->min_vruntime = 0;
+        }
+}
+
+/* Insert @ent into the group queue of @rq by vruntime, FIFO among ties */
+static void fair_insert_group(struct fair_rq *rq, struct fair_group_ent *ent)
+{
+        struct fair_group_ent *pos;
+
+        for_each_in_list (pos, struct fair_group_ent, node, &rq->group_queue) {
+                if (pos->vruntime > ent->vruntime)
+                        break;
+        }
+        /* Insert before pos, or at the tail if the loop completes */
+        list_append(&ent->node, &pos->node);
+}
+
+static void fair_insert_thread(struct fair_group_ent *ent,
+                               struct thread *thread)
+{
+        struct thread *pos;
+        u64 vruntime = thread->thread_ctx->vruntime;
+
+        for_each_in_list (
+                pos, struct thread, ready_queue_node, &ent->thread_queue) {
+                if (pos->thread_ctx->vruntime > vruntime)
+                        break;
+        }
+        list_append(&thread->ready_queue_node, &pos->ready_queue_node);
+}
+
+/* Put @thread into the queue of its group on @cpuid, whose lock is held */
+static void __fair_sched_enqueue(u32 cpuid, struct thread *thread)
+{
+        struct fair_rq *rq = &fair_rqs[cpuid];
+        struct fair_group_ent *ent = &thread->cap_group->fair_ents[cpuid];
+        struct thread_ctx *ctx = thread->thread_ctx;
+
+        ctx->vruntime = MAX(ctx->vruntime, ent->min_vruntime);
+        fair_insert_thread(ent, thread);
+        if (ent->nr_ready++ == 0) {
+                ent->vruntime = MAX(ent->vruntime, rq->min_vruntime);
+                fair_insert_group(rq, ent);
+        }
+        rq->queue_len++;
+        ctx->cpuid = cpuid;
+        ctx->state = TS_READY;
+}
+
+/* Remove @thread from the queue on @cpuid, whose lock is held */
+static void __fair_sched_dequeue(u32 cpuid, struct thread *thread)
+{
+        struct fair_group_ent *ent = &thread->cap_group->fair_ents[cpuid];
+
+        list_del(&thread->ready_queue_node);
+        if (--ent->nr_ready == 0)
+                list_del(&ent->node);
+        fair_rqs[cpuid].queue_len--;
+        thread->thread_ctx->state = TS_INTER;
+}
+
+/*
+ * Put `thread` into the queue of its group on the CPU of its affinity, or
+ * on the one by sched_pick_cpu if affinity = NO_AFF.
+ */
+int fair_sched_enqueue(struct thread *thread)
+{
+        struct fair_rq *rq;
+        s32 cpuid;
+
+        if (!thread || !thread->thread_ctx
+            || thread->thread_ctx->state == TS_READY) {
+                return -1;
+        }
+
+        cpuid = thread->thread_ctx->affinity;
+        if (cpuid == NO_AFF) {
+                cpuid = sched_pick_cpu(thread);
+        } else if (cpuid >= PLAT_CPU_NUM) {
+                return -1;
+        }
+
+        if (thread->thread_ctx->type != TYPE_IDLE) {
+                rq = &fair_rqs[cpuid];
+                lock(&rq->queue_lock);
+                __fair_sched_enqueue(cpuid, thread);
+                unlock(&rq->queue_lock);
+                sched_stat_enqueue(thread);
+                /* The core may be idle with its tick stopped */
+                tick_kick_cpu(cpuid);
+        }
+        return 0;
+}
+
+/* Remove `thread` from its current residual ready queue */
+int fair_sched_dequeue(struct thread *thread)
+{
+        struct fair_rq *rq;
+        u32 cpuid;
+
+        if (!thread || !thread->thread_ctx
+            || thread->thread_ctx->state != TS_READY) {
+                return -1;
+        }
+
+        if (thread->thread_ctx->type != TYPE_IDLE) {
+                cpuid = thread->thread_ctx->cpuid;
+                rq = &fair_rqs[cpuid];
+                lock(&rq->queue_lock);
+                __fair_sched_dequeue(cpuid, thread);
+                unlock(&rq->queue_lock);
+                sched_stat_dequeue(thread);
+        }
+        return 0;
+}
+
+/* Choose the first thread of the first group and dequeue it */
+struct thread *fair_sched_choose_thread(void)
+{
+        u32 cpuid = smp_get_cpu_id();
+        struct fair_rq *rq = &fair_rqs[cpuid];
+        struct fair_group_ent *ent;
+        struct thread *thread = NULL;
+
+        lock(&rq->queue_lock);
+        if (!list_empty(&rq->group_queue)) {
+                ent = list_entry(
+                        rq->group_queue.next, struct fair_group_ent, node);
+                thread = list_entry(ent->thread_queue.next,
+                                    struct thread,
+                                    ready_queue_node);
+                /* Both are the least of their queues */
+                rq->min_vruntime = MAX(rq->min_vruntime, ent->vruntime);
+                ent->min_vruntime =
+                        MAX(ent->min_vruntime, thread->thread_ctx->vruntime);
+                __fair_sched_dequeue(cpuid, thread);
+        }
+        unlock(&rq->queue_lock);
+
+        if (!thread)
+                return &idle_threads[cpuid];
+        sched_stat_dequeue(thread);
+        return thread;
+}
+
+/*
+ * Charge @delta ticks on this CPU to @thread and to its group here, which
+ * is moved back in the queue if other threads of it are ready.
+ */
+void fair_sched_charge(struct thread *thread, u64 delta)
+{
+        u32 cpuid = smp_get_cpu_id();
+        struct fair_rq *rq = &fair_rqs[cpuid];
+        struct fair_group_ent *ent;
+        struct cap_group *cap_group = thread->cap_group;
+
+        if (thread->thread_ctx->type == TYPE_IDLE)
+                return;
+
+        ent = &cap_group->fair_ents[cpuid];
+        lock(&rq->queue_lock);
+        thread->thread_ctx->vruntime += delta;
+        ent->vruntime += delta * SCHED_WEIGHT_DEFAULT / cap_group->sched_weight;
+        if (ent->nr_ready > 0) {
+                list_del(&ent->node);
+                fair_insert_group(rq, ent);
+        }
+        unlock(&rq->queue_lock);
+}
+
+static inline void fair_sched_refill_budget(struct thread *target, u32 budget)
+{
+        target->thread_ctx->sc->budget = budget;
+}
+
+/*
+ * Schedule a thread to execute.
+ * The running thread goes on until its budget is used up, and then it is
+ * charged and queued by its new vruntime behind the other groups.
+ */
+int fair_sched(void)
+{
+        struct thread_ctx *ctx;
+
+        if (current_thread) {
+                ctx = current_thread->thread_ctx;
+                if (ctx->thread_exit_state == TE_EXITING) {
+                        ctx->state = TS_EXIT;
+                        ctx->thread_exit_state = TE_EXITED;
+                }
+
+                if (ctx->state == TS_RUNNING) {
+                        if (ctx->sc->budget != 0) {
+                                switch_to_thread(current_thread);
+                                return 0;
+                        }
+                        fair_sched_refill_budget(current_thread,
+                                                 DEFAULT_BUDGET);
+                        /* Queue it by the vruntime up to now */
+                        sched_charge_oncpu();
+                        ctx->state = TS_INTER;
+                        fair_sched_enqueue(current_thread);
+                }
+        }
+
+        switch_to_thread(fair_sched_choose_thread());
+        return 0;
+}
+
+int fair_sched_init(void)
+{
+        int i;
+
+        /* Initialize global variables */
+        for (i = 0; i < PLAT_CPU_NUM; i++) {
+                current_threads[i] = NULL;
+                init_list_head(&fair_rqs[i].group_queue);
+                fair_rqs[i].queue_len = 0;
+                fair_rqs[i].min_vruntime = 0;
+                lock_init(&fair_rqs[i].queue_lock);
+        }
+
+        init_idle_threads("KNL-IDLE-FAIR");
+        return 0;
+}
+
+u32 fair_sched_queue_len(u32 cpuid)
+{
+        return fair_rqs[cpuid].queue_len;
+}
+
+void fair_top(void)
+{
+        struct fair_group_ent *ent;
+        struct cap_group *cap_group;
+        struct thread *thread;
+        u32 cpuid;
+
+        printk("\n*****CPU RQ Info*****\n");
+        for (cpuid = 0; cpuid < PLAT_CPU_NUM; cpuid++) {
+                printk("== CPU %d RQ LEN %lu==\n",
+                       cpuid,
+                       fair_rqs[cpuid].queue_len);
+                if (current_threads[cpuid] != NULL) {
+                        printk("Current ");
+                        print_thread(current_threads[cpuid]);
+                }
+                for_each_in_list (ent,
+                                  struct fair_group_ent,
+                                  node,
+                                  &fair_rqs[cpuid].group_queue) {
+                        cap_group = container_of(
+                                ent, struct cap_group, fair_ents[cpuid]);
+                        printk("-- CAP GROUP:%s weight %u vruntime %lu --\n",
+                               cap_group->cap_group_name,
+                               cap_group->sched_weight,
+                               ent->vruntime);
+                        for_each_in_list (thread,
+                                          struct thread,
+                                          ready_queue_node,
+                                          &ent->thread_queue) {
+                                print_thread(thread);
+                        }
+                }
+                printk("\n");
+        }
+}
+
+struct sched_ops fair = {.sched_init = fair_sched_init,
+                         .sched = fair_sched,
+                         .sched_enqueue = fair_sched_enqueue,
+                         .sched_dequeue = fair_sched_dequeue,
+                         .sched_queue_len = fair_sched_queue_len,
+                         .sched_charge = fair_sched_charge,
+                         .sched_top = fair_top};
@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan PSL v1.
+ * You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v1 for more details.
+ */
+
+/*
+ * Priority-based Round Robin (PBRR) policy.
+ * Each CPU has one ready queue per priority, and the threads of the highest
+ * priority run in round robin. A ready thread of a higher priority preempts
+ * the running one at the next sched (e.g., the next timer irq).
+ */
+#include <sched/sched.h>
+#include <arch/machine/smp.h>
+#include <common/kprint.h>
+#include <machine.h>
+#include <mm/kmalloc.h>
+#include <common/list.h>
+#include <common/util.h>
+#include <common/bitops.h>
+#include <common/macro.h>
+#include <common/errno.h>
+#include <common/types.h>
+#include <object/thread.h>
+#include <irq/irq.h>
+#include <sched/context.h>
+#include <irq/timer.h>
+
+/* Metadata for the ready queues of one CPU */
+struct pbrr_queue_meta {
+        struct list_head queue_head[PRIO_NUM];
+        /* The prio-th bit is set iff queue_head[prio] is not empty */
+        unsigned long prio_bmp[BITS_TO_LONGS(PRIO_NUM)];
+        u32 queue_len;
+} __attribute__((aligned(CACHELINE_SZ)));
+
+/*
+ * pbrr_ready_queue
+ * Per-CPU ready queues for ready tasks.
+ */
+struct pbrr_queue_meta pbrr_ready_queue_meta[PLAT_CPU_NUM];
+
+/* Idle threads (in sched.c) are chosen when all the queues are empty */
+extern struct thread idle_threads[PLAT_CPU_NUM];
+
+static int __pbrr_sched_enqueue(struct thread *thread, bool to_head)
+{
+        struct pbrr_queue_meta *meta;
+        s32 cpuid;
+        u32 prio;
+
+        if (!thread || !thread->thread_ctx
+            || thread->thread_ctx->state == TS_READY) {
+                return -1;
+        }
+
+        cpuid = thread->thread_ctx->affinity;
+        if (cpuid == NO_AFF) {
+                cpuid = sched_pick_cpu(thread);
+        } else if (cpuid >= PLAT_CPU_NUM) {
+                return -1;
+        }
+
+        prio = thread->thread_ctx->prio;
+        if (prio > MAX_PRIO)
+                return -1;
+
+        if (thread->thread_ctx->type != TYPE_IDLE) {
+                meta = &pbrr_ready_queue_meta[cpuid];
+                if (to_head)
+                        list_add(&thread->ready_queue_node,
+                                 &meta->queue_head[prio]);
+                else
+                        list_append(&thread->ready_queue_node,
+                                    &meta->queue_head[prio]);
+                set_bit(prio, meta->prio_bmp);
+                meta->queue_len++;
+                thread->thread_ctx->cpuid = cpuid;
+                thread->thread_ctx->state = TS_READY;
+                sched_stat_enqueue(thread);
+                /* The core may be idle with its tick stopped */
+                tick_kick_cpu(cpuid);
+        }
+        return 0;
+}
+
+/*
+ * Put `thread` at the end of the ready queue of its priority on the CPU of
+ * its affinity, or on the one by sched_pick_cpu if affinity = NO_AFF.
+ */
+int pbrr_sched_enqueue(struct thread *thread)
+{
+        return __pbrr_sched_enqueue(thread, false);
+}
+
+/* Remove `thread` from its current residual ready queue */
+int pbrr_sched_dequeue(struct thread *thread)
+{
+        struct pbrr_queue_meta *meta;
+        u32 prio;
+
+        if (!thread || !thread->thread_ctx
+            || thread->thread_ctx->state != TS_READY) {
+                return -1;
+        }
+
+        if (thread->thread_ctx->type != TYPE_IDLE) {
+                meta = &pbrr_ready_queue_meta[thread->thread_ctx->cpuid];
+                prio = thread->thread_ctx->prio;
+                list_del(&thread->ready_queue_node);
+                if (list_empty(&meta->queue_head[prio]))
+                        clear_bit(prio, meta->prio_bmp);
+                meta->queue_len--;
+                thread->thread_ctx->state = TS_INTER;
+                sched_stat_dequeue(thread);
+        }
+        return 0;
+}
+
+/* Highest priority of the ready threads on @cpuid, -1 if there is none */
+static int pbrr_highest_prio(u32 cpuid)
+{
+        int prio;
+
+        prio = find_last_bit(pbrr_ready_queue_meta[cpuid].prio_bmp, PRIO_NUM);
+        return prio == PRIO_NUM ? -1 : prio;
+}
+
+/* Choose the first thread of the highest priority and dequeue it */
+struct thread *pbrr_sched_choose_thread(void)
+{
+        struct thread *thread = NULL;
+        u32 cpuid = smp_get_cpu_id();
+        int prio;
+
+        prio = pbrr_highest_prio(cpuid);
+        if (prio < 0)
+                return &idle_threads[cpuid];
+
+        thread = list_entry(pbrr_ready_queue_meta[cpuid].queue_head[prio].next,
+                            struct thread,
+                            ready_queue_node);
+        pbrr_sched_dequeue(thread);
+        return thread;
+}
+
+static inline void pbrr_sched_refill_budget(struct thread *target, u32 budget)
+{
+        target->thread_ctx->sc->budget = budget;
+}
+
+/*
+ * Schedule a thread to execute.
+ * The running thread goes on unless its budget is used up or a thread of a
+ * higher priority is ready on this CPU. A preempted thread is put back at
+ * the head of its queue, so that it resumes first with the budget left.
+ */
+int pbrr_sched(void)
+{
+        struct thread_ctx *ctx;
+
+        if (current_thread) {
+                ctx = current_thread->thread_ctx;
+                if (ctx->thread_exit_state == TE_EXITING) {
+                        ctx->state = TS_EXIT;
+                        ctx->thread_exit_state = TE_EXITED;
+                }
+
+                if (ctx->state == TS_RUNNING && ctx->type != TYPE_IDLE) {
+                        if (ctx->sc->budget == 0) {
+                                pbrr_sched_refill_budget(current_thread,
+                                                         DEFAULT_BUDGET);
+                                ctx->state = TS_INTER;
+                                __pbrr_sched_enqueue(current_thread, false);
+                        } else if (pbrr_highest_prio(smp_get_cpu_id())
+                                   > (int)ctx->prio) {
+                                ctx->state = TS_INTER;
+                                __pbrr_sched_enqueue(current_thread, true);
+                        } else {
+                                switch_to_thread(current_thread);
+                                return 0;
+                        }
+                }
+        }
+
+        switch_to_thread(pbrr_sched_choose_thread());
+        return 0;
+}
+
+int pbrr_sched_init(void)
+{
+        int i, prio;
+
+        /* Initialize global variables */
+        for (i = 0; i < PLAT_CPU_NUM; i++) {
+                current_threads[i] = NULL;
+                for (prio = 0; prio < PRIO_NUM; prio++)
+                        init_list_head(
+                                &pbrr_ready_queue_meta[i].queue_head[prio]);
+                memset(pbrr_ready_queue_meta[i].prio_bmp,
+                       0,
+                       sizeof(pbrr_ready_queue_meta[i].prio_bmp));
+                pbrr_ready_queue_meta[i].queue_len = 0;
+        }
+
+        init_idle_threads("KNL-IDLE-PBRR");
+        return 0;
+}
+
+u32 pbrr_sched_queue_len(u32 cpuid)
+{
+        return pbrr_ready_queue_meta[cpuid].queue_len;
+}
+
+void pbrr_top(void)
+{
+        struct pbrr_queue_meta *meta;
+        struct thread *thread;
+        u32 cpuid;
+        int prio;
+
+        printk("\n*****CPU RQ Info*****\n");
+        for (cpuid = 0; cpuid < PLAT_CPU_NUM; cpuid++) {
+                meta = &pbrr_ready_queue_meta[cpuid];
+                printk("== CPU %d RQ LEN %lu==\n", cpuid, meta->queue_len);
+                if (current_threads[cpuid] != NULL) {
+                        printk("Current ");
+                        print_thread(current_threads[cpuid]);
+                }
+                /* From the highest priority to the lowest */
+                for (prio = MAX_PRIO; prio >= MIN_PRIO; prio--) {
+                        for_each_in_list (thread,
+                                          struct thread,
+                                          ready_queue_node,
+                                          &meta->queue_head[prio]) {
+                                print_thread(thread);
+                        }
+                }
+                printk("\n");
+        }
+}
+
+struct sched_ops pbrr = {.sched_init = pbrr_sched_init,
+                         .sched = pbrr_sched,
+                         .sched_enqueue = pbrr_sched_enqueue,
+                         .sched_dequeue = pbrr_sched_dequeue,
+                         .sched_queue_len = pbrr_sched_queue_len,
+                         .sched_top = pbrr_top};
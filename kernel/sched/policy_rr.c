@@ -25,15 +25,17 @@
 #include <object/thread.h>
 #include <irq/irq.h>
 #include <sched/context.h>
-
-/* in arch/sched/idle.S */
-void idle_thread_routine(void);
+#include <common/lock.h>
+#include <irq/timer.h>
 
 /* Metadata for ready queue */
 struct queue_meta {
         struct list_head queue_head;
         u32 queue_len;
-        char pad[pad_to_cache_line(sizeof(u32) + sizeof(struct list_head))];
+        /* Protects the queue, which may be stolen from by other CPUs */
+        struct lock queue_lock;
+        char pad[pad_to_cache_line(sizeof(u32) + sizeof(struct list_head)
+                                   + sizeof(struct lock))];
 };
 
 /*
@@ -43,43 +45,86 @@ struct queue_meta {
 struct queue_meta rr_ready_queue_meta[PLAT_CPU_NUM];
 
 /*
- * RR policy also has idle threads.
+ * RR policy also has idle threads (in sched.c).
  * When no active user threads in ready queue,
  * we will choose the idle thread to execute.
  * Idle thread will **NOT** be in the RQ.
  */
-struct thread idle_threads[PLAT_CPU_NUM];
+extern struct thread idle_threads[PLAT_CPU_NUM];
+
+/*
+ * Whether @thread just enqueued on the current CPU, with @queue_len threads
+ * in the queue, waits for another thread to run first.
+ */
+static bool rr_sched_must_wait(struct thread *thread, u32 queue_len)
+{
+        if (queue_len > 1)
+                return true;
+        return current_thread && current_thread != thread
+               && current_thread->thread_ctx->type != TYPE_IDLE;
+}
 
 /*
  * Sched_enqueue
  * Put `thread` at the end of ready queue of assigned `affinity`.
- * If affinity = NO_AFF, assign the core to the current cpu.
+ * If affinity = NO_AFF, assign the core by sched_pick_cpu, i.e., the
+ * wake_cpu of the thread or the current cpu.
  * If the thread is IDLE thread, do nothing!
  * Do not forget to check if the affinity is valid!
+ * Reserved threads go to the queues of policy_rsv.c instead.
  */
 int rr_sched_enqueue(struct thread *thread)
 {
+        struct queue_meta *meta;
+        u32 queue_len;
+
         if (!thread || !thread->thread_ctx
             || thread->thread_ctx->state == TS_READY) {
                 return -1;
         }
+        if (sched_is_rsv(thread->thread_ctx->sc))
+                return rsv_sched_enqueue(thread);
 
         s32 cpuid = thread->thread_ctx->affinity;
         if (cpuid == NO_AFF) {
-                cpuid = smp_get_cpu_id();
+                cpuid = sched_pick_cpu(thread);
         } else if (cpuid >= PLAT_CPU_NUM) {
                 return -1;
         }
 
         if (thread->thread_ctx->type != TYPE_IDLE) {
-                list_append(&thread->ready_queue_node,
-                            &rr_ready_queue_meta[cpuid].queue_head);
+                meta = &rr_ready_queue_meta[cpuid];
+                lock(&meta->queue_lock);
+                list_append(&thread->ready_queue_node, &meta->queue_head);
+                meta->queue_len++;
                 thread->thread_ctx->cpuid = cpuid;
                 thread->thread_ctx->state = TS_READY;
+                queue_len = meta->queue_len;
+                unlock(&meta->queue_lock);
+                sched_stat_enqueue(thread);
+
+                /*
+                 * Idle cores stop their tick, so wake up the target core,
+                 * or one to steal the thread if it has to wait here.
+                 */
+                if (cpuid != smp_get_cpu_id())
+                        tick_kick_cpu(cpuid);
+                else if (thread->thread_ctx->affinity == NO_AFF
+                         && rr_sched_must_wait(thread, queue_len))
+                        tick_kick_idle_cpu();
         }
         return 0;
 }
 
+/* Remove `thread` from @meta, whose queue_lock is held */
+static void __rr_sched_dequeue(struct queue_meta *meta, struct thread *thread)
+{
+        list_del(&thread->ready_queue_node);
+        meta->queue_len--;
+        thread->thread_ctx->state = TS_INTER;
+        sched_stat_dequeue(thread);
+}
+
 /*
  * Sched_dequeue
  * remove `thread` from its current residual ready queue
@@ -87,39 +132,170 @@ int rr_sched_enqueue(struct thread *thread)
  */
 int rr_sched_dequeue(struct thread *thread)
 {
+        struct queue_meta *meta;
+        u32 cpuid;
+
         if (!thread || !thread->thread_ctx
             || thread->thread_ctx->state != TS_READY) {
                 return -1;
         }
+        if (sched_is_rsv(thread->thread_ctx->sc))
+                return rsv_sched_dequeue(thread);
 
         if (thread->thread_ctx->type != TYPE_IDLE) {
-                list_del(&thread->ready_queue_node);
-                thread->thread_ctx->state = TS_INTER;
+                /* The thread may be moved to another queue before locking */
+                while (true) {
+                        cpuid = thread->thread_ctx->cpuid;
+                        meta = &rr_ready_queue_meta[cpuid];
+                        lock(&meta->queue_lock);
+                        if (thread->thread_ctx->cpuid == cpuid)
+                                break;
+                        unlock(&meta->queue_lock);
+                }
+                if (thread->thread_ctx->state != TS_READY) {
+                        unlock(&meta->queue_lock);
+                        return -1;
+                }
+                __rr_sched_dequeue(meta, thread);
+                unlock(&meta->queue_lock);
         }
         return 0;
 }
 
 /*
- * Choose an appropriate thread and dequeue from ready queue
+ * The longest ready queue other than @cpuid's, NULL if all are empty.
+ * queue_len is read without the locks, as a hint only.
+ */
+static struct queue_meta *rr_longest_remote_queue(u32 cpuid)
+{
+        struct queue_meta *longest = NULL;
+        u32 i, max_len = 0;
+
+        for (i = 0; i < PLAT_CPU_NUM; i++) {
+                if (i != cpuid && rr_ready_queue_meta[i].queue_len > max_len) {
+                        longest = &rr_ready_queue_meta[i];
+                        max_len = longest->queue_len;
+                }
+        }
+        return longest;
+}
+
+/*
+ * Steal a ready thread for @cpuid, whose queue is empty, from the longest
+ * remote queue. Only NO_AFF threads are taken, and those without wake_cpu
+ * first, since the others run better near their IPC clients.
  *
- * Hints:
- * You can use `list_entry` to find the next ready thread in the ready queue
+ * Note: a thread enqueued by rr_sched is still on its kernel stack until
+ * its CPU erets to the next thread, which the big kernel lock serializes
+ * with the stealer for now.
+ */
+static struct thread *rr_steal_thread(u32 cpuid)
+{
+        struct queue_meta *victim;
+        struct thread *thread, *target = NULL;
+
+        victim = rr_longest_remote_queue(cpuid);
+        if (!victim)
+                return NULL;
+
+        lock(&victim->queue_lock);
+        for_each_in_list (
+                thread, struct thread, ready_queue_node, &victim->queue_head) {
+                if (thread->thread_ctx->affinity != NO_AFF)
+                        continue;
+                if (!target)
+                        target = thread;
+                if (thread->thread_ctx->wake_cpu == NO_AFF) {
+                        target = thread;
+                        break;
+                }
+        }
+        if (target) {
+                __rr_sched_dequeue(victim, target);
+                target->thread_ctx->cpuid = cpuid;
+        }
+        unlock(&victim->queue_lock);
+        return target;
+}
+
+/*
+ * Choose an appropriate thread and dequeue from ready queue
+ * Reserved threads come first, so that best-effort ones only run in the
+ * slack. When the local queue is empty, try to steal one before going idle.
  */
 struct thread *rr_sched_choose_thread(void)
 {
         struct thread *thread = NULL;
         u32 cpuid = smp_get_cpu_id();
-        if (list_empty(&rr_ready_queue_meta[cpuid].queue_head)) {
-                return &idle_threads[cpuid];
+        struct queue_meta *meta = &rr_ready_queue_meta[cpuid];
+
+        thread = rsv_sched_choose_thread(cpuid);
+        if (thread)
+                return thread;
+
+        lock(&meta->queue_lock);
+        if (!list_empty(&meta->queue_head)) {
+                thread = list_entry(
+                        meta->queue_head.next, struct thread, ready_queue_node);
+                __rr_sched_dequeue(meta, thread);
         }
+        unlock(&meta->queue_lock);
 
-        thread = list_entry(rr_ready_queue_meta[cpuid].queue_head.next,
-                            struct thread,
-                            ready_queue_node);
-        rr_sched_dequeue(thread);
+        if (!thread)
+                thread = rr_steal_thread(cpuid);
+        if (!thread)
+                thread = &idle_threads[cpuid];
         return thread;
 }
 
+/*
+ * Periodic rebalance for the current CPU, driven by the timer irq.
+ * NO_AFF threads are pulled from the longest remote queue until the two
+ * queues differ by at most one. Threads with wake_cpu stay where they are.
+ */
+void rr_sched_balance(void)
+{
+        u32 cpuid = smp_get_cpu_id();
+        struct queue_meta *local = &rr_ready_queue_meta[cpuid];
+        struct queue_meta *victim;
+        struct thread *thread, *tmp;
+        u32 nr;
+
+        victim = rr_longest_remote_queue(cpuid);
+        if (!victim || victim->queue_len <= local->queue_len + 1)
+                return;
+
+        /* Lock the two queues in a fixed order */
+        if (victim < local) {
+                lock(&victim->queue_lock);
+                lock(&local->queue_lock);
+        } else {
+                lock(&local->queue_lock);
+                lock(&victim->queue_lock);
+        }
+
+        nr = victim->queue_len > local->queue_len ?
+                     (victim->queue_len - local->queue_len) / 2 :
+                     0;
+        for_each_in_list_safe (
+                thread, tmp, ready_queue_node, &victim->queue_head) {
+                if (nr == 0)
+                        break;
+                if (thread->thread_ctx->affinity != NO_AFF
+                    || thread->thread_ctx->wake_cpu != NO_AFF)
+                        continue;
+                list_del(&thread->ready_queue_node);
+                victim->queue_len--;
+                list_append(&thread->ready_queue_node, &local->queue_head);
+                local->queue_len++;
+                thread->thread_ctx->cpuid = cpuid;
+                nr--;
+        }
+
+        unlock(&victim->queue_lock);
+        unlock(&local->queue_lock);
+}
+
 /*
  * You should use this function in rr_sched
  */
@@ -141,9 +317,13 @@ static inline void rr_sched_refill_budget(struct thread *target, u32 budget)
  * You should also check the state of the old thread. Old thread
  * could be exiting/waiting or running when calling this function.
  * You will also need to check the remaining budget of the old thread.
+ * A ready reserved thread of an earlier deadline preempts the running one,
+ * and a reserved thread out of its reservation is throttled.
  */
 int rr_sched(void)
 {
+        sched_cont_t *sc;
+
         if (current_thread) {
                 if (current_thread->thread_ctx->thread_exit_state
                     == TE_EXITING) {
@@ -153,7 +333,11 @@ int rr_sched(void)
                 }
 
                 if (current_thread->thread_ctx->state == TS_RUNNING) {
-                        if (current_thread->thread_ctx->sc->budget != 0) {
+                        sc = current_thread->thread_ctx->sc;
+                        if (sc->budget != 0
+                            && !(sched_is_rsv(sc) && sc->rsv_left == 0)
+                            && !rsv_should_preempt(current_thread,
+                                                   smp_get_cpu_id())) {
                                 switch_to_thread(current_thread);
                                 return 0;
                         }
@@ -172,53 +356,25 @@ int rr_sched(void)
 int rr_sched_init(void)
 {
         int i = 0;
-        char idle_name[] = "KNL-IDLE-RR";
-        int name_len = strlen(idle_name);
-
-        struct cap_group *idle_cap_group;
-        struct vmspace *idle_vmspace;
 
         /* Initialize global variables */
         for (i = 0; i < PLAT_CPU_NUM; i++) {
                 current_threads[i] = NULL;
                 init_list_head(&(rr_ready_queue_meta[i].queue_head));
                 rr_ready_queue_meta[i].queue_len = 0;
+                lock_init(&rr_ready_queue_meta[i].queue_lock);
         }
+        rsv_init();
 
-        /* Create a fake idle cap group to store the name */
-        idle_cap_group = kzalloc(sizeof(*idle_cap_group));
-        memset(idle_cap_group->cap_group_name, 0, MAX_GROUP_NAME_LEN);
-        if (name_len > MAX_GROUP_NAME_LEN)
-                name_len = MAX_GROUP_NAME_LEN;
-        memcpy(idle_cap_group->cap_group_name, idle_name, name_len);
-        init_list_head(&idle_cap_group->thread_list);
-
-        extern struct vmspace *create_idle_vmspace(void);
-        idle_vmspace = create_idle_vmspace();
-
-        /* Initialize one idle thread for each core and insert into the RQ */
-        for (i = 0; i < PLAT_CPU_NUM; i++) {
-                /* Set the thread context of the idle threads */
-                BUG_ON(!(idle_threads[i].thread_ctx =
-                                 create_thread_ctx(TYPE_IDLE)));
-                /* We will set the stack and func ptr in arch_idle_ctx_init */
-                init_thread_ctx(&idle_threads[i], 0, 0, MIN_PRIO, TYPE_IDLE, i);
-                /* Call arch-dependent function to fill the context of the idle
-                 * threads */
-                arch_idle_ctx_init(idle_threads[i].thread_ctx,
-                                   idle_thread_routine);
-
-                idle_threads[i].cap_group = idle_cap_group;
-                idle_threads[i].vmspace = idle_vmspace;
-
-                /* Add idle_threads to the threads list */
-                list_add(&idle_threads[i].node, &idle_cap_group->thread_list);
-        }
-        kdebug("Scheduler initialized. Create %d idle threads.\n", i);
-
+        init_idle_threads("KNL-IDLE-RR");
         return 0;
 }
 
+u32 rr_sched_queue_len(u32 cpuid)
+{
+        return rr_ready_queue_meta[cpuid].queue_len + rsv_queue_len(cpuid);
+}
+
 #define MAX_CAP_GROUP_BUF 256
 
 void rr_top(void)
@@ -289,4 +445,7 @@ struct sched_ops rr = {.sched_init = rr_sched_init,
                        .sched = rr_sched,
                        .sched_enqueue = rr_sched_enqueue,
                        .sched_dequeue = rr_sched_dequeue,
+                       .sched_balance = rr_sched_balance,
+                       .sched_queue_len = rr_sched_queue_len,
+                       .sched_set_param = rsv_set_param,
                        .sched_top = rr_top};
@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan PSL v1.
+ * You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v1 for more details.
+ */
+
+/*
+ * Reservation (RSV) class, dispatched by the rr policy before its own queue.
+ * A reserved thread gets rsv_budget ticks in every rsv_period ticks on
+ * rsv_cpu, and the ready ones run in the order of their deadlines (EDF).
+ * A thread which has used up its budget is throttled on the timer wheel
+ * until its deadline, where the next period starts.
+ * Reservations are partitioned: each one is admitted to a single CPU as
+ * long as the utilization there stays within RSV_MAX_UTIL, so that EDF
+ * meets all the deadlines and best-effort threads still get the slack.
+ */
+#include <sched/sched.h>
+#include <arch/machine/smp.h>
+#include <common/kprint.h>
+#include <machine.h>
+#include <common/list.h>
+#include <common/util.h>
+#include <common/macro.h>
+#include <common/errno.h>
+#include <common/types.h>
+#include <common/lock.h>
+#include <object/thread.h>
+#include <sched/context.h>
+#include <irq/timer.h>
+#include <irq/ipi.h>
+
+/* Reserved threads ready on one CPU, sorted by deadline */
+struct rsv_queue {
+        struct list_head queue_head;
+        u32 queue_len;
+        /* Admitted utilization, in 1/RSV_UTIL_SCALE */
+        u32 util;
+        struct lock queue_lock;
+} __attribute__((aligned(CACHELINE_SZ)));
+
+struct rsv_queue rsv_queues[PLAT_CPU_NUM];
+
+/* Serializes the admission tests against each other */
+static struct lock rsv_admit_lock;
+
+void rsv_init(void)
+{
+        int i;
+
+        for (i = 0; i < PLAT_CPU_NUM; i++) {
+                init_list_head(&rsv_queues[i].queue_head);
+                rsv_queues[i].queue_len = 0;
+                rsv_queues[i].util = 0;
+                lock_init(&rsv_queues[i].queue_lock);
+        }
+        lock_init(&rsv_admit_lock);
+}
+
+/* In u64, since budget * RSV_UTIL_SCALE overflows u32 for long periods */
+static u32 rsv_util(u32 period, u32 budget)
+{
+        return DIV_ROUND_UP((u64)budget * RSV_UTIL_SCALE, period);
+}
+
+/* Length of @ticks scheduling ticks in ticks of plat_get_current_tick */
+static u64 rsv_ticks_to_cnt(u32 ticks)
+{
+        return (u64)ticks * TICK_MS * 1000 * tick_per_us;
+}
+
+/* Start a new period with a full budget if the deadline has passed */
+static void rsv_replenish(sched_cont_t *sc, u64 now)
+{
+        if (now < sc->rsv_deadline)
+                return;
+        sc->rsv_deadline = now + rsv_ticks_to_cnt(sc->rsv_period);
+        sc->rsv_left = sc->rsv_budget;
+}
+
+/*
+ * Put @thread, which is not running, to sleep until its deadline.
+ * The wheel wakes it at or after the deadline, where it is replenished, so
+ * a thread woken by the wheel is never throttled again.
+ */
+void rsv_throttle(struct thread *thread)
+{
+        timer_sleep_thread(thread, thread->thread_ctx->sc->rsv_deadline);
+}
+
+/*
+ * Put the reserved @thread into the queue of its rsv_cpu by deadline, or
+ * throttle it if the budget of this period is used up.
+ */
+int rsv_sched_enqueue(struct thread *thread)
+{
+        sched_cont_t *sc = thread->thread_ctx->sc;
+        struct rsv_queue *queue;
+        struct thread *pos;
+        u32 cpuid = sc->rsv_cpu;
+
+        rsv_replenish(sc, plat_get_current_tick());
+        if (sc->rsv_left == 0) {
+                rsv_throttle(thread);
+                return 0;
+        }
+
+        queue = &rsv_queues[cpuid];
+        lock(&queue->queue_lock);
+        /* FIFO among the same deadlines */
+        for_each_in_list (
+                pos, struct thread, ready_queue_node, &queue->queue_head) {
+                if (pos->thread_ctx->sc->rsv_deadline > sc->rsv_deadline)
+                        break;
+        }
+        /* Insert before pos, or at the tail if the loop completes */
+        list_append(&thread->ready_queue_node, &pos->ready_queue_node);
+        queue->queue_len++;
+        thread->thread_ctx->cpuid = cpuid;
+        thread->thread_ctx->state = TS_READY;
+        unlock(&queue->queue_lock);
+        sched_stat_enqueue(thread);
+
+        /* A running best-effort thread there has to make room at once */
+        if (cpuid != smp_get_cpu_id())
+                arch_send_ipi(cpuid, IPI_RESCHED);
+        return 0;
+}
+
+int rsv_sched_dequeue(struct thread *thread)
+{
+        struct rsv_queue *queue;
+
+        queue = &rsv_queues[thread->thread_ctx->cpuid];
+        lock(&queue->queue_lock);
+        if (thread->thread_ctx->state != TS_READY) {
+                unlock(&queue->queue_lock);
+                return -1;
+        }
+        list_del(&thread->ready_queue_node);
+        queue->queue_len--;
+        thread->thread_ctx->state = TS_INTER;
+        unlock(&queue->queue_lock);
+        sched_stat_dequeue(thread);
+        return 0;
+}
+
+/* Dequeue the ready thread of the earliest deadline, NULL if there is none */
+struct thread *rsv_sched_choose_thread(u32 cpuid)
+{
+        struct rsv_queue *queue = &rsv_queues[cpuid];
+        struct thread *thread = NULL;
+
+        lock(&queue->queue_lock);
+        if (!list_empty(&queue->queue_head)) {
+                thread = list_entry(queue->queue_head.next,
+                                    struct thread,
+                                    ready_queue_node);
+                list_del(&thread->ready_queue_node);
+                queue->queue_len--;
+                thread->thread_ctx->state = TS_INTER;
+        }
+        unlock(&queue->queue_lock);
+
+        if (thread)
+                sched_stat_dequeue(thread);
+        return thread;
+}
+
+/*
+ * Whether the running @thread has to give @cpuid to a ready reserved
+ * thread: always for a best-effort one, or else by the deadlines.
+ */
+bool rsv_should_preempt(struct thread *thread, u32 cpuid)
+{
+        struct rsv_queue *queue = &rsv_queues[cpuid];
+        sched_cont_t *sc = thread->thread_ctx->sc;
+        struct thread *first;
+        bool ret = false;
+
+        lock(&queue->queue_lock);
+        if (!list_empty(&queue->queue_head)) {
+                first = list_entry(queue->queue_head.next,
+                                   struct thread,
+                                   ready_queue_node);
+                ret = !sched_is_rsv(sc)
+                      || first->thread_ctx->sc->rsv_deadline
+                                 < sc->rsv_deadline;
+        }
+        unlock(&queue->queue_lock);
+        return ret;
+}
+
+/* rsv_admit_lock is held */
+static void __rsv_release(sched_cont_t *sc)
+{
+        if (!sched_is_rsv(sc))
+                return;
+        rsv_queues[sc->rsv_cpu].util -=
+                rsv_util(sc->rsv_period, sc->rsv_budget);
+        sc->rsv_period = 0;
+}
+
+/* The CPU with the least utilization which admits @util more, or -1 */
+static s32 rsv_admit_cpu(sched_cont_t *sc, s32 aff, u32 util)
+{
+        u32 cpuid, used, best_used = RSV_MAX_UTIL;
+        s32 best = -1;
+
+        for (cpuid = 0; cpuid < PLAT_CPU_NUM; cpuid++) {
+                if (aff != NO_AFF && cpuid != (u32)aff)
+                        continue;
+                used = rsv_queues[cpuid].util;
+                /* The old reservation of the thread is replaced */
+                if (sched_is_rsv(sc) && sc->rsv_cpu == cpuid)
+                        used -= rsv_util(sc->rsv_period, sc->rsv_budget);
+                if (used + util <= RSV_MAX_UTIL
+                    && (best < 0 || used < best_used)) {
+                        best = cpuid;
+                        best_used = used;
+                }
+        }
+        return best;
+}
+
+/*
+ * Reserve @budget ticks in every @period ticks for @thread, or make it best
+ * effort again if @period is 0. The reservation goes to the CPU of its
+ * affinity, or to the least utilized one if it is NO_AFF.
+ * Returns -EBUSY if no CPU admits it, and the old parameters are kept.
+ */
+int rsv_set_param(struct thread *thread, u32 period, u32 budget)
+{
+        sched_cont_t *sc = thread->thread_ctx->sc;
+        s32 aff = thread->thread_ctx->affinity;
+        bool ready;
+        s32 cpuid = 0;
+
+        if (!sc)
+                return -EINVAL;
+
+        lock(&rsv_admit_lock);
+        if (period != 0) {
+                cpuid = rsv_admit_cpu(sc, aff, rsv_util(period, budget));
+                if (cpuid < 0) {
+                        unlock(&rsv_admit_lock);
+                        return -EBUSY;
+                }
+        }
+
+        /* Move a ready thread to the queue of its new class */
+        ready = thread->thread_ctx->state == TS_READY;
+        if (ready)
+                BUG_ON(cur_sched_ops->sched_dequeue(thread));
+
+        __rsv_release(sc);
+        sc->rsv_period = period;
+        sc->rsv_budget = budget;
+        if (period != 0) {
+                sc->rsv_cpu = cpuid;
+                rsv_queues[cpuid].util += rsv_util(period, budget);
+                /* The first period starts at the next enqueue */
+                sc->rsv_deadline = 0;
+                sc->rsv_left = 0;
+        }
+        unlock(&rsv_admit_lock);
+
+        if (ready)
+                BUG_ON(cur_sched_ops->sched_enqueue(thread));
+        return 0;
+}
+
+/* Give back the utilization of a reservation, e.g., when its thread exits */
+void rsv_release(sched_cont_t *sc)
+{
+        lock(&rsv_admit_lock);
+        __rsv_release(sc);
+        unlock(&rsv_admit_lock);
+}
+
+u32 rsv_queue_len(u32 cpuid)
+{
+        return rsv_queues[cpuid].queue_len;
+}
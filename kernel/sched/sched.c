@@ -16,6 +16,7 @@
 #include <common/kprint.h>
 #include <machine.h>
 #include <mm/kmalloc.h>
+#include <mm/slab.h>
 #include <common/list.h>
 #include <common/util.h>
 #include <object/thread.h>
@@ -24,9 +25,21 @@
 #include <object/thread.h>
 #include <irq/irq.h>
 #include <sched/context.h>
+#include <irq/timer.h>
+#include <mm/uaccess.h>
+#include <sched/trace.h>
 
 struct thread *current_threads[PLAT_CPU_NUM];
 
+/* in arch/sched/idle.S */
+void idle_thread_routine(void);
+
+/*
+ * Idle threads, one per core, shared by all the policies.
+ * Idle thread will **NOT** be in the RQ.
+ */
+struct thread idle_threads[PLAT_CPU_NUM];
+
 /* Chosen Scheduling Policies */
 struct sched_ops *cur_sched_ops;
 
@@ -98,6 +111,7 @@ int switch_to_thread(struct thread *target)
                 return 0;
         }
 
+        sched_trace(SCHED_TRACE_SWITCH, target, (u64)current_thread);
         target->thread_ctx->cpuid = smp_get_cpu_id();
         target->thread_ctx->state = TS_RUNNING;
         /* Record the thread transferring the CPU */
@@ -129,6 +143,87 @@ void sched_to_thread(struct thread *target)
         /* The control flow will never return back. */
 }
 
+/*
+ * The CPU to enqueue @thread on, whose affinity is NO_AFF: its wake_cpu if
+ * set (wake-affine), or else the current CPU.
+ */
+u32 sched_pick_cpu(struct thread *thread)
+{
+        s32 cpuid = thread->thread_ctx->wake_cpu;
+
+        if (cpuid != NO_AFF && cpuid < PLAT_CPU_NUM)
+                return cpuid;
+        return smp_get_cpu_id();
+}
+
+/* The thread charged for the time on each CPU, and since when */
+static struct thread *oncpu_threads[PLAT_CPU_NUM];
+static u64 oncpu_since[PLAT_CPU_NUM];
+
+/* Called by the policies when @thread is put into a ready queue */
+void sched_stat_enqueue(struct thread *thread)
+{
+        thread->thread_ctx->stat.enqueue_cnt++;
+        thread->thread_ctx->ready_tick = plat_get_current_tick();
+        sched_trace(SCHED_TRACE_ENQUEUE, thread, thread->thread_ctx->cpuid);
+}
+
+/* Called by the policies when @thread is removed from a ready queue */
+void sched_stat_dequeue(struct thread *thread)
+{
+        thread->thread_ctx->stat.dequeue_cnt++;
+        sched_trace(SCHED_TRACE_DEQUEUE, thread, thread->thread_ctx->cpuid);
+}
+
+/*
+ * Charge the time on the current CPU since the last charge to the thread
+ * there, which is also passed to the policy.
+ */
+void sched_charge_oncpu(void)
+{
+        u32 cpuid = smp_get_cpu_id();
+        struct thread *thread = oncpu_threads[cpuid];
+        u64 now, delta;
+
+        now = plat_get_current_tick();
+        delta = now - oncpu_since[cpuid];
+        oncpu_since[cpuid] = now;
+        if (!thread)
+                return;
+
+        thread->thread_ctx->stat.oncpu_ticks += delta;
+        if (cur_sched_ops->sched_charge)
+                cur_sched_ops->sched_charge(thread, delta);
+}
+
+/*
+ * Charge the time on CPU to the thread switched out, and account the
+ * switch and the wakeup latency of @target switched in.
+ */
+static void sched_stat_switch(struct thread *target)
+{
+        u32 cpuid = smp_get_cpu_id();
+        struct sched_stat *stat = &target->thread_ctx->stat;
+        u64 now, lat;
+
+        if (oncpu_threads[cpuid] == target)
+                return;
+
+        sched_charge_oncpu();
+        now = oncpu_since[cpuid];
+        oncpu_threads[cpuid] = target;
+
+        stat->switch_cnt++;
+        if (target->thread_ctx->ready_tick) {
+                lat = now - target->thread_ctx->ready_tick;
+                stat->wakeup_cnt++;
+                stat->wakeup_lat_ticks += lat;
+                if (lat > stat->wakeup_lat_max)
+                        stat->wakeup_lat_max = lat;
+                target->thread_ctx->ready_tick = 0;
+        }
+}
+
 /*
  * Switch vmspace and arch-related stuff
  * Return the context pointer which should be set to stack pointer register
@@ -147,6 +242,9 @@ u64 switch_context(void)
         if (target_thread->prev_thread == THREAD_ITSELF)
                 return (u64)target_ctx;
 
+        sched_stat_switch(target_thread);
+        tick_sched_switch(target_thread);
+
         /* TYPE_TESTS threads do not have vmspace. */
         if (target_thread->thread_ctx->type != TYPE_TESTS) {
                 BUG_ON(!target_thread->vmspace);
@@ -162,10 +260,28 @@ u64 switch_context(void)
  * handle timer irq
  * Hints: Should check current_thread and its sc first
  */
+static u32 balance_ticks[PLAT_CPU_NUM];
+
 void sched_handle_timer_irq(void)
 {
-        if (current_thread && current_thread->thread_ctx->sc->budget > 0) {
-                --current_thread->thread_ctx->sc->budget;
+        u32 cpuid = smp_get_cpu_id();
+        sched_cont_t *sc;
+
+        sched_trace(SCHED_TRACE_TIMER, current_thread, 0);
+        if (current_thread) {
+                sc = current_thread->thread_ctx->sc;
+                if (sc->budget > 0)
+                        --sc->budget;
+                /* Charge the reservation, sched() throttles it at 0 */
+                if (sched_is_rsv(sc) && sc->rsv_left > 0)
+                        --sc->rsv_left;
+        }
+
+        /* Rebalance the ready queues every SCHED_BALANCE_TICKS */
+        if (cur_sched_ops->sched_balance
+            && ++balance_ticks[cpuid] >= SCHED_BALANCE_TICKS) {
+                balance_ticks[cpuid] = 0;
+                cur_sched_ops->sched_balance();
         }
 }
 
@@ -181,6 +297,166 @@ void sys_yield(void)
 void sys_top(void)
 {
         cur_sched_ops->sched_top();
+        kmem_cache_report();
+}
+
+/*
+ * Create the idle threads, called by the sched_init of a policy.
+ * @name is the name of the fake cap group holding them.
+ */
+void init_idle_threads(const char *name)
+{
+        int i = 0;
+        int name_len = strlen(name);
+
+        struct cap_group *idle_cap_group;
+        struct vmspace *idle_vmspace;
+
+        /* Create a fake idle cap group to store the name */
+        idle_cap_group = kzalloc(sizeof(*idle_cap_group));
+        memset(idle_cap_group->cap_group_name, 0, MAX_GROUP_NAME_LEN);
+        if (name_len > MAX_GROUP_NAME_LEN)
+                name_len = MAX_GROUP_NAME_LEN;
+        memcpy(idle_cap_group->cap_group_name, name, name_len);
+        init_list_head(&idle_cap_group->thread_list);
+
+        extern struct vmspace *create_idle_vmspace(void);
+        idle_vmspace = create_idle_vmspace();
+
+        /* Initialize one idle thread for each core */
+        for (i = 0; i < PLAT_CPU_NUM; i++) {
+                /* Set the thread context of the idle threads */
+                BUG_ON(!(idle_threads[i].thread_ctx =
+                                 create_thread_ctx(TYPE_IDLE)));
+                /* We will set the stack and func ptr in arch_idle_ctx_init */
+                init_thread_ctx(&idle_threads[i], 0, 0, MIN_PRIO, TYPE_IDLE, i);
+                /* Call arch-dependent function to fill the context of the idle
+                 * threads */
+                arch_idle_ctx_init(idle_threads[i].thread_ctx,
+                                   idle_thread_routine);
+
+                idle_threads[i].cap_group = idle_cap_group;
+                idle_threads[i].vmspace = idle_vmspace;
+
+                /* Add idle_threads to the threads list */
+                list_add(&idle_threads[i].node, &idle_cap_group->thread_list);
+        }
+        kdebug("Scheduler initialized. Create %d idle threads.\n", i);
+}
+
+/*
+ * Get a snapshot of the scheduling statistics of a thread, together with
+ * the length of each ready queue.
+ * thread_cap can be SCHED_STAT_SELF for the calling thread.
+ */
+int sys_get_sched_stat(u64 thread_cap, u64 snapshot_ptr)
+{
+        struct sched_snapshot snapshot = {0};
+        struct thread *thread;
+        struct thread_ctx *ctx;
+        u32 cpuid;
+        int r;
+
+        if ((s64)thread_cap == SCHED_STAT_SELF) {
+                thread = current_thread;
+        } else {
+                thread = obj_get(current_cap_group, thread_cap, TYPE_THREAD);
+                if (!thread)
+                        return -ECAPBILITY;
+        }
+
+        ctx = thread->thread_ctx;
+        snapshot.cpuid = ctx->cpuid;
+        snapshot.state = ctx->state;
+        snapshot.prio = ctx->prio;
+        snapshot.affinity = ctx->affinity;
+        snapshot.stat = ctx->stat;
+        /* The thread running now has not been charged yet */
+        cpuid = smp_get_cpu_id();
+        if (thread == current_thread && oncpu_threads[cpuid] == thread)
+                snapshot.stat.oncpu_ticks +=
+                        plat_get_current_tick() - oncpu_since[cpuid];
+
+        snapshot.cpu_num = MIN(PLAT_CPU_NUM, SCHED_STAT_MAX_CPU);
+        if (cur_sched_ops->sched_queue_len) {
+                for (cpuid = 0; cpuid < snapshot.cpu_num; cpuid++)
+                        snapshot.queue_len[cpuid] =
+                                cur_sched_ops->sched_queue_len(cpuid);
+        }
+
+        if (thread != current_thread)
+                obj_put(thread);
+
+        r = copy_to_user(
+                (char *)snapshot_ptr, (char *)&snapshot, sizeof(snapshot));
+        return r < 0 ? r : 0;
+}
+
+/*
+ * Reserve budget_ms in every period_ms for a thread (thread_cap -1 for the
+ * calling one), or make it best effort again if period_ms is 0. Both are
+ * rounded to scheduling ticks of TICK_MS, the budget upwards.
+ * As with raising a weight, only the root process may reserve CPU time.
+ * Returns -EBUSY if the reservation is not admitted.
+ */
+int sys_set_sched_param(u64 thread_cap, u64 param_ptr)
+{
+        struct sched_rsv_param param;
+        struct thread *thread;
+        u32 period, budget;
+        int r;
+
+        if (!cur_sched_ops->sched_set_param)
+                return -ENOSYS;
+
+        r = copy_from_user((char *)&param, (char *)param_ptr, sizeof(param));
+        if (r < 0)
+                return r;
+
+        period = param.period_ms / TICK_MS;
+        budget = DIV_ROUND_UP((u64)param.budget_ms, TICK_MS);
+        if (param.period_ms != 0 && (period == 0 || budget == 0
+                                     || budget > period))
+                return -EINVAL;
+        if (param.period_ms != 0 && current_cap_group->pid != ROOT_PID)
+                return -EPERM;
+
+        if (thread_cap == -1) {
+                thread = current_thread;
+        } else {
+                thread = obj_get(current_cap_group, thread_cap, TYPE_THREAD);
+                if (!thread)
+                        return -ECAPBILITY;
+        }
+
+        r = cur_sched_ops->sched_set_param(thread, period, budget);
+        if (thread_cap != -1)
+                obj_put(thread);
+        return r;
+}
+
+/*
+ * Set the weight of a cap_group under the fair policy, SCHED_WEIGHT_DEFAULT
+ * by default. Only the root process may raise a weight above the default,
+ * so that a group cannot take more than its share by itself.
+ */
+int sys_set_cap_group_weight(u64 cap_group_cap, u32 weight)
+{
+        struct cap_group *cap_group;
+
+        if (weight == 0 || weight > SCHED_WEIGHT_MAX)
+                return -EINVAL;
+        if (weight > SCHED_WEIGHT_DEFAULT && current_cap_group->pid != ROOT_PID)
+                return -EPERM;
+
+        cap_group = obj_get(current_cap_group, cap_group_cap, TYPE_CAP_GROUP);
+        if (!cap_group)
+                return -ECAPBILITY;
+
+        /* Applies to the time charged from now on */
+        cap_group->sched_weight = weight;
+        obj_put(cap_group);
+        return 0;
 }
 
 int sched_init(struct sched_ops *sched_ops)
@@ -189,5 +465,6 @@ int sched_init(struct sched_ops *sched_ops)
 
         cur_sched_ops = sched_ops;
         cur_sched_ops->sched_init();
+        sched_trace_init();
         return 0;
 }
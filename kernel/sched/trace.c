@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan PSL v1.
+ * You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v1 for more details.
+ */
+
+/*
+ * Per-CPU rings of scheduler events.
+ *
+ * Each ring is written only by its CPU with irqs off, so recording takes
+ * no lock: the writer bumps reserve, fills the slot, and then bumps head
+ * to publish it. The drainer reads a slot below head and then checks
+ * reserve, so that a slot being overwritten meanwhile is detected and
+ * counted as lost rather than returned torn. Old events are overwritten
+ * when the drainer falls behind.
+ */
+#include <sched/trace.h>
+#include <sched/sched.h>
+#include <arch/machine/smp.h>
+#include <arch/sync.h>
+#include <common/lock.h>
+#include <common/errno.h>
+#include <irq/timer.h>
+#include <mm/uaccess.h>
+#include <object/thread.h>
+
+#define SCHED_TRACE_MASK (SCHED_TRACE_ENTRIES - 1)
+/* Events copied to the user at a time */
+#define SCHED_TRACE_BATCH 64
+
+struct sched_trace_ring {
+        /* Events published */
+        volatile u64 head;
+        /* Events started, head or head + 1 */
+        volatile u64 reserve;
+        /* Next event to drain, written by the drainer only */
+        u64 tail;
+        struct sched_trace_event events[SCHED_TRACE_ENTRIES];
+} __attribute__((aligned(CACHELINE_SZ)));
+
+bool sched_trace_enabled __attribute__((aligned(CACHELINE_SZ)));
+
+static struct sched_trace_ring sched_trace_rings[PLAT_CPU_NUM];
+
+/* Serializes the drainers, and the buffer they copy through */
+static struct lock sched_trace_lock;
+static struct sched_trace_event sched_trace_buf[SCHED_TRACE_BATCH];
+
+void __sched_trace(u32 type, struct thread *thread, u64 arg)
+{
+        u32 cpuid = smp_get_cpu_id();
+        struct sched_trace_ring *ring = &sched_trace_rings[cpuid];
+        struct sched_trace_event *event;
+        u64 head = ring->head;
+
+        ring->reserve = head + 1;
+        smp_wmb();
+
+        event = &ring->events[head & SCHED_TRACE_MASK];
+        event->ts = plat_get_current_tick();
+        event->thread = (u64)thread;
+        event->arg = arg;
+        event->type = type;
+        event->cpuid = cpuid;
+
+        smp_wmb();
+        ring->head = head + 1;
+}
+
+/*
+ * Copy the oldest event of @ring not drained yet to @event, without
+ * consuming it. Events overwritten before that are skipped and added to
+ * @lost. Returns false if the ring is empty.
+ */
+static bool sched_trace_peek(struct sched_trace_ring *ring,
+                             struct sched_trace_event *event, u64 *lost)
+{
+        u64 head;
+
+        while (true) {
+                head = ring->head;
+                smp_rmb();
+                if (head - ring->tail > SCHED_TRACE_ENTRIES) {
+                        *lost += head - SCHED_TRACE_ENTRIES - ring->tail;
+                        ring->tail = head - SCHED_TRACE_ENTRIES;
+                }
+                if (ring->tail == head)
+                        return false;
+
+                *event = ring->events[ring->tail & SCHED_TRACE_MASK];
+                smp_rmb();
+                /* The slot is reused once reserve passes a ring ahead */
+                if (ring->reserve - ring->tail <= SCHED_TRACE_ENTRIES)
+                        return true;
+                ring->tail++;
+                (*lost)++;
+        }
+}
+
+/*
+ * Enable or disable tracing, or drop the events recorded so far.
+ * Events of a CPU may still be recorded for a while after it is disabled.
+ */
+int sys_sched_trace_ctl(u32 op)
+{
+        int i;
+
+        switch (op) {
+        case SCHED_TRACE_OFF:
+        case SCHED_TRACE_ON:
+                sched_trace_enabled = op == SCHED_TRACE_ON;
+                smp_mb();
+                return 0;
+        case SCHED_TRACE_RESET:
+                lock(&sched_trace_lock);
+                for (i = 0; i < PLAT_CPU_NUM; i++)
+                        sched_trace_rings[i].tail = sched_trace_rings[i].head;
+                unlock(&sched_trace_lock);
+                return 0;
+        default:
+                return -EINVAL;
+        }
+}
+
+/* Copy the n events in the buffer to the user after the done ones */
+static int sched_trace_flush(u64 events_ptr, u64 done, u64 n)
+{
+        return copy_to_user(
+                (char *)(events_ptr + done * sizeof(struct sched_trace_event)),
+                (char *)sched_trace_buf,
+                n * sizeof(struct sched_trace_event));
+}
+
+/*
+ * Move at most @count events of all the CPUs, merged in time order, to the
+ * array at @events_ptr. The number of events overwritten before being
+ * drained is stored at @lost_ptr if it is not 0.
+ * Returns the number of events moved.
+ */
+int sys_sched_trace_drain(u64 events_ptr, u64 count, u64 lost_ptr)
+{
+        struct sched_trace_event pending[PLAT_CPU_NUM];
+        u64 done = 0, lost = 0, n = 0;
+        int i, oldest, r = 0;
+
+        lock(&sched_trace_lock);
+        while (done + n < count) {
+                oldest = -1;
+                for (i = 0; i < PLAT_CPU_NUM; i++) {
+                        if (!sched_trace_peek(
+                                    &sched_trace_rings[i], &pending[i], &lost))
+                                continue;
+                        if (oldest < 0 || pending[i].ts < pending[oldest].ts)
+                                oldest = i;
+                }
+                if (oldest < 0)
+                        break;
+
+                sched_trace_buf[n++] = pending[oldest];
+                sched_trace_rings[oldest].tail++;
+                if (n == SCHED_TRACE_BATCH) {
+                        r = sched_trace_flush(events_ptr, done, n);
+                        if (r < 0)
+                                goto out_unlock;
+                        done += n;
+                        n = 0;
+                }
+        }
+        if (n) {
+                r = sched_trace_flush(events_ptr, done, n);
+                if (r < 0)
+                        goto out_unlock;
+                done += n;
+        }
+
+        if (lost_ptr)
+                r = copy_to_user((char *)lost_ptr, (char *)&lost, sizeof(lost));
+out_unlock:
+        unlock(&sched_trace_lock);
+        return r < 0 ? r : done;
+}
+
+void sched_trace_init(void)
+{
+        lock_init(&sched_trace_lock);
+}
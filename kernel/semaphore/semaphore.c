@@ -15,6 +15,7 @@
 #include <object/thread.h>
 #include <sched/context.h>
 #include <irq/irq.h>
+#include <sched/trace.h>
 
 void init_sem(struct semaphore *sem)
 {
@@ -72,6 +73,7 @@ s32 signal_sem(struct semaphore *sem)
         }
         if (target) {
                 BUG_ON(!target->thread_ctx->sc);
+                sched_trace(SCHED_TRACE_WAKEUP, target, (u64)current_thread);
                 target->thread_ctx->state = TS_INTER;
                 BUG_ON(sched_enqueue(target));
         }
@@ -21,6 +21,7 @@
 #include <object/cap_group.h>
 #include <object/object.h>
 #include <sched/sched.h>
+#include <sched/trace.h>
 #include <ipc/connection.h>
 #include <irq/timer.h>
 #include <irq/irq.h>
@@ -97,6 +98,7 @@ const void *syscall_table[NR_SYSCALL] = {
         [SYS_unmap_pmo] = sys_unmap_pmo,
         [SYS_write_pmo] = sys_write_pmo,
         [SYS_read_pmo] = sys_read_pmo,
+        [SYS_get_pmo_size] = sys_get_pmo_size,
         /* - batch */
         [SYS_create_pmos] = sys_create_pmos,
         [SYS_map_pmos] = sys_map_pmos,
@@ -108,6 +110,7 @@ const void *syscall_table[NR_SYSCALL] = {
         [SYS_cap_copy_to] = sys_cap_copy_to,
         [SYS_cap_copy_from] = sys_cap_copy_from,
         [SYS_transfer_caps] = sys_transfer_caps,
+        [SYS_cap_free] = sys_cap_free,
 
         /* Multitask */
         /* - create & exit */
@@ -119,6 +122,8 @@ const void *syscall_table[NR_SYSCALL] = {
         [SYS_set_affinity] = sys_set_affinity,
         [SYS_get_affinity] = sys_get_affinity,
         [SYS_get_cpu_id] = sys_get_cpu_id,
+        [SYS_set_sched_param] = sys_set_sched_param,
+        [SYS_set_cap_group_weight] = sys_set_cap_group_weight,
 
         /* IPC */
         /* - procedure call */
@@ -126,6 +131,13 @@ const void *syscall_table[NR_SYSCALL] = {
         [SYS_register_client] = sys_register_client,
         [SYS_ipc_call] = sys_ipc_call,
         [SYS_ipc_return] = sys_ipc_return,
+        /* - register-only procedure call */
+        [SYS_ipc_call_regs] = sys_ipc_call_regs,
+        [SYS_ipc_return_regs] = sys_ipc_return_regs,
+        /* - batched procedure call */
+        [SYS_ipc_call_batch] = sys_ipc_call_batch,
+        /* - connection */
+        [SYS_ipc_close_connection] = sys_ipc_close_connection,
 
         /* Hardware Access (Privileged Instruction) */
         /* - cache */
@@ -136,6 +148,8 @@ const void *syscall_table[NR_SYSCALL] = {
         /* POSIX */
         /* - time */
         [SYS_clock_gettime] = sys_clock_gettime,
+        [SYS_clock_nanosleep] = sys_clock_nanosleep,
+        [SYS_nanosleep] = sys_nanosleep,
         /* - memory */
         [SYS_handle_brk] = sys_handle_brk,
         [SYS_handle_mmap] = sys_handle_mmap,
@@ -144,6 +158,9 @@ const void *syscall_table[NR_SYSCALL] = {
         /* Debug */
         [SYS_top] = sys_top,
         [SYS_get_free_mem_size] = sys_get_free_mem_size,
+        [SYS_get_sched_stat] = sys_get_sched_stat,
+        [SYS_sched_trace_ctl] = sys_sched_trace_ctl,
+        [SYS_sched_trace_drain] = sys_sched_trace_drain,
 
         /* Performance Benchmark */
         [SYS_perf_start] = sys_perf_start,
@@ -26,6 +26,7 @@
 #define SYS_unmap_pmo         13
 #define SYS_write_pmo         14
 #define SYS_read_pmo          15
+#define SYS_get_pmo_size      16
 /* - batch */
 #define SYS_create_pmos 20
 #define SYS_map_pmos    21
@@ -37,6 +38,7 @@
 #define SYS_cap_copy_to   60
 #define SYS_cap_copy_from 61
 #define SYS_transfer_caps 62
+#define SYS_cap_free      63
 
 /* Multitask */
 /* - create & exit */
@@ -44,10 +46,12 @@
 #define SYS_create_thread    82
 #define SYS_thread_exit      83
 /* - schedule */
-#define SYS_yield        100
-#define SYS_set_affinity 101
-#define SYS_get_affinity 102
-#define SYS_get_cpu_id   103
+#define SYS_yield                100
+#define SYS_set_affinity         101
+#define SYS_get_affinity         102
+#define SYS_get_cpu_id           103
+#define SYS_set_sched_param      104
+#define SYS_set_cap_group_weight 105
 
 /* IPC */
 /* - procedure call */
@@ -55,6 +59,12 @@
 #define SYS_register_client 121
 #define SYS_ipc_call        122
 #define SYS_ipc_return      123
+#define SYS_ipc_call_regs   124
+#define SYS_ipc_return_regs 125
+/* - batched procedure call */
+#define SYS_ipc_call_batch 126
+/* - connection */
+#define SYS_ipc_close_connection 127
 
 /* Hardware Access (Privileged Instruction) */
 /* - cache */
@@ -64,7 +74,9 @@
 
 /* POSIX */
 /* - time */
-#define SYS_clock_gettime 200
+#define SYS_clock_gettime   200
+#define SYS_clock_nanosleep 201
+#define SYS_nanosleep       202
 /* - memory */
 #define SYS_handle_brk    210
 #define SYS_handle_mmap   211
@@ -73,6 +85,9 @@
 /* Debug */
 #define SYS_top               221
 #define SYS_get_free_mem_size 222
+#define SYS_get_sched_stat    223
+#define SYS_sched_trace_ctl   224
+#define SYS_sched_trace_drain 225
 
 /* Performance Benchmark */
 #define SYS_perf_start 230
@@ -37,4 +37,6 @@ void run_test(void)
         tst_sched_preemptive();
         tst_sched_affinity();
         tst_sched();
+        tst_buddy_bench();
+        tst_cap();
 }
@@ -20,4 +20,6 @@ void tst_sched_preemptive(void);
 void tst_sched_affinity(void);
 void tst_sched(void);
 void tst_malloc(void);
+void tst_buddy_bench(void);
+void tst_cap(void);
 void tst_sched(void);
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan PSL v1.
+ * You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v1 for more details.
+ */
+
+/*
+ * Microbenchmark of the buddy allocator, run by CPU 0 only.
+ *
+ * The free-order lookup and the pool lookup of virt_to_page are compared
+ * against copies of the former linear scans (legacy_*), and alloc/free
+ * pairs are timed for each order on the pool as it is after boot.
+ * Results are in cycles of the PMU cycle counter per operation.
+ */
+#include <common/kprint.h>
+#include <common/macro.h>
+#include <common/bitops.h>
+#include <arch/machine/smp.h>
+#include <arch/time.h>
+#include <mm/buddy.h>
+
+#include "tests.h"
+#include "barrier.h"
+
+#define BUDDY_BENCH_ROUND 4096
+
+/* Keeps the lookups in the loops from being optimized out */
+static volatile u64 bench_sink;
+
+/* The free-order lookup before the order bitmap */
+static u64 legacy_find_order(struct phys_mem_pool *pool, u64 order)
+{
+        while (order < BUDDY_MAX_ORDER) {
+                if (pool->free_lists[order].nr_free > 0)
+                        break;
+                ++order;
+        }
+        return order;
+}
+
+static u64 bitmap_find_order(struct phys_mem_pool *pool, u64 order)
+{
+        unsigned long avail = pool->order_bmp & ~((1UL << order) - 1);
+
+        return avail ? ctzl(avail) : BUDDY_MAX_ORDER;
+}
+
+/* The pool lookup of virt_to_page before the section table */
+static struct phys_mem_pool *legacy_find_pool(void *ptr)
+{
+        u64 addr = (u64)ptr;
+        int i;
+
+        for (i = 0; i < physmem_map_num; ++i) {
+                if (addr >= global_mem[i].pool_start_addr
+                    && addr < global_mem[i].pool_start_addr
+                                       + global_mem[i].pool_mem_size)
+                        return &global_mem[i];
+        }
+        return NULL;
+}
+
+static void bench_find_order(struct phys_mem_pool *pool, u64 order)
+{
+        u64 start, legacy, bitmap;
+        int i;
+
+        start = get_cycles();
+        for (i = 0; i < BUDDY_BENCH_ROUND; i++)
+                bench_sink = legacy_find_order(pool, order);
+        legacy = get_cycles() - start;
+
+        start = get_cycles();
+        for (i = 0; i < BUDDY_BENCH_ROUND; i++)
+                bench_sink = bitmap_find_order(pool, order);
+        bitmap = get_cycles() - start;
+
+        BUG_ON(legacy_find_order(pool, order)
+               != bitmap_find_order(pool, order));
+        kinfo("[TEST] buddy find order %lu: linear %lu, bitmap %lu\n",
+              order,
+              legacy / BUDDY_BENCH_ROUND,
+              bitmap / BUDDY_BENCH_ROUND);
+}
+
+static void bench_find_pool(struct phys_mem_pool *pool)
+{
+        u64 start, legacy, table;
+        void *addr;
+        int i;
+
+        addr = (void *)(pool->pool_start_addr + pool->pool_mem_size / 2);
+
+        start = get_cycles();
+        for (i = 0; i < BUDDY_BENCH_ROUND; i++)
+                bench_sink = (u64)legacy_find_pool(addr);
+        legacy = get_cycles() - start;
+
+        start = get_cycles();
+        for (i = 0; i < BUDDY_BENCH_ROUND; i++)
+                bench_sink = (u64)virt_to_page(addr);
+        table = get_cycles() - start;
+
+        BUG_ON(virt_to_page(addr)->pool != legacy_find_pool(addr));
+        kinfo("[TEST] buddy virt_to_page: scan %lu, section table %lu\n",
+              legacy / BUDDY_BENCH_ROUND,
+              table / BUDDY_BENCH_ROUND);
+}
+
+/* Each pair splits down from and merges back to the lowest free order */
+static void bench_alloc_free(struct phys_mem_pool *pool, u64 order)
+{
+        struct page *page;
+        u64 start, cycles;
+        int i;
+
+        start = get_cycles();
+        for (i = 0; i < BUDDY_BENCH_ROUND; i++) {
+                page = buddy_get_pages(pool, order);
+                BUG_ON(page == NULL);
+                buddy_free_pages(pool, page);
+        }
+        cycles = get_cycles() - start;
+
+        kinfo("[TEST] buddy alloc/free order %lu: %lu\n",
+              order,
+              cycles / BUDDY_BENCH_ROUND);
+}
+
+void tst_buddy_bench(void)
+{
+        struct phys_mem_pool *pool = &global_mem[0];
+        u64 order;
+
+        global_barrier();
+        if (smp_get_cpu_id() == 0) {
+                bench_find_order(pool, 0);
+                bench_find_order(pool, BUDDY_MAX_ORDER - 1);
+                bench_find_pool(pool);
+                for (order = 0; order < BUDDY_MAX_ORDER; order += 4)
+                        bench_alloc_free(pool, order);
+                kinfo("[TEST] buddy bench finished\n");
+        }
+        global_barrier();
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan PSL v1.
+ * You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v1 for more details.
+ */
+
+/*
+ * Capability copy/free test, run by CPU 0 only.
+ *
+ * Caps are copied between two cap_groups by cap_copy, cap_copy_n and
+ * cap_move, and every copy is freed again. All the slots are given back to
+ * the object_slot cache, so a slot allocated anywhere else would panic in
+ * kmem_cache_free. Enough rounds are run to cycle the per-CPU magazines.
+ */
+#include <common/kprint.h>
+#include <common/macro.h>
+#include <common/errno.h>
+#include <arch/machine/smp.h>
+#include <object/object.h>
+#include <object/cap_group.h>
+#include <semaphore/semaphore.h>
+
+#include "tests.h"
+#include "barrier.h"
+
+#define CAP_TEST_ROUND 256
+
+extern int cap_group_init(struct cap_group *cap_group, unsigned int size,
+                          u64 pid);
+extern void cap_group_deinit(void *ptr);
+
+static struct cap_group *tst_cap_group_create(u64 pid)
+{
+        struct cap_group *cap_group;
+
+        cap_group = obj_alloc(TYPE_CAP_GROUP, sizeof(*cap_group));
+        BUG_ON(!cap_group);
+        cap_group_init(cap_group, BASE_OBJECT_NUM, pid);
+        return cap_group;
+}
+
+static void tst_cap_group_destroy(struct cap_group *cap_group)
+{
+        cap_group_deinit(cap_group);
+        obj_free(cap_group);
+}
+
+/* Slot id of the only cap of @object in @cap_group, -1 if there is none */
+static int tst_find_slot(struct cap_group *cap_group, struct object *object)
+{
+        struct object_slot *slot;
+        int i;
+
+        for (i = 0; i < cap_group->slot_table.slots_size; i++) {
+                slot = get_slot(cap_group, i);
+                if (slot && slot->object == object)
+                        return i;
+        }
+        return -1;
+}
+
+static void tst_cap_copy_free(struct cap_group *src, struct cap_group *dest)
+{
+        struct semaphore *sem;
+        struct object *object;
+        int src_id, dest_id, moved_id, r;
+
+        sem = obj_alloc(TYPE_SEMAPHORE, sizeof(*sem));
+        BUG_ON(!sem);
+        src_id = cap_alloc(src, sem, 0);
+        BUG_ON(src_id < 0);
+        object = get_slot(src, src_id)->object;
+
+        /* A copied cap is freed alone */
+        dest_id = cap_copy(src, dest, src_id);
+        BUG_ON(dest_id < 0);
+        BUG_ON(get_slot(dest, dest_id)->object != object);
+        BUG_ON(cap_free(dest, dest_id) != 0);
+        BUG_ON(get_slot(dest, dest_id) != NULL);
+
+        /* A moved cap leaves the source, and the copy is the only one */
+        r = cap_move(src, dest, src_id);
+        BUG_ON(r != 0);
+        BUG_ON(get_slot(src, src_id) != NULL);
+        moved_id = tst_find_slot(dest, object);
+        BUG_ON(moved_id < 0);
+
+        /* Copies in bulk are freed together with the object */
+        BUG_ON(cap_copy_n(dest, src, &moved_id, &src_id, 1) != 0);
+        BUG_ON(cap_free_all(dest, moved_id) != 0);
+        BUG_ON(get_slot(src, src_id) != NULL);
+        BUG_ON(get_slot(dest, moved_id) != NULL);
+}
+
+void tst_cap(void)
+{
+        struct cap_group *src, *dest;
+        int i;
+
+        global_barrier();
+        if (smp_get_cpu_id() == 0) {
+                src = tst_cap_group_create(2);
+                dest = tst_cap_group_create(3);
+                for (i = 0; i < CAP_TEST_ROUND; i++)
+                        tst_cap_copy_free(src, dest);
+                tst_cap_group_destroy(src);
+                tst_cap_group_destroy(dest);
+                kinfo("Pass tst_cap!\n");
+        }
+        global_barrier();
+}
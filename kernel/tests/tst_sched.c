@@ -26,7 +26,9 @@
 struct queue_meta {
         struct list_head queue_head;
         u32 queue_len;
-        char pad[pad_to_cache_line(sizeof(u32) + sizeof(struct list_head))];
+        struct lock queue_lock;
+        char pad[pad_to_cache_line(sizeof(u32) + sizeof(struct list_head)
+                                   + sizeof(struct lock))];
 };
 
 extern struct thread *rr_sched_choose_thread(void);
@@ -24,3 +24,7 @@
 
 #define MEM_AUTO_ALLOC_REGION      0x300000000000UL
 #define MEM_AUTO_ALLOC_REGION_SIZE 0x100000000000UL
+
+/* Arena of malloc_huge, aligned to HUGE_PAGE_SIZE */
+#define MALLOC_HUGE_BASE 0x200000000000UL
+#define MALLOC_HUGE_SIZE 0x10000000UL
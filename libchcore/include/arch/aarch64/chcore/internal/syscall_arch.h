@@ -87,3 +87,59 @@ static inline long __chcore_syscall6(long n, long a, long b, long c, long d,
         __asm_syscall(
                 "r"(x8), "0"(x0), "r"(x1), "r"(x2), "r"(x3), "r"(x4), "r"(x5));
 }
+
+static inline long __chcore_syscall7(long n, long a, long b, long c, long d,
+                                     long e, long f, long g)
+{
+        register long x8 __asm__("x8") = n;
+        register long x0 __asm__("x0") = a;
+        register long x1 __asm__("x1") = b;
+        register long x2 __asm__("x2") = c;
+        register long x3 __asm__("x3") = d;
+        register long x4 __asm__("x4") = e;
+        register long x5 __asm__("x5") = f;
+        register long x6 __asm__("x6") = g;
+        __asm_syscall("r"(x8),
+                      "0"(x0),
+                      "r"(x1),
+                      "r"(x2),
+                      "r"(x3),
+                      "r"(x4),
+                      "r"(x5),
+                      "r"(x6));
+}
+
+/*
+ * Same as __chcore_syscall7, except that x1 ~ x6 also carry results back
+ * (used by the register-only IPC). They are stored into rets[0] ~ rets[5].
+ */
+static inline long __chcore_syscall7_ret6(long n, long a, long b, long c,
+                                          long d, long e, long f, long g,
+                                          long *rets)
+{
+        register long x8 __asm__("x8") = n;
+        register long x0 __asm__("x0") = a;
+        register long x1 __asm__("x1") = b;
+        register long x2 __asm__("x2") = c;
+        register long x3 __asm__("x3") = d;
+        register long x4 __asm__("x4") = e;
+        register long x5 __asm__("x5") = f;
+        register long x6 __asm__("x6") = g;
+        __asm__ __volatile__("svc 0"
+                             : "+r"(x0),
+                               "+r"(x1),
+                               "+r"(x2),
+                               "+r"(x3),
+                               "+r"(x4),
+                               "+r"(x5),
+                               "+r"(x6)
+                             : "r"(x8)
+                             : "memory", "cc");
+        rets[0] = x1;
+        rets[1] = x2;
+        rets[2] = x3;
+        rets[3] = x4;
+        rets[4] = x5;
+        rets[5] = x6;
+        return x0;
+}
@@ -26,6 +26,8 @@ int chcore_cap_copy_from(u64 src_cap_group_cap, u64 src_cap);
 
 int chcore_cap_transfer_multi(u64 dest_group_cap, int *src_caps, int nr_caps,
                               int *dest_caps);
+/* Only caps of pmos and semaphores can be freed */
+int chcore_cap_free(u64 cap);
 
 #ifdef __cplusplus
 }
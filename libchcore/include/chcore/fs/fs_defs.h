@@ -40,7 +40,9 @@ enum fs_req_type {
         FS_REQ_WRITE,
         FS_REQ_GET_SIZE,
         FS_REQ_LSEEK,
-        FS_REQ_GETDENTS64
+        FS_REQ_GETDENTS64,
+        /* Hand an async ring (chcore/ipc_async.h) to the server */
+        FS_REQ_ASYNC_SETUP
 };
 
 /* Clients send fs_request to fs_server */
@@ -13,6 +13,7 @@
 #pragma once
 
 #include <chcore/types.h>
+#include <chcore/thread.h>
 #include <chcore/internal/syscall_arch.h>
 #include <chcore/internal/syscall_num.h>
 
@@ -20,6 +21,8 @@
 extern "C" {
 #endif
 
+struct timespec;
+
 /* Character */
 
 static inline void __chcore_sys_putc(char ch)
@@ -80,6 +83,11 @@ static inline int __chcore_sys_read_pmo(u64 pmo_cap, u64 offset, u64 user_ptr,
                 __CHCORE_SYS_read_pmo, pmo_cap, offset, user_ptr, len);
 }
 
+static inline int __chcore_sys_get_pmo_size(u64 pmo_cap, u64 user_buf)
+{
+        return __chcore_syscall2(__CHCORE_SYS_get_pmo_size, pmo_cap, user_buf);
+}
+
 /* - batch */
 
 static inline int __chcore_sys_create_pmos(u64 user_buf, u64 cnt)
@@ -133,6 +141,11 @@ static inline int __chcore_sys_transfer_caps(u64 dest_group_cap,
                                  dst_caps_buf);
 }
 
+static inline int __chcore_sys_cap_free(u64 slot_id)
+{
+        return __chcore_syscall1(__CHCORE_SYS_cap_free, slot_id);
+}
+
 /* Multitask */
 
 /* - create & exit */
@@ -179,6 +192,20 @@ static inline u32 __chcore_sys_get_cpu_id()
         return __chcore_syscall0(__CHCORE_SYS_get_cpu_id);
 }
 
+static inline int __chcore_sys_set_sched_param(u64 thread_cap,
+                                               struct sched_rsv_param *param)
+{
+        return __chcore_syscall2(
+                __CHCORE_SYS_set_sched_param, thread_cap, (long)param);
+}
+
+static inline int __chcore_sys_set_cap_group_weight(u64 cap_group_cap,
+                                                    u32 weight)
+{
+        return __chcore_syscall2(
+                __CHCORE_SYS_set_cap_group_weight, cap_group_cap, weight);
+}
+
 /* IPC */
 
 /* - procedure call */
@@ -213,6 +240,54 @@ static inline void __chcore_sys_ipc_return(u64 ret, u64 cap_num)
         __chcore_syscall2(__CHCORE_SYS_ipc_return, ret, cap_num);
 }
 
+/* - register-only procedure call */
+
+static inline u64 __chcore_sys_ipc_call_regs(u32 conn_cap, const u64 *args,
+                                             u64 *rets)
+{
+        return __chcore_syscall7_ret6(__CHCORE_SYS_ipc_call_regs,
+                                      conn_cap,
+                                      args[0],
+                                      args[1],
+                                      args[2],
+                                      args[3],
+                                      args[4],
+                                      args[5],
+                                      (long *)rets);
+}
+
+static inline void __chcore_sys_ipc_return_regs(u64 ret, const u64 *rets)
+{
+        __chcore_syscall7(__CHCORE_SYS_ipc_return_regs,
+                          ret,
+                          rets[0],
+                          rets[1],
+                          rets[2],
+                          rets[3],
+                          rets[4],
+                          rets[5]);
+}
+
+/* - batched procedure call */
+
+static inline s64 __chcore_sys_ipc_call_batch(const u32 *conn_caps,
+                                              void *const *ipc_msgs,
+                                              s64 *rets, u64 n)
+{
+        return __chcore_syscall4(__CHCORE_SYS_ipc_call_batch,
+                                 (long)conn_caps,
+                                 (long)ipc_msgs,
+                                 (long)rets,
+                                 n);
+}
+
+/* - connection */
+
+static inline int __chcore_sys_ipc_close_connection(u32 conn_cap)
+{
+        return __chcore_syscall1(__CHCORE_SYS_ipc_close_connection, conn_cap);
+}
+
 /* Hardware Access (Privileged Instruction) */
 
 /* - cache */
@@ -229,6 +304,32 @@ static inline u64 __chcore_sys_get_current_tick(void)
         return __chcore_syscall0(__CHCORE_SYS_get_current_tick);
 }
 
+/* POSIX */
+/* - time */
+
+static inline int __chcore_sys_clock_gettime(u64 clock, struct timespec *ts)
+{
+        return __chcore_syscall2(__CHCORE_SYS_clock_gettime, clock, (long)ts);
+}
+
+static inline int __chcore_sys_clock_nanosleep(u64 clock, int flags,
+                                               const struct timespec *req,
+                                               struct timespec *rem)
+{
+        return __chcore_syscall4(__CHCORE_SYS_clock_nanosleep,
+                                 clock,
+                                 flags,
+                                 (long)req,
+                                 (long)rem);
+}
+
+static inline int __chcore_sys_nanosleep(const struct timespec *req,
+                                         struct timespec *rem)
+{
+        return __chcore_syscall2(
+                __CHCORE_SYS_nanosleep, (long)req, (long)rem);
+}
+
 /* Debug */
 
 static inline void __chcore_sys_top(void)
@@ -241,6 +342,27 @@ static inline u64 __chcore_sys_get_free_mem_size(void)
         return __chcore_syscall0(__CHCORE_SYS_get_free_mem_size);
 }
 
+static inline int __chcore_sys_get_sched_stat(u64 thread_cap,
+                                              struct sched_snapshot *snapshot)
+{
+        return __chcore_syscall2(
+                __CHCORE_SYS_get_sched_stat, thread_cap, (long)snapshot);
+}
+
+static inline int __chcore_sys_sched_trace_ctl(u32 op)
+{
+        return __chcore_syscall1(__CHCORE_SYS_sched_trace_ctl, op);
+}
+
+static inline int __chcore_sys_sched_trace_drain(
+        struct sched_trace_event *events, u64 count, u64 *lost)
+{
+        return __chcore_syscall3(__CHCORE_SYS_sched_trace_drain,
+                                 (long)events,
+                                 count,
+                                 (long)lost);
+}
+
 /* Performance Benchmark */
 
 static inline void __chcore_sys_perf_start(void)
@@ -24,6 +24,7 @@
 #define __CHCORE_SYS_unmap_pmo         13
 #define __CHCORE_SYS_write_pmo         14
 #define __CHCORE_SYS_read_pmo          15
+#define __CHCORE_SYS_get_pmo_size      16
 /* - batch */
 #define __CHCORE_SYS_create_pmos 20
 #define __CHCORE_SYS_map_pmos    21
@@ -35,6 +36,7 @@
 #define __CHCORE_SYS_cap_copy_to   60
 #define __CHCORE_SYS_cap_copy_from 61
 #define __CHCORE_SYS_transfer_caps 62
+#define __CHCORE_SYS_cap_free      63
 
 /* Multitask */
 /* - create & exit */
@@ -42,10 +44,12 @@
 #define __CHCORE_SYS_create_thread    82
 #define __CHCORE_SYS_thread_exit      83
 /* - schedule */
-#define __CHCORE_SYS_yield        100
-#define __CHCORE_SYS_set_affinity 101
-#define __CHCORE_SYS_get_affinity 102
-#define __CHCORE_SYS_get_cpu_id   103
+#define __CHCORE_SYS_yield                100
+#define __CHCORE_SYS_set_affinity         101
+#define __CHCORE_SYS_get_affinity         102
+#define __CHCORE_SYS_get_cpu_id           103
+#define __CHCORE_SYS_set_sched_param      104
+#define __CHCORE_SYS_set_cap_group_weight 105
 
 /* IPC */
 /* - procedure call */
@@ -53,6 +57,12 @@
 #define __CHCORE_SYS_register_client 121
 #define __CHCORE_SYS_ipc_call        122
 #define __CHCORE_SYS_ipc_return      123
+#define __CHCORE_SYS_ipc_call_regs   124
+#define __CHCORE_SYS_ipc_return_regs 125
+/* - batched procedure call */
+#define __CHCORE_SYS_ipc_call_batch 126
+/* - connection */
+#define __CHCORE_SYS_ipc_close_connection 127
 
 /* Hardware Access (Privileged Instruction) */
 /* - cache */
@@ -62,7 +72,9 @@
 
 /* POSIX */
 /* - time */
-#define __CHCORE_SYS_clock_gettime 200
+#define __CHCORE_SYS_clock_gettime   200
+#define __CHCORE_SYS_clock_nanosleep 201
+#define __CHCORE_SYS_nanosleep       202
 /* - memory */
 #define __CHCORE_SYS_handle_brk    210
 #define __CHCORE_SYS_handle_mmap   211
@@ -71,6 +83,9 @@
 /* Debug */
 #define __CHCORE_SYS_top               221
 #define __CHCORE_SYS_get_free_mem_size 222
+#define __CHCORE_SYS_get_sched_stat    223
+#define __CHCORE_SYS_sched_trace_ctl   224
+#define __CHCORE_SYS_sched_trace_drain 225
 
 /* Performance Benchmark */
 #define __CHCORE_SYS_perf_start 230
@@ -21,8 +21,19 @@ typedef struct ipc_struct {
         u64 shared_buf;
         u64 shared_buf_len;
         struct spinlock ipc_lock;
+        /*
+         * The shared buffer is split into msg_slot_num slots, and each
+         * in-flight ipc_msg takes one (see ipc_set_msg_slots).
+         */
+        u64 msg_slot_num;
+        u64 msg_slot_size;
+        /* Slots in use, protected by ipc_lock */
+        u64 msg_slot_bmp;
 } ipc_struct_t;
 
+/* Upper bound of ipc_struct->msg_slot_num */
+#define IPC_MAX_MSG_SLOTS 64
+
 typedef struct ipc_msg {
         u64 data_len;
         u64 cap_slot_number;
@@ -30,20 +41,47 @@ typedef struct ipc_msg {
         u64 cap_slots_offset;
 } ipc_msg_t;
 
+/* Number of u64 values carried by the register-only IPC */
+#define IPC_REGS_NUM 6
+
+/* Arguments/results of a register-only IPC */
+typedef struct ipc_regs {
+        u64 reg[IPC_REGS_NUM];
+} ipc_regs_t;
+
+/*
+ * Zero-copy PMO window in ipc_msg cap slots (see ipc_set_msg_window).
+ * It takes IPC_WINDOW_SLOTS slots: the pmo cap with the flags, the offset
+ * and the length. The kernel maps the window into the server during the call
+ * and passes it to the handler (see server_handler).
+ */
+#define IPC_MSG_WINDOW       (1UL << 63)
+#define IPC_MSG_WINDOW_WRITE (1UL << 62)
+#define IPC_WINDOW_SLOTS     3
+
 struct ipc_vm_config {
         u64 stack_base_addr;
         u64 stack_size;
         u64 buf_base_addr;
         u64 buf_size;
+        /* Server only: all connection buffers are placed in this area */
+        u64 buf_area_size;
 };
 
 /* Shadow thread configs */
 #define SERVER_STACK_BASE 0x7000000
 #define SERVER_STACK_SIZE 0x1000
-#define SERVER_BUF_BASE   0x7400000
-#define SERVER_BUF_SIZE   0x1000
-#define CLIENT_BUF_BASE   0x7800000
-#define CLIENT_BUF_SIZE   0x1000
+/* Shared buffer configs, SERVER/CLIENT_BUF_SIZE are the default sizes */
+#define SERVER_BUF_BASE      0x100000000000UL
+#define SERVER_BUF_SIZE      0x1000
+#define SERVER_BUF_AREA_SIZE 0x40000000UL
+#define CLIENT_BUF_BASE      0x140000000000UL
+#define CLIENT_BUF_SIZE      0x1000
+#define CLIENT_BUF_AREA_SIZE 0x40000000UL
+/* Largest shared buffer a client can get for one connection */
+#define IPC_MAX_BUF_SIZE 0x800000
+/* Calls issued by one ipc_call_batch at most */
+#define IPC_MAX_BATCH 16
 
 #define MAX_CLIENT        32
 #define RETRY_UPPER_BOUND 100
@@ -51,12 +89,25 @@ struct ipc_vm_config {
 /*
  * server_handler is an IPC routine (can have two arguments):
  * first is ipc_msg and second is client_pid.
+ *
+ * For a register-only IPC (ipc_call_regs), ipc_msg is NULL and the
+ * IPC_REGS_NUM arguments follow client_pid, i.e., the handler looks like
+ * handler(ipc_msg, client_pid, reg0, reg1, ..., reg5).
+ *
+ * Otherwise, the address and the length of the window mapped for the call
+ * follow client_pid, i.e., handler(ipc_msg, client_pid, window, window_len),
+ * which are 0 if the client grants none. Only these are set by the kernel,
+ * while the ipc_msg can still be written by the client.
  */
 typedef void (*server_handler)();
 
 /* Registeration interfaces */
 struct ipc_struct *ipc_register_client(int server_thread_cap);
+struct ipc_struct *ipc_register_client_with_buf(int server_thread_cap,
+                                                u64 buf_size);
 int ipc_register_server(server_handler server_handler);
+int ipc_set_msg_slots(struct ipc_struct *icb, u64 slot_num);
+int ipc_client_close(struct ipc_struct *icb);
 
 /* IPC message operating interfaces */
 struct ipc_msg *ipc_create_msg(struct ipc_struct *icb, u64 data_len,
@@ -65,9 +116,18 @@ char *ipc_get_msg_data(struct ipc_msg *ipc_msg);
 u64 ipc_get_msg_cap(struct ipc_msg *ipc_msg, u64 cap_id);
 int ipc_set_msg_data(struct ipc_msg *ipc_msg, void *data, u64 offset, u64 len);
 int ipc_set_msg_cap(struct ipc_msg *ipc_msg, u64 cap_slot_index, u32 cap);
+int ipc_set_msg_window(struct ipc_msg *ipc_msg, u64 cap_slot_index,
+                       u32 pmo_cap, u64 offset, u64 len, bool writable);
 int ipc_destroy_msg(struct ipc_struct *icb, struct ipc_msg *ipc_msg);
 
 /* IPC issue/finish interfaces */
 s64 ipc_call(struct ipc_struct *icb, struct ipc_msg *ipc_msg);
 void ipc_return(struct ipc_msg *ipc_msg, int ret);
 void ipc_return_with_cap(struct ipc_msg *ipc_msg, int ret);
+s64 ipc_call_batch(struct ipc_struct **icbs, struct ipc_msg **ipc_msgs,
+                   s64 *rets, u64 n);
+
+/* Register-only IPC for small requests, no shared buffer is touched */
+s64 ipc_call_regs(struct ipc_struct *icb, const ipc_regs_t *args,
+                  ipc_regs_t *rets);
+void ipc_return_regs(s64 ret, const ipc_regs_t *rets);
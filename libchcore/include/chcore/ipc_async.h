@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan PSL v1.
+ * You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v1 for more details.
+ */
+
+#pragma once
+
+#include <chcore/types.h>
+#include <chcore/ipc.h>
+#include <chcore/thread.h>
+#include <sync/spin.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Asynchronous IPC on a submission/completion ring.
+ *
+ * The client posts requests into the submission queue (sq) of a pmo shared
+ * with the server, and a worker thread of the server drains it and posts
+ * the results into the completion queue (cq). No kernel crossing happens
+ * per request: a semaphore is signaled only when a queue turns non-empty,
+ * i.e., when its consumer may be sleeping.
+ *
+ * Setup: the client fills IPC_ASYNC_CAP_SLOTS cap slots of an ipc_msg by
+ * ipc_async_ring_set_msg and sends it by ipc_call as a server-specific
+ * request, on which the server calls ipc_async_ring_accept.
+ */
+
+/* Caps carried by the setup ipc_msg: ring pmo, sq and cq semaphores */
+#define IPC_ASYNC_CAP_SLOTS 3
+/* Priority of the server worker thread, the same as shadow threads */
+#define IPC_ASYNC_WORKER_PRIO (MAX_PRIO - 1)
+
+struct ipc_async_sqe {
+        /* Chosen by the client and returned in the cqe */
+        u64 tag;
+        ipc_regs_t args;
+};
+
+struct ipc_async_cqe {
+        u64 tag;
+        s64 ret;
+        ipc_regs_t rets;
+};
+
+/*
+ * Header of the ring pmo, followed by sq[entries], cq[entries] and a data
+ * area of data_size bytes for the payloads of requests.
+ */
+struct ipc_async_shm {
+        u64 entries;
+        u64 data_size;
+        /* sq: produced by the client and consumed by the server */
+        volatile u64 sq_head;
+        volatile u64 sq_tail;
+        /* cq: produced by the server and consumed by the client */
+        volatile u64 cq_head;
+        volatile u64 cq_tail;
+        /* Set by the client to stop the server worker */
+        volatile u64 closed;
+};
+
+struct ipc_async_ring;
+
+/*
+ * Server routine for each request, which runs in the worker thread.
+ * The return value and @rets are posted to the cq.
+ */
+typedef s64 (*ipc_async_handler)(struct ipc_async_ring *ring,
+                                 const ipc_regs_t *args, ipc_regs_t *rets);
+
+/* Local view of a ring, in both the client and the server */
+struct ipc_async_ring {
+        struct ipc_async_shm *shm;
+        struct ipc_async_sqe *sq;
+        struct ipc_async_cqe *cq;
+        void *data;
+        u64 shm_size;
+        /* Local copies, the shared header is not trusted by the server */
+        u64 entries;
+        u64 data_size;
+        int pmo_cap;
+        /* Signaled when the sq turns non-empty */
+        int sq_sem;
+        /* Signaled when the cq turns non-empty */
+        int cq_sem;
+
+        /* Client only: submitted but not reaped, at most entries */
+        u64 in_flight;
+        struct spinlock lock;
+
+        /* Server only */
+        u64 client_badge;
+        ipc_async_handler handler;
+};
+
+/* Client interfaces */
+struct ipc_async_ring *ipc_async_ring_create(u64 entries, u64 data_size);
+int ipc_async_ring_set_msg(struct ipc_async_ring *ring,
+                           struct ipc_msg *ipc_msg, u64 cap_slot_index);
+void ipc_async_ring_destroy(struct ipc_async_ring *ring);
+int ipc_async_submit(struct ipc_async_ring *ring, u64 tag,
+                     const ipc_regs_t *args);
+int ipc_async_reap(struct ipc_async_ring *ring, struct ipc_async_cqe *cqe,
+                   bool is_block);
+
+/* Server interfaces */
+int ipc_async_ring_accept(struct ipc_msg *ipc_msg, u64 cap_slot_index,
+                          u64 client_badge, ipc_async_handler handler);
+
+static inline void *ipc_async_data(struct ipc_async_ring *ring)
+{
+        return ring->data;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -17,6 +17,7 @@
 /* PMO types */
 #define PMO_ANONYM 0
 #define PMO_DATA   1
+#define PMO_HUGE   7 /* lazy allocation in blocks of HUGE_PAGE_SIZE */
 #define PMO_FORBID 10 /* Forbidden area: avoid overflow */
 
 /* virtual memory permission flags */
@@ -26,6 +27,8 @@
 #define VM_FORBID (0)
 
 #define PAGE_SIZE 0x1000
+/* A PMO_HUGE must be mapped at an address aligned to it */
+#define HUGE_PAGE_SIZE 0x200000
 
 #ifdef __cplusplus
 extern "C" {
@@ -36,6 +39,7 @@ int chcore_pmo_map(u64 target_cap_group_cap, u64 pmo_cap, u64 addr, u64 perm);
 int chcore_pmo_unmap(u64 target_cap_group_cap, u64 pmo_cap, u64 addr);
 int chcore_pmo_write(u64 pmo_cap, u64 offset, void *buf, u64 len);
 int chcore_pmo_read(u64 pmo_cap, u64 offset, void *buf, u64 len);
+int chcore_pmo_get_size(u64 pmo_cap, u64 *size);
 
 struct pmo_request {
         /* input: args */
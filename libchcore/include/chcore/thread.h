@@ -35,6 +35,91 @@ enum thread_type {
         TYPE_SHADOW = 1, /* SHADOW thread is used to achieve migrate IPC */
 };
 
+/*
+ * Scheduling statistics of a thread, with times in ticks of the system
+ * counter (see __chcore_sys_get_current_tick).
+ */
+struct sched_stat {
+        u64 enqueue_cnt;
+        u64 dequeue_cnt;
+        /* Times switched in */
+        u64 switch_cnt;
+        u64 oncpu_ticks;
+        /* From being enqueued to running: samples, total and max */
+        u64 wakeup_cnt;
+        u64 wakeup_lat_ticks;
+        u64 wakeup_lat_max;
+};
+
+#define SCHED_STAT_MAX_CPU 16
+/* thread_cap of __chcore_sys_get_sched_stat for the calling thread */
+#define SCHED_STAT_SELF    ((u64)-1)
+
+/* Snapshot returned by __chcore_sys_get_sched_stat */
+struct sched_snapshot {
+        u32 cpuid;
+        u32 state;
+        u32 prio;
+        s32 affinity;
+        struct sched_stat stat;
+        /* Ready threads on each of the cpu_num CPUs */
+        u32 cpu_num;
+        u32 queue_len[SCHED_STAT_MAX_CPU];
+};
+
+/*
+ * Parameters of __chcore_sys_set_sched_param: budget_ms of CPU time in
+ * every period_ms, EDF scheduled. period_ms = 0 for best effort.
+ * Only the root process may reserve (-EPERM otherwise).
+ * Returns -EBUSY if the kernel cannot admit the reservation.
+ */
+struct sched_rsv_param {
+        u32 period_ms;
+        u32 budget_ms;
+};
+
+/*
+ * Weights of __chcore_sys_set_cap_group_weight under the fair policy.
+ * Only the root process may set one above the default.
+ */
+#define SCHED_WEIGHT_DEFAULT 1024
+#define SCHED_WEIGHT_MAX     (SCHED_WEIGHT_DEFAULT * 64)
+
+/* Types of sched_trace_event */
+enum sched_trace_type {
+        /* Switched in, arg is the thread switched out (0 if none) */
+        SCHED_TRACE_SWITCH = 0,
+        /* Put into a ready queue, arg is the CPU of the queue */
+        SCHED_TRACE_ENQUEUE,
+        /* Removed from a ready queue, arg is the CPU of the queue */
+        SCHED_TRACE_DEQUEUE,
+        /* Woken up by a semaphore, arg is the signaling thread */
+        SCHED_TRACE_WAKEUP,
+        /* IPC migrates to the shadow thread, arg is the client thread */
+        SCHED_TRACE_MIGRATE,
+        /* Timer irq while the thread runs */
+        SCHED_TRACE_TIMER,
+        SCHED_TRACE_TYPE_NUM,
+};
+
+/*
+ * Event drained by __chcore_sys_sched_trace_drain, in time order across
+ * CPUs. Threads are identified by opaque ids.
+ */
+struct sched_trace_event {
+        /* In ticks of __chcore_sys_get_current_tick */
+        u64 ts;
+        u64 thread;
+        u64 arg;
+        u32 type;
+        u32 cpuid;
+};
+
+/* ops of __chcore_sys_sched_trace_ctl */
+#define SCHED_TRACE_OFF   0
+#define SCHED_TRACE_ON    1
+#define SCHED_TRACE_RESET 2
+
 int chcore_thread_create(void *(*func)(void *), u64 arg, u32 prio, u32 type);
 
 #ifdef __cplusplus
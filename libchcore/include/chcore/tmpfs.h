@@ -17,6 +17,7 @@ extern "C" {
 #endif
 
 #include <sys/types.h>
+#include <chcore/types.h>
 
 int alloc_fd();
 void connect_tmpfs_server();
@@ -32,6 +33,20 @@ int fs_rmdir(const char *path);
 int fs_getdents(int fd, size_t size, char *buf);
 int fs_getsize(const char *path);
 
+/* Zero-copy I/O through a window of a pmo, see fs_read_pmo */
+int fs_read_pmo(int fd, int pmo_cap, u64 offset, size_t size);
+int fs_write_pmo(int fd, int pmo_cap, u64 offset, size_t size);
+
+/*
+ * Async requests on a ring (chcore/ipc_async.h), whose completions are
+ * taken by ipc_async_reap. The cqe ret is that of the sync version.
+ */
+struct ipc_async_ring;
+struct ipc_async_ring *fs_async_setup(u64 entries, u64 data_size);
+int fs_async_read(struct ipc_async_ring *ring, u64 tag, int fd, size_t size,
+                  u64 data_offset);
+int fs_async_close(struct ipc_async_ring *ring, u64 tag, int fd);
+
 #ifdef __cplusplus
 }
 #endif
@@ -21,6 +21,8 @@ extern "C" {
 void *malloc(size_t size);
 void free(void *ptr);
 void *calloc(size_t nmemb, size_t size);
+/* Allocate from an arena backed by huge pages, for large datasets */
+void *malloc_huge(size_t size);
 
 #ifdef __cplusplus
 }
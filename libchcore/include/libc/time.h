@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan PSL v1.
+ * You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v1 for more details.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef u64 time_t;
+typedef u64 clockid_t;
+
+/* Both clocks count from the system boot */
+#define CLOCK_REALTIME  0
+#define CLOCK_MONOTONIC 1
+
+/* Flags of clock_nanosleep */
+#define TIMER_ABSTIME 1
+
+struct timespec {
+        time_t tv_sec;
+        long tv_nsec;
+};
+
+/* Return 0 on success, or a negative errno on failure */
+int clock_gettime(clockid_t clock, struct timespec *ts);
+int clock_nanosleep(clockid_t clock, int flags, const struct timespec *req,
+                    struct timespec *rem);
+int nanosleep(const struct timespec *req, struct timespec *rem);
+
+#ifdef __cplusplus
+}
+#endif
@@ -12,13 +12,26 @@
 
 #include <chcore/tmpfs.h>
 #include <chcore/ipc.h>
+#include <chcore/ipc_async.h>
 #include <chcore/assert.h>
 #include <chcore/internal/server_caps.h>
 #include <chcore/fs/defs.h>
+#include <chcore/memory.h>
+#include <chcore/internal/utils.h>
 #include <string.h>
 
 struct ipc_struct *tmpfs_ipc_struct = NULL;
 
+/* Shared buffer asked for the tmpfs connection, bulk I/O moves in its chunks */
+#define TMPFS_IPC_BUF_SIZE 0x100000
+
+/* Bytes of file data that fit in a msg slot after the request */
+static size_t fs_buf_size(void)
+{
+        return tmpfs_ipc_struct->msg_slot_size - sizeof(struct ipc_msg)
+               - sizeof(struct fs_request);
+}
+
 int alloc_fd()
 {
         // 0: stdin 1: stdout 2: stderr
@@ -30,7 +43,8 @@ void connect_tmpfs_server(void)
 {
         int tmpfs_cap = __chcore_get_tmpfs_cap();
         chcore_assert(tmpfs_cap >= 0);
-        tmpfs_ipc_struct = ipc_register_client(tmpfs_cap);
+        tmpfs_ipc_struct =
+                ipc_register_client_with_buf(tmpfs_cap, TMPFS_IPC_BUF_SIZE);
         chcore_assert(tmpfs_ipc_struct);
 }
 
@@ -58,7 +72,7 @@ int fs_read(int fd, size_t size, char *buf)
         int ret, count;
 
         do {
-                count = MIN(size, FS_BUF_SIZE);
+                count = MIN(size, fs_buf_size());
                 fr->req = FS_REQ_READ;
                 fr->read.fd = fd;
                 fr->read.count = count;
@@ -83,7 +97,7 @@ int fs_write(int fd, size_t size, const char *buf)
         int ret, count;
 
         do {
-                count = MIN(size, FS_BUF_SIZE);
+                count = MIN(size, fs_buf_size());
                 memcpy((void *)fr + sizeof(struct fs_request), buf, count);
                 fr->req = FS_REQ_WRITE;
                 fr->write.count = count;
@@ -101,15 +115,9 @@ int fs_write(int fd, size_t size, const char *buf)
 
 int fs_close(int fd)
 {
-        struct ipc_msg *ipc_msg =
-                ipc_create_msg(tmpfs_ipc_struct, sizeof(struct fs_request), 0);
-        chcore_assert(ipc_msg);
-        struct fs_request *fr = (struct fs_request *)ipc_get_msg_data(ipc_msg);
-        fr->req = FS_REQ_CLOSE;
-        fr->close.fd = fd;
-        int ret = ipc_call(tmpfs_ipc_struct, ipc_msg);
-        ipc_destroy_msg(tmpfs_ipc_struct, ipc_msg);
-        return ret;
+        /* Small enough to be sent in registers */
+        ipc_regs_t args = {.reg = {FS_REQ_CLOSE, fd}};
+        return ipc_call_regs(tmpfs_ipc_struct, &args, NULL);
 }
 
 int fs_creat(const char *path)
@@ -173,7 +181,7 @@ int fs_getdents(int fd, size_t size, char *buf)
         int ret, count;
 
         do {
-                count = MIN(size, FS_BUF_SIZE);
+                count = MIN(size, fs_buf_size());
                 fr->req = FS_REQ_GETDENTS64;
                 fr->getdents64.fd = fd;
                 fr->getdents64.count = count;
@@ -201,3 +209,92 @@ int fs_getsize(const char *path)
         ipc_destroy_msg(tmpfs_ipc_struct, ipc_msg);
         return ret;
 }
+
+/*
+ * Zero-copy read/write: tmpfs copies between the file and the pmo window
+ * [offset, offset + size) directly instead of the shared buffer.
+ * offset must be page-aligned.
+ */
+static int fs_rw_pmo(enum fs_req_type req, int fd, int pmo_cap, u64 offset,
+                     size_t size)
+{
+        struct ipc_msg *ipc_msg = ipc_create_msg(
+                tmpfs_ipc_struct, sizeof(struct fs_request), IPC_WINDOW_SLOTS);
+        chcore_assert(ipc_msg);
+        struct fs_request *fr = (struct fs_request *)ipc_get_msg_data(ipc_msg);
+        int ret;
+
+        ipc_set_msg_window(ipc_msg,
+                           0,
+                           pmo_cap,
+                           offset,
+                           ROUND_UP(size, PAGE_SIZE),
+                           req == FS_REQ_READ);
+        fr->req = req;
+        if (req == FS_REQ_READ) {
+                fr->read.fd = fd;
+                fr->read.count = size;
+        } else {
+                fr->write.fd = fd;
+                fr->write.count = size;
+        }
+        ret = ipc_call(tmpfs_ipc_struct, ipc_msg);
+        ipc_destroy_msg(tmpfs_ipc_struct, ipc_msg);
+        return ret;
+}
+
+int fs_read_pmo(int fd, int pmo_cap, u64 offset, size_t size)
+{
+        return fs_rw_pmo(FS_REQ_READ, fd, pmo_cap, offset, size);
+}
+
+int fs_write_pmo(int fd, int pmo_cap, u64 offset, size_t size)
+{
+        return fs_rw_pmo(FS_REQ_WRITE, fd, pmo_cap, offset, size);
+}
+
+/*
+ * Open an async ring to tmpfs with @entries requests in flight at most and
+ * a data area of @data_size bytes for fs_async_read.
+ */
+struct ipc_async_ring *fs_async_setup(u64 entries, u64 data_size)
+{
+        struct ipc_async_ring *ring;
+        struct ipc_msg *ipc_msg;
+        struct fs_request *fr;
+        int ret;
+
+        ring = ipc_async_ring_create(entries, data_size);
+        if (!ring)
+                return NULL;
+
+        ipc_msg = ipc_create_msg(tmpfs_ipc_struct,
+                                 sizeof(struct fs_request),
+                                 IPC_ASYNC_CAP_SLOTS);
+        chcore_assert(ipc_msg);
+        fr = (struct fs_request *)ipc_get_msg_data(ipc_msg);
+        fr->req = FS_REQ_ASYNC_SETUP;
+        ipc_async_ring_set_msg(ring, ipc_msg, 0);
+        ret = ipc_call(tmpfs_ipc_struct, ipc_msg);
+        ipc_destroy_msg(tmpfs_ipc_struct, ipc_msg);
+
+        if (ret < 0) {
+                ipc_async_ring_destroy(ring);
+                return NULL;
+        }
+        return ring;
+}
+
+/* Read @size bytes of @fd into the data area of @ring at @data_offset */
+int fs_async_read(struct ipc_async_ring *ring, u64 tag, int fd, size_t size,
+                  u64 data_offset)
+{
+        ipc_regs_t args = {.reg = {FS_REQ_READ, fd, size, data_offset}};
+        return ipc_async_submit(ring, tag, &args);
+}
+
+int fs_async_close(struct ipc_async_ring *ring, u64 tag, int fd)
+{
+        ipc_regs_t args = {.reg = {FS_REQ_CLOSE, fd}};
+        return ipc_async_submit(ring, tag, &args);
+}
@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan PSL v1.
+ * You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v1 for more details.
+ */
+
+#include <chcore/ipc_async.h>
+#include <chcore/capability.h>
+#include <chcore/memory.h>
+#include <chcore/thread.h>
+#include <chcore/internal/raw_syscall.h>
+#include <chcore/internal/utils.h>
+#include <errno.h>
+#include <malloc.h>
+#include <string.h>
+
+/*
+ * Wakeup protocol of a queue (the same for sq and cq):
+ * - The producer publishes the entry, bumps tail, and then reads head.
+ *   If head equals the old tail, the consumer has found the queue empty
+ *   and may be sleeping, so the producer signals the semaphore.
+ * - The consumer bumps head, and then reads tail. It sleeps on the
+ *   semaphore only when they are equal.
+ * With full barriers in between, at least one side sees the other's
+ * update, so no wakeup is lost. A spare signal only costs the consumer
+ * one more round of checking.
+ */
+
+static u64 ring_shm_size(u64 entries, u64 data_size)
+{
+        return ROUND_UP(sizeof(struct ipc_async_shm)
+                                + entries * sizeof(struct ipc_async_sqe)
+                                + entries * sizeof(struct ipc_async_cqe)
+                                + data_size,
+                        PAGE_SIZE);
+}
+
+/*
+ * Whether a ring of @entries and @data_size fits in a pmo of @pmo_size.
+ * The terms are bounded one by one so that ring_shm_size cannot overflow.
+ */
+static bool ring_layout_valid(u64 entries, u64 data_size, u64 pmo_size)
+{
+        u64 entry_size = sizeof(struct ipc_async_sqe)
+                         + sizeof(struct ipc_async_cqe);
+
+        if (entries == 0 || (entries & (entries - 1)) != 0)
+                return false;
+        if (entries > pmo_size / entry_size || data_size > pmo_size)
+                return false;
+        return ring_shm_size(entries, data_size) <= pmo_size;
+}
+
+/* Drop the caps of the ring, either of them may be absent (negative) */
+static void ring_free_caps(struct ipc_async_ring *ring)
+{
+        if (ring->pmo_cap >= 0)
+                chcore_cap_free(ring->pmo_cap);
+        if (ring->sq_sem >= 0)
+                chcore_cap_free(ring->sq_sem);
+        if (ring->cq_sem >= 0)
+                chcore_cap_free(ring->cq_sem);
+}
+
+/* Locate the queues and the data area in the mapped pmo */
+static void ring_init_view(struct ipc_async_ring *ring, void *shm,
+                           u64 entries, u64 data_size)
+{
+        ring->entries = entries;
+        ring->data_size = data_size;
+        ring->shm_size = ring_shm_size(entries, data_size);
+        ring->shm = shm;
+        ring->sq = (struct ipc_async_sqe *)(ring->shm + 1);
+        ring->cq = (struct ipc_async_cqe *)(ring->sq + entries);
+        ring->data = ring->cq + entries;
+}
+
+/*
+ * Create a ring with @entries (a power of 2) sq/cq entries and a data area
+ * of @data_size bytes.
+ */
+struct ipc_async_ring *ipc_async_ring_create(u64 entries, u64 data_size)
+{
+        struct ipc_async_ring *ring;
+        struct ipc_async_shm *shm;
+        u64 shm_size;
+
+        if (entries == 0 || (entries & (entries - 1)) != 0)
+                return NULL;
+
+        ring = malloc(sizeof(*ring));
+        if (!ring)
+                goto out_fail;
+        memset(ring, 0, sizeof(*ring));
+        ring->sq_sem = -1;
+        ring->cq_sem = -1;
+
+        shm_size = ring_shm_size(entries, data_size);
+        ring->pmo_cap = chcore_pmo_create(shm_size, PMO_DATA);
+        if (ring->pmo_cap < 0)
+                goto out_free_ring;
+        shm = chcore_pmo_auto_map(ring->pmo_cap, shm_size, VM_READ | VM_WRITE);
+        if (!shm)
+                goto out_free_caps;
+
+        ring->sq_sem = __chcore_sys_create_sem();
+        ring->cq_sem = __chcore_sys_create_sem();
+        if (ring->sq_sem < 0 || ring->cq_sem < 0)
+                goto out_unmap;
+
+        shm->entries = entries;
+        shm->data_size = data_size;
+        ring_init_view(ring, shm, entries, data_size);
+        spinlock_init(&ring->lock);
+        return ring;
+
+out_unmap:
+        chcore_pmo_auto_unmap(ring->pmo_cap, (u64)shm, shm_size);
+out_free_caps:
+        ring_free_caps(ring);
+out_free_ring:
+        free(ring);
+out_fail:
+        return NULL;
+}
+
+/* Put the caps of the ring into the setup ipc_msg */
+int ipc_async_ring_set_msg(struct ipc_async_ring *ring,
+                           struct ipc_msg *ipc_msg, u64 cap_slot_index)
+{
+        if (cap_slot_index + IPC_ASYNC_CAP_SLOTS > ipc_msg->cap_slot_number)
+                return -EINVAL;
+
+        ipc_set_msg_cap(ipc_msg, cap_slot_index, ring->pmo_cap);
+        ipc_set_msg_cap(ipc_msg, cap_slot_index + 1, ring->sq_sem);
+        ipc_set_msg_cap(ipc_msg, cap_slot_index + 2, ring->cq_sem);
+        return 0;
+}
+
+/* Stop the server worker and release the ring, nothing may be in flight */
+void ipc_async_ring_destroy(struct ipc_async_ring *ring)
+{
+        ring->shm->closed = 1;
+        __sync_synchronize();
+        __chcore_sys_signal_sem(ring->sq_sem);
+
+        /* The server worker keeps its own copies of the caps */
+        chcore_pmo_auto_unmap(ring->pmo_cap, (u64)ring->shm, ring->shm_size);
+        ring_free_caps(ring);
+        free(ring);
+}
+
+/*
+ * Post a request to the sq.
+ * Returns -EAGAIN if entries requests are not reaped yet, which also keeps
+ * the server from overflowing the cq.
+ */
+int ipc_async_submit(struct ipc_async_ring *ring, u64 tag,
+                     const ipc_regs_t *args)
+{
+        struct ipc_async_shm *shm = ring->shm;
+        struct ipc_async_sqe *sqe;
+        u64 tail;
+
+        spinlock_lock(&ring->lock);
+        if (ring->in_flight == ring->entries) {
+                spinlock_unlock(&ring->lock);
+                return -EAGAIN;
+        }
+        ring->in_flight++;
+
+        tail = shm->sq_tail;
+        sqe = &ring->sq[tail & (ring->entries - 1)];
+        sqe->tag = tag;
+        sqe->args = *args;
+        __sync_synchronize();
+        shm->sq_tail = tail + 1;
+        __sync_synchronize();
+        if (shm->sq_head == tail)
+                __chcore_sys_signal_sem(ring->sq_sem);
+        spinlock_unlock(&ring->lock);
+        return 0;
+}
+
+/*
+ * Take a completion from the cq.
+ * Returns -EAGAIN if there is none and @is_block is false.
+ */
+int ipc_async_reap(struct ipc_async_ring *ring, struct ipc_async_cqe *cqe,
+                   bool is_block)
+{
+        struct ipc_async_shm *shm = ring->shm;
+        u64 head;
+
+        while (1) {
+                spinlock_lock(&ring->lock);
+                head = shm->cq_head;
+                __sync_synchronize();
+                if (head != shm->cq_tail) {
+                        __sync_synchronize();
+                        *cqe = ring->cq[head & (ring->entries - 1)];
+                        __sync_synchronize();
+                        shm->cq_head = head + 1;
+                        ring->in_flight--;
+                        spinlock_unlock(&ring->lock);
+                        return 0;
+                }
+                spinlock_unlock(&ring->lock);
+
+                if (!is_block)
+                        return -EAGAIN;
+                __chcore_sys_wait_sem(ring->cq_sem, true);
+        }
+}
+
+/* Post a completion to the cq, called by the server worker only */
+static void ring_complete(struct ipc_async_ring *ring, u64 tag, s64 ret,
+                          const ipc_regs_t *rets)
+{
+        struct ipc_async_shm *shm = ring->shm;
+        struct ipc_async_cqe *cqe;
+        u64 tail;
+
+        tail = shm->cq_tail;
+        cqe = &ring->cq[tail & (ring->entries - 1)];
+        cqe->tag = tag;
+        cqe->ret = ret;
+        cqe->rets = *rets;
+        __sync_synchronize();
+        shm->cq_tail = tail + 1;
+        __sync_synchronize();
+        if (shm->cq_head == tail)
+                __chcore_sys_signal_sem(ring->cq_sem);
+}
+
+/* Server worker: drain the sq until the client destroys the ring */
+static void *ring_worker(void *arg)
+{
+        struct ipc_async_ring *ring = arg;
+        struct ipc_async_shm *shm = ring->shm;
+        struct ipc_async_sqe sqe;
+        ipc_regs_t rets;
+        u64 head;
+        s64 ret;
+
+        while (!shm->closed) {
+                head = shm->sq_head;
+                __sync_synchronize();
+                if (head == shm->sq_tail) {
+                        __chcore_sys_wait_sem(ring->sq_sem, true);
+                        continue;
+                }
+
+                /* Copy the entry since the client may reuse it after head */
+                sqe = ring->sq[head & (ring->entries - 1)];
+                __sync_synchronize();
+                shm->sq_head = head + 1;
+
+                memset(&rets, 0, sizeof(rets));
+                ret = ring->handler(ring, &sqe.args, &rets);
+                ring_complete(ring, sqe.tag, ret, &rets);
+        }
+
+        chcore_pmo_auto_unmap(ring->pmo_cap, (u64)ring->shm, ring->shm_size);
+        ring_free_caps(ring);
+        free(ring);
+        return NULL;
+}
+
+/*
+ * Map the ring sent by ipc_async_ring_set_msg and start a worker thread
+ * which serves its requests by @handler. On failure the received caps
+ * are freed.
+ */
+int ipc_async_ring_accept(struct ipc_msg *ipc_msg, u64 cap_slot_index,
+                          u64 client_badge, ipc_async_handler handler)
+{
+        struct ipc_async_ring *ring;
+        struct ipc_async_shm *shm, hdr;
+        u64 pmo_size;
+        int ret, i;
+
+        if (cap_slot_index + IPC_ASYNC_CAP_SLOTS > ipc_msg->cap_slot_number)
+                return -EINVAL;
+
+        ring = malloc(sizeof(*ring));
+        if (!ring) {
+                ret = -ENOMEM;
+                goto out_free_caps;
+        }
+        memset(ring, 0, sizeof(*ring));
+        ring->pmo_cap = ipc_get_msg_cap(ipc_msg, cap_slot_index);
+        ring->sq_sem = ipc_get_msg_cap(ipc_msg, cap_slot_index + 1);
+        ring->cq_sem = ipc_get_msg_cap(ipc_msg, cap_slot_index + 2);
+        ring->client_badge = client_badge;
+        ring->handler = handler;
+
+        /*
+         * Read the header first to learn the size of the whole ring. It is
+         * written by the client, so the layout must fit in the real pmo.
+         */
+        ret = chcore_pmo_get_size(ring->pmo_cap, &pmo_size);
+        if (ret < 0)
+                goto out_free_ring;
+        ret = chcore_pmo_read(ring->pmo_cap, 0, &hdr, sizeof(hdr));
+        if (ret < 0)
+                goto out_free_ring;
+        if (!ring_layout_valid(hdr.entries, hdr.data_size, pmo_size)) {
+                ret = -EINVAL;
+                goto out_free_ring;
+        }
+
+        shm = chcore_pmo_auto_map(ring->pmo_cap,
+                                  ring_shm_size(hdr.entries, hdr.data_size),
+                                  VM_READ | VM_WRITE);
+        if (!shm) {
+                ret = -ENOMEM;
+                goto out_free_ring;
+        }
+        ring_init_view(ring, shm, hdr.entries, hdr.data_size);
+
+        ret = chcore_thread_create(
+                ring_worker, (u64)ring, IPC_ASYNC_WORKER_PRIO, TYPE_USER);
+        if (ret < 0)
+                goto out_unmap;
+        return 0;
+
+out_unmap:
+        chcore_pmo_auto_unmap(ring->pmo_cap, (u64)shm, ring->shm_size);
+out_free_ring:
+        free(ring);
+out_free_caps:
+        /* The caps were installed for the ring, do not leak them */
+        for (i = 0; i < IPC_ASYNC_CAP_SLOTS; i++)
+                chcore_cap_free(ipc_get_msg_cap(ipc_msg, cap_slot_index + i));
+        return ret;
+}
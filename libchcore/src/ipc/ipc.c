@@ -14,6 +14,7 @@
 #include <chcore/thread.h>
 #include <chcore/assert.h>
 #include <chcore/internal/raw_syscall.h>
+#include <chcore/internal/utils.h>
 #include <string.h>
 #include <chcore/memory.h>
 #include <sync/spin.h>
@@ -21,7 +22,38 @@
 #include <malloc.h>
 #include <stdio.h>
 
-int client_ipc_num = 0; // Current clients number
+/*
+ * Each client id owns a fixed window of the client buffer area, which is
+ * large enough for IPC_MAX_BUF_SIZE. Ids (and thus windows) are returned
+ * to client_id_bmp by ipc_client_close.
+ */
+#define CLIENT_BUF_WINDOW_SIZE (CLIENT_BUF_AREA_SIZE / MAX_CLIENT)
+
+/* Client ids in use, protected by client_id_lock */
+static u32 client_id_bmp = 0;
+static struct spinlock client_id_lock;
+
+static int alloc_client_id(void)
+{
+        int client_id;
+
+        spinlock_lock(&client_id_lock);
+        for (client_id = 0; client_id < MAX_CLIENT; client_id++) {
+                if (!(client_id_bmp & (1U << client_id))) {
+                        client_id_bmp |= 1U << client_id;
+                        break;
+                }
+        }
+        spinlock_unlock(&client_id_lock);
+        return client_id < MAX_CLIENT ? client_id : -1;
+}
+
+static void free_client_id(int client_id)
+{
+        spinlock_lock(&client_id_lock);
+        client_id_bmp &= ~(1U << client_id);
+        spinlock_unlock(&client_id_lock);
+}
 
 /* Register IPC server */
 int ipc_register_server(server_handler server_handler)
@@ -32,6 +64,7 @@ int ipc_register_server(server_handler server_handler)
         vm_config.stack_size = SERVER_STACK_SIZE;
         vm_config.buf_base_addr = SERVER_BUF_BASE;
         vm_config.buf_size = SERVER_BUF_SIZE;
+        vm_config.buf_area_size = SERVER_BUF_AREA_SIZE;
         ret = __chcore_sys_register_server(
                 (u64)server_handler, MAX_CLIENT, (u64)&vm_config);
         chcore_bug_on(ret < 0);
@@ -41,17 +74,35 @@ int ipc_register_server(server_handler server_handler)
 /* Register IPC client */
 struct ipc_struct *ipc_register_client(int server_thread_cap)
 {
-        int conn_cap, retry_times = RETRY_UPPER_BOUND;
-        struct ipc_struct *ipc_struct = malloc(sizeof(struct ipc_struct));
-        // Assign a unique id for each client
-        int client_id = __sync_fetch_and_add(&client_ipc_num, 1);
-        struct ipc_vm_config vm_config;
+        return ipc_register_client_with_buf(server_thread_cap, CLIENT_BUF_SIZE);
+}
+
+/*
+ * Register IPC client with a shared buffer of @buf_size.
+ * The kernel may grant a smaller one (at most IPC_MAX_BUF_SIZE), which is
+ * recorded in ipc_struct->shared_buf_len.
+ */
+struct ipc_struct *ipc_register_client_with_buf(int server_thread_cap,
+                                                u64 buf_size)
+{
+        int conn_cap = -EIPCRETRY, retry_times = RETRY_UPPER_BOUND;
+        struct ipc_struct *ipc_struct;
+        struct ipc_vm_config vm_config = {0};
+        int client_id;
 
-        if (client_id >= MAX_CLIENT)
+        ipc_struct = malloc(sizeof(struct ipc_struct));
+        if (!ipc_struct)
                 return NULL;
+        // Assign a unique id for each client
+        client_id = alloc_client_id();
+        if (client_id < 0)
+                goto out_free_icb;
 
-        vm_config.buf_base_addr = CLIENT_BUF_BASE + client_id * CLIENT_BUF_SIZE;
-        vm_config.buf_size = CLIENT_BUF_SIZE;
+        if (buf_size > IPC_MAX_BUF_SIZE)
+                buf_size = IPC_MAX_BUF_SIZE;
+        vm_config.buf_base_addr =
+                CLIENT_BUF_BASE + client_id * CLIENT_BUF_WINDOW_SIZE;
+        vm_config.buf_size = ROUND_UP(buf_size, PAGE_SIZE);
         while (retry_times) {
                 conn_cap = __chcore_sys_register_client((u32)server_thread_cap,
                                                         (u64)&vm_config);
@@ -63,30 +114,118 @@ struct ipc_struct *ipc_register_client(int server_thread_cap)
                         __chcore_sys_yield();
                         continue;
                 } else if (conn_cap < 0) {
-                        return 0;
+                        break;
                 }
         }
+        if (conn_cap <= 0)
+                goto out_free_id;
         ipc_struct->shared_buf = vm_config.buf_base_addr;
         ipc_struct->shared_buf_len = vm_config.buf_size;
         ipc_struct->conn_cap = conn_cap;
         spinlock_init(&ipc_struct->ipc_lock);
+        ipc_struct->msg_slot_num = 1;
+        ipc_struct->msg_slot_size = ipc_struct->shared_buf_len;
+        ipc_struct->msg_slot_bmp = 0;
 
         return ipc_struct;
+
+out_free_id:
+        free_client_id(client_id);
+out_free_icb:
+        free(ipc_struct);
+        return NULL;
+}
+
+/*
+ * Close the connection and free @icb, which must have no call in flight.
+ * The server gets back the slot and the shared buffer of the connection,
+ * and the client id (with its buffer window) can be reused.
+ */
+int ipc_client_close(struct ipc_struct *icb)
+{
+        int ret;
+
+        ret = __chcore_sys_ipc_close_connection(icb->conn_cap);
+        if (ret < 0)
+                return ret;
+        free_client_id((icb->shared_buf - CLIENT_BUF_BASE)
+                       / CLIENT_BUF_WINDOW_SIZE);
+        free(icb);
+        return 0;
+}
+
+/*
+ * Split the shared buffer into @slot_num equal slots, so that up to
+ * @slot_num threads can have their ipc_msgs in flight at the same time.
+ * The kernel serves each of them with its own shadow thread.
+ * It must be called when no ipc_msg is in use.
+ */
+int ipc_set_msg_slots(struct ipc_struct *icb, u64 slot_num)
+{
+        u64 slot_size;
+        int ret = 0;
+
+        if (slot_num == 0 || slot_num > IPC_MAX_MSG_SLOTS)
+                return -EINVAL;
+        /* Keep every ipc_msg 8-byte aligned */
+        slot_size = ROUND_DOWN(icb->shared_buf_len / slot_num, sizeof(u64));
+        if (slot_size <= sizeof(struct ipc_msg))
+                return -EINVAL;
+
+        spinlock_lock(&icb->ipc_lock);
+        if (icb->msg_slot_bmp != 0) {
+                ret = -EBUSY;
+                goto out_unlock;
+        }
+        icb->msg_slot_num = slot_num;
+        icb->msg_slot_size = slot_size;
+out_unlock:
+        spinlock_unlock(&icb->ipc_lock);
+        return ret;
+}
+
+/* Claim a free msg slot of the shared buffer, wait if all are in use */
+static u64 ipc_get_msg_slot(struct ipc_struct *icb)
+{
+        u64 slot;
+
+        while (1) {
+                spinlock_lock(&icb->ipc_lock);
+                for (slot = 0; slot < icb->msg_slot_num; slot++) {
+                        if (!(icb->msg_slot_bmp & (1UL << slot))) {
+                                icb->msg_slot_bmp |= 1UL << slot;
+                                spinlock_unlock(&icb->ipc_lock);
+                                return slot;
+                        }
+                }
+                spinlock_unlock(&icb->ipc_lock);
+                __chcore_sys_yield();
+        }
 }
 
 /* IPC msg related stuff */
 /*
- * ipc_msg is constructed on the shm pointed by icb->shared_buf.
- * A new ips_msg will override the old one.
+ * ipc_msg is constructed on a msg slot of the shm pointed by
+ * icb->shared_buf. The slot is held until ipc_destroy_msg.
+ * Returns NULL if the message does not fit in one slot.
  */
 struct ipc_msg *ipc_create_msg(struct ipc_struct *icb, u64 data_len,
                                u64 cap_slot_number)
 {
         ipc_msg_t *ipc_msg;
+        u64 slot, slot_size = icb->msg_slot_size;
         int i;
 
-        spinlock_lock(&icb->ipc_lock);
-        ipc_msg = (ipc_msg_t *)icb->shared_buf;
+        /* Bound each term first so that the sum cannot overflow */
+        if (data_len > slot_size || cap_slot_number > slot_size / sizeof(u64)
+            || sizeof(*ipc_msg) + data_len + cap_slot_number * sizeof(u64)
+                       > slot_size) {
+                printf("%s failed due to overflow.\n", __func__);
+                return NULL;
+        }
+
+        slot = ipc_get_msg_slot(icb);
+        ipc_msg = (ipc_msg_t *)(icb->shared_buf + slot * icb->msg_slot_size);
         ipc_msg->data_len = data_len;
         ipc_msg->cap_slot_number = cap_slot_number;
 
@@ -142,9 +281,40 @@ int ipc_set_msg_cap(struct ipc_msg *ipc_msg, u64 cap_slot_index, u32 cap)
         return 0;
 }
 
-/* Unlock the ipc_msg when destroying the message */
+/*
+ * Grant the server access to [offset, offset + len) of the pmo during the
+ * call, without copying. offset and len must be page-aligned. The window
+ * takes IPC_WINDOW_SLOTS cap slots starting from cap_slot_index.
+ */
+int ipc_set_msg_window(struct ipc_msg *ipc_msg, u64 cap_slot_index,
+                       u32 pmo_cap, u64 offset, u64 len, bool writable)
+{
+        u64 *slots;
+
+        if (cap_slot_index + IPC_WINDOW_SLOTS > ipc_msg->cap_slot_number) {
+                printf("%s failed due to overflow.\n", __func__);
+                return -1;
+        }
+
+        slots = ipc_get_msg_cap_ptr(ipc_msg, cap_slot_index);
+        slots[0] = IPC_MSG_WINDOW | (writable ? IPC_MSG_WINDOW_WRITE : 0)
+                   | pmo_cap;
+        slots[1] = offset;
+        slots[2] = len;
+        return 0;
+}
+
+/* Release the msg slot when destroying the message */
 int ipc_destroy_msg(struct ipc_struct *icb, struct ipc_msg *ipc_msg)
 {
+        u64 slot;
+
+        slot = ((u64)ipc_msg - icb->shared_buf) / icb->msg_slot_size;
+        /* Not created by ipc_create_msg (e.g., NULL for a null call) */
+        if ((u64)ipc_msg < icb->shared_buf || slot >= icb->msg_slot_num)
+                return -EINVAL;
+        spinlock_lock(&icb->ipc_lock);
+        icb->msg_slot_bmp &= ~(1UL << slot);
         spinlock_unlock(&icb->ipc_lock);
         return 0;
 }
@@ -159,13 +329,53 @@ s64 ipc_call(struct ipc_struct *icb, struct ipc_msg *ipc_msg)
                 ret = -EINVAL;
                 goto out;
         }
-        ret = __chcore_sys_ipc_call(icb->conn_cap,
-                                    (void *)ipc_msg,
-                                    ipc_msg ? ipc_msg->cap_slot_number : 0);
+        while (1) {
+                ret = __chcore_sys_ipc_call(
+                        icb->conn_cap,
+                        (void *)ipc_msg,
+                        ipc_msg ? ipc_msg->cap_slot_number : 0);
+                /* All the shadow threads of the connection are busy */
+                if (ret != -EIPCRETRY)
+                        break;
+                __chcore_sys_yield();
+        }
 out:
         return ret;
 }
 
+/*
+ * Issue n independent IPC requests in one kernel crossing, i.e.,
+ * ipc_call(icbs[i], ipc_msgs[i]) in order, and store the results in rets.
+ * Each ipc_msg needs its own msg slot until the batch is finished.
+ */
+s64 ipc_call_batch(struct ipc_struct **icbs, struct ipc_msg **ipc_msgs,
+                   s64 *rets, u64 n)
+{
+        u32 conn_caps[IPC_MAX_BATCH];
+        s64 ret;
+        int i;
+
+        if (n == 0 || n > IPC_MAX_BATCH)
+                return -EINVAL;
+        for (i = 0; i < n; i++) {
+                if (icbs[i]->conn_cap == 0)
+                        return -EINVAL;
+                conn_caps[i] = icbs[i]->conn_cap;
+        }
+
+        ret = __chcore_sys_ipc_call_batch(
+                conn_caps, (void *const *)ipc_msgs, rets, n);
+        if (ret < 0)
+                return ret;
+
+        /* Calls on busy connections are issued again one by one */
+        for (i = 0; i < n; i++) {
+                if (rets[i] == -EIPCRETRY)
+                        rets[i] = ipc_call(icbs[i], ipc_msgs[i]);
+        }
+        return ret;
+}
+
 /* Server uses **ipc_return** to finish an IPC request */
 void ipc_return(struct ipc_msg *ipc_msg, int ret)
 {
@@ -179,3 +389,34 @@ void ipc_return_with_cap(struct ipc_msg *ipc_msg, int ret)
 {
         __chcore_sys_ipc_return((u64)ret, ipc_msg->cap_slot_number);
 }
+
+/*
+ * Register-only IPC: args and rets travel in registers.
+ * No msg slot is taken, so it runs concurrently with other calls on the
+ * same ipc_struct.
+ */
+s64 ipc_call_regs(struct ipc_struct *icb, const ipc_regs_t *args,
+                  ipc_regs_t *rets)
+{
+        ipc_regs_t dummy;
+        s64 ret;
+
+        if (icb->conn_cap == 0)
+                return -EINVAL;
+
+        while (1) {
+                ret = __chcore_sys_ipc_call_regs(
+                        icb->conn_cap, args->reg, rets ? rets->reg : dummy.reg);
+                if (ret != -EIPCRETRY)
+                        break;
+                __chcore_sys_yield();
+        }
+        return ret;
+}
+
+void ipc_return_regs(s64 ret, const ipc_regs_t *rets)
+{
+        ipc_regs_t zero = {0};
+
+        __chcore_sys_ipc_return_regs((u64)ret, rets ? rets->reg : zero.reg);
+}
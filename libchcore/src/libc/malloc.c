@@ -16,6 +16,7 @@
 #include <chcore/assert.h>
 #include <chcore/capability.h>
 #include <chcore/memory.h>
+#include <chcore/internal/mem_layout.h>
 
 #define PMO_SIZE 0x1000
 #define MAP_VA   0x1000000
@@ -24,6 +25,11 @@
 static char *malloc_buf_;
 static size_t malloc_header_ = 0;
 
+/* The huge arena is populated in blocks of HUGE_PAGE_SIZE on faults */
+#define MALLOC_ALIGN 16
+static char *malloc_huge_buf_;
+static size_t malloc_huge_header_ = 0;
+
 void *malloc(size_t size)
 {
         chcore_bug_on(malloc_header_ + size > MALLOC_SZ);
@@ -45,6 +51,30 @@ void *malloc(size_t size)
         return ptr;
 }
 
+void *malloc_huge(size_t size)
+{
+        size = (size + MALLOC_ALIGN - 1) & ~(size_t)(MALLOC_ALIGN - 1);
+        chcore_bug_on(malloc_huge_header_ + size > MALLOC_HUGE_SIZE);
+
+        if (malloc_huge_buf_ == NULL) {
+                int pmo_cap, r;
+                pmo_cap = chcore_pmo_create(MALLOC_HUGE_SIZE, PMO_HUGE);
+                chcore_bug_on(pmo_cap < 0);
+                r = chcore_pmo_map(SELF_CAP,
+                                   pmo_cap,
+                                   MALLOC_HUGE_BASE,
+                                   VM_READ | VM_WRITE);
+                chcore_bug_on(r < 0);
+
+                malloc_huge_buf_ = (char *)MALLOC_HUGE_BASE;
+        }
+
+        void *ptr = (void *)&malloc_huge_buf_[malloc_huge_header_];
+        malloc_huge_header_ += size;
+
+        return ptr;
+}
+
 void free(void *ptr)
 {
         (void)ptr;
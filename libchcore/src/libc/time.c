@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan PSL v1.
+ * You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v1 for more details.
+ */
+
+#include <time.h>
+#include <chcore/internal/raw_syscall.h>
+
+int clock_gettime(clockid_t clock, struct timespec *ts)
+{
+        return __chcore_sys_clock_gettime(clock, ts);
+}
+
+/*
+ * The calling thread blocks in the kernel, instead of spinning, until the
+ * time is up. The sleep is never interrupted, so @rem is not written.
+ */
+int clock_nanosleep(clockid_t clock, int flags, const struct timespec *req,
+                    struct timespec *rem)
+{
+        return __chcore_sys_clock_nanosleep(clock, flags, req, rem);
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem)
+{
+        return __chcore_sys_nanosleep(req, rem);
+}
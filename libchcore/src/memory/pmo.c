@@ -39,6 +39,11 @@ int chcore_pmo_read(u64 pmo_cap, u64 offset, void *buf, u64 len)
         return __chcore_sys_read_pmo(pmo_cap, offset, (u64)buf, len);
 }
 
+int chcore_pmo_get_size(u64 pmo_cap, u64 *size)
+{
+        return __chcore_sys_get_pmo_size(pmo_cap, (u64)size);
+}
+
 int chcore_pmo_create_multi(struct pmo_request *reqs, u64 nr_reqs)
 {
         return __chcore_sys_create_pmos((u64)reqs, nr_reqs);
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan PSL v1.
+ * You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v1 for more details.
+ */
+
+/*
+ * FP/SIMD context test.
+ *
+ * Threads sharing CPUs each keep their own value in v16 across yields,
+ * which switch to the others. Any value seen changed means the state was
+ * not switched with the thread.
+ */
+
+#include <chcore/internal/raw_syscall.h>
+#include <chcore/internal/syscall_num.h>
+#include <chcore/thread.h>
+#include <chcore/assert.h>
+#include <stdio.h>
+
+#define PRIO 255
+
+#define THREAD_NUM 8
+#define ROUNDS     1000
+#define CPU_NUM    2
+
+static volatile int finished;
+
+/* Put @v in v16, yield, and read v16 back */
+static u64 yield_with_simd(u64 v)
+{
+        register long x8 __asm__("x8") = __CHCORE_SYS_yield;
+        u64 ret;
+
+        asm volatile("fmov d16, %1\n"
+                     "svc 0\n"
+                     "fmov %0, d16\n"
+                     : "=r"(ret)
+                     : "r"(v), "r"(x8)
+                     : "x0", "v16", "memory", "cc");
+        return ret;
+}
+
+void *thread_routine(void *arg)
+{
+        u64 id = (u64)arg, v;
+        int i;
+
+        for (i = 0; i < ROUNDS; i++) {
+                v = (id << 32) | i;
+                chcore_assert(yield_with_simd(v) == v);
+        }
+        __sync_fetch_and_add(&finished, 1);
+        return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+        int cap;
+        u64 i;
+
+        for (i = 0; i < THREAD_NUM; i++) {
+                cap = chcore_thread_create(
+                        thread_routine, i, PRIO, TYPE_USER);
+                chcore_assert(cap >= 0);
+                /* Half of them move between CPUs */
+                if (i % 2 == 0)
+                        __chcore_sys_set_affinity(cap, i / 2 % CPU_NUM);
+        }
+        while (finished != THREAD_NUM)
+                __chcore_sys_yield();
+        printf("FP/SIMD state kept by %d threads\n", THREAD_NUM);
+        return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan PSL v1.
+ * You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v1 for more details.
+ */
+
+/*
+ * Huge page test.
+ *
+ * The same buffer is taken from malloc (4K pages) and from malloc_huge
+ * (2M blocks). The first pass over it counts the cost of page faults, and
+ * the second one that of TLB misses, in ticks of sys_get_current_tick.
+ */
+
+#include <malloc.h>
+#include <chcore/memory.h>
+#include <chcore/assert.h>
+#include <chcore/internal/raw_syscall.h>
+#include <stdio.h>
+
+#define BUF_SIZE (32UL * 1024 * 1024)
+
+/* Write one byte per page, and return the ticks it takes */
+static u64 touch(volatile char *buf, u64 v)
+{
+        u64 start, off;
+
+        start = __chcore_sys_get_current_tick();
+        for (off = 0; off < BUF_SIZE; off += PAGE_SIZE)
+                buf[off] = (char)v;
+        return __chcore_sys_get_current_tick() - start;
+}
+
+static void bench(const char *name, char *buf)
+{
+        u64 fault, tlb, off;
+
+        fault = touch(buf, 1);
+        tlb = touch(buf, 2);
+        for (off = 0; off < BUF_SIZE; off += PAGE_SIZE)
+                chcore_assert(buf[off] == 2);
+        printf("%s: first touch %llu ticks, second touch %llu ticks\n",
+               name,
+               fault,
+               tlb);
+}
+
+int main(int argc, char *argv[])
+{
+        char *buf;
+
+        buf = malloc_huge(BUF_SIZE);
+        chcore_assert(((u64)buf & (HUGE_PAGE_SIZE - 1)) == 0);
+        /* Memory from a huge block must read as zero first */
+        chcore_assert(buf[BUF_SIZE - 1] == 0);
+
+        __chcore_sys_perf_start();
+        bench("4K pages", malloc(BUF_SIZE));
+        bench("2M pages", buf);
+        __chcore_sys_perf_end();
+        return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan PSL v1.
+ * You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v1 for more details.
+ */
+
+/*
+ * Wake-affine IPC benchmark against ipc_affine_server.bin.
+ *
+ * The client is pinned on each CPU but the helper's in turn, and its calls
+ * block in the server until the helper on another core wakes the handler
+ * up. The kernel wakes the handler on the CPU of its client, where the
+ * IPC buffer is cached, so both the handler and the client after the call
+ * should stay on the client's CPU. Without it, they would move to the
+ * helper's CPU. The baseline asks the server to turn wake-affine off for
+ * its calls, and is reported next to it for each CPU.
+ */
+
+#include <stdio.h>
+#include <chcore/ipc.h>
+#include <chcore/procm.h>
+#include <chcore/assert.h>
+#include <chcore/internal/raw_syscall.h>
+
+#define BENCH_SAMPLES 256
+#define BENCH_WARMUP  16
+#define BENCH_CPU_NUM 4
+#define HELPER_CPU    0
+
+/* reg0 of the calls, see ipc_affine_server.c */
+#define AFFINE_ON  0
+#define AFFINE_OFF 1
+
+static u64 samples[BENCH_SAMPLES];
+
+static void sort_samples(u64 *s, int n)
+{
+        int i, j;
+        u64 v;
+
+        for (i = 1; i < n; i++) {
+                v = s[i];
+                for (j = i; j > 0 && s[j - 1] > v; j--)
+                        s[j] = s[j - 1];
+                s[j] = v;
+        }
+}
+
+static void bench_on_cpu(struct ipc_struct *icb, int cpu, u64 mode)
+{
+        ipc_regs_t args = {.reg = {mode}};
+        int i, handler_local = 0, client_local = 0;
+        u64 start;
+
+        chcore_assert(__chcore_sys_set_affinity(-1, cpu) == 0);
+        __chcore_sys_yield();
+
+        for (i = 0; i < BENCH_WARMUP; i++) {
+                ipc_call_regs(icb, &args, NULL);
+                __chcore_sys_yield();
+        }
+
+        for (i = 0; i < BENCH_SAMPLES; i++) {
+                start = __chcore_sys_get_current_tick();
+                if (ipc_call_regs(icb, &args, NULL) == cpu)
+                        handler_local++;
+                samples[i] = __chcore_sys_get_current_tick() - start;
+                if (__chcore_sys_get_cpu_id() == cpu)
+                        client_local++;
+                /* Go back to the pinned CPU if the call moved the client */
+                __chcore_sys_yield();
+        }
+
+        sort_samples(samples, BENCH_SAMPLES);
+        printf("client on cpu %d, %-11s: handler local %d/%d,"
+               " client local %d/%d, min %llu median %llu p99 %llu ticks\n",
+               cpu,
+               mode == AFFINE_ON ? "wake-affine" : "baseline",
+               handler_local,
+               BENCH_SAMPLES,
+               client_local,
+               BENCH_SAMPLES,
+               samples[0],
+               samples[BENCH_SAMPLES / 2],
+               samples[BENCH_SAMPLES * 99 / 100]);
+}
+
+int main(int argc, char *argv[])
+{
+        struct ipc_struct *icb;
+        int server_cap, cpu;
+
+        printf("Hello from ipc_affine_bench.bin!\n");
+        chcore_assert(chcore_procm_spawn("/ipc_affine_server.bin", &server_cap)
+                      > 0);
+        icb = ipc_register_client(server_cap);
+        chcore_assert(icb);
+
+        for (cpu = 0; cpu < BENCH_CPU_NUM; cpu++) {
+                if (cpu == HELPER_CPU)
+                        continue;
+                bench_on_cpu(icb, cpu, AFFINE_ON);
+                bench_on_cpu(icb, cpu, AFFINE_OFF);
+        }
+        return 0;
+}
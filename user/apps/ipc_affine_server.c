@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan PSL v1.
+ * You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v1 for more details.
+ */
+
+/*
+ * Server of ipc_affine_bench.bin, which spawns it.
+ * Each request is handed to a helper thread pinned on HELPER_CPU and the
+ * handler blocks until the helper answers, so that the handler is woken up
+ * by another core. The CPU it resumes on is returned to the client.
+ * If reg0 of the call is AFFINE_OFF, the handler clears its wake-affine
+ * before blocking, and is woken up on the helper's CPU instead.
+ */
+
+#include <time.h>
+#include <chcore/ipc.h>
+#include <chcore/thread.h>
+#include <chcore/assert.h>
+#include <chcore/internal/raw_syscall.h>
+
+#define HELPER_CPU 0
+#define PRIO       255
+#define NO_AFF     -1
+#define AFFINE_OFF 1
+
+static const struct timespec server_idle = {.tv_sec = 3600};
+static int req_sem;
+static int done_sem;
+
+static void *helper_routine(void *arg)
+{
+        while (1) {
+                __chcore_sys_wait_sem(req_sem, true);
+                __chcore_sys_signal_sem(done_sem);
+        }
+        return NULL;
+}
+
+/* Serve one client at a time, by ipc_call_regs */
+static void affine_dispatch(struct ipc_msg *ipc_msg, u64 client_pid,
+                            u64 mode)
+{
+        /* Setting the affinity also clears the wake_cpu of this call */
+        if (mode == AFFINE_OFF)
+                __chcore_sys_set_affinity(-1, NO_AFF);
+        __chcore_sys_signal_sem(req_sem);
+        __chcore_sys_wait_sem(done_sem, true);
+        ipc_return_regs(__chcore_sys_get_cpu_id(), NULL);
+}
+
+int main(int argc, char *argv[])
+{
+        int thread_cap;
+
+        req_sem = __chcore_sys_create_sem();
+        done_sem = __chcore_sys_create_sem();
+        chcore_assert(req_sem >= 0 && done_sem >= 0);
+
+        thread_cap = chcore_thread_create(helper_routine, 0, PRIO, TYPE_USER);
+        chcore_assert(thread_cap >= 0);
+        __chcore_sys_set_affinity(thread_cap, HELPER_CPU);
+
+        ipc_register_server(affine_dispatch);
+
+        /* Server does not exit, and sleeps rather than spins */
+        while (1) {
+                nanosleep(&server_idle, NULL);
+        }
+        return 0;
+}
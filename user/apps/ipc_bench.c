@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan PSL v1.
+ * You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v1 for more details.
+ */
+
+/*
+ * IPC benchmark against ipc_bench_server.bin.
+ *
+ * Time is read by sys_get_current_tick (the system counter), and the
+ * timer interrupt is disabled by sys_perf_start during measurement.
+ * Each sample covers BENCH_CALLS_PER_SAMPLE calls to amortize the cost of
+ * reading the counter, which is measured first and subtracted. Results are
+ * per call, in ticks with one decimal.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <chcore/ipc.h>
+#include <chcore/memory.h>
+#include <chcore/procm.h>
+#include <chcore/thread.h>
+#include <chcore/assert.h>
+#include <chcore/internal/raw_syscall.h>
+
+#define BENCH_SAMPLES          512
+#define BENCH_CAP_SAMPLES      64
+#define BENCH_WARMUP           64
+#define BENCH_CALLS_PER_SAMPLE 8
+#define BENCH_MAX_PAYLOAD      4096
+#define BENCH_THD_MAX          4
+#define BENCH_THD_CALLS        2048
+#define BENCH_CPU_NUM          4
+#define PRIO                   255
+
+static u64 samples[BENCH_SAMPLES];
+static u64 tick_overhead;
+static int server_cap;
+
+static void sort_samples(u64 *s, int n)
+{
+        int i, j;
+        u64 v;
+
+        for (i = 1; i < n; i++) {
+                v = s[i];
+                for (j = i; j > 0 && s[j - 1] > v; j--)
+                        s[j] = s[j - 1];
+                s[j] = v;
+        }
+}
+
+/* Print a value of ticks * 10 */
+static void print_ticks(const char *name, u64 v)
+{
+        printf(" %s %llu.%llu", name, v / 10, v % 10);
+}
+
+/* Report min, median and p99 of n samples in ticks per call */
+static void report(const char *name, u64 *s, int n)
+{
+        sort_samples(s, n);
+        printf("%s:", name);
+        print_ticks("min", s[0]);
+        print_ticks("median", s[n / 2]);
+        print_ticks("p99", s[n * 99 / 100]);
+        printf("\n");
+}
+
+static u64 sample_end(u64 start)
+{
+        u64 ticks = __chcore_sys_get_current_tick() - start;
+
+        ticks = ticks > tick_overhead ? ticks - tick_overhead : 0;
+        return ticks * 10 / BENCH_CALLS_PER_SAMPLE;
+}
+
+static void measure_tick_overhead(void)
+{
+        u64 start;
+        int i;
+
+        for (i = 0; i < BENCH_SAMPLES; i++) {
+                start = __chcore_sys_get_current_tick();
+                samples[i] = __chcore_sys_get_current_tick() - start;
+        }
+        sort_samples(samples, BENCH_SAMPLES);
+        tick_overhead = samples[0];
+        printf("tick read overhead: %llu\n", tick_overhead);
+}
+
+static void bench_null_call(struct ipc_struct *icb)
+{
+        ipc_regs_t args = {0};
+        u64 start;
+        int i, j;
+
+        for (i = 0; i < BENCH_WARMUP; i++)
+                ipc_call(icb, NULL);
+        for (i = 0; i < BENCH_SAMPLES; i++) {
+                start = __chcore_sys_get_current_tick();
+                for (j = 0; j < BENCH_CALLS_PER_SAMPLE; j++)
+                        ipc_call(icb, NULL);
+                samples[i] = sample_end(start);
+        }
+        report("null call", samples, BENCH_SAMPLES);
+
+        for (i = 0; i < BENCH_SAMPLES; i++) {
+                start = __chcore_sys_get_current_tick();
+                for (j = 0; j < BENCH_CALLS_PER_SAMPLE; j++)
+                        ipc_call_regs(icb, &args, NULL);
+                samples[i] = sample_end(start);
+        }
+        report("null regs call", samples, BENCH_SAMPLES);
+}
+
+static void bench_payload(struct ipc_struct *icb)
+{
+        static char payload[BENCH_MAX_PAYLOAD];
+        struct ipc_msg *ipc_msg;
+        u64 size, start;
+        int i, j;
+
+        memset(payload, 1, sizeof(payload));
+        for (size = 0; size <= BENCH_MAX_PAYLOAD; size = size ? size * 4 : 64) {
+                ipc_msg = ipc_create_msg(icb, size, 0);
+                for (i = 0; i < BENCH_WARMUP; i++)
+                        ipc_call(icb, ipc_msg);
+                for (i = 0; i < BENCH_SAMPLES; i++) {
+                        start = __chcore_sys_get_current_tick();
+                        for (j = 0; j < BENCH_CALLS_PER_SAMPLE; j++) {
+                                ipc_set_msg_data(ipc_msg, payload, 0, size);
+                                chcore_assert(ipc_call(icb, ipc_msg) == size);
+                        }
+                        samples[i] = sample_end(start);
+                }
+                ipc_destroy_msg(icb, ipc_msg);
+
+                printf("payload %llu bytes", size);
+                report("", samples, BENCH_SAMPLES);
+        }
+}
+
+/*
+ * Each call copies a cap into the server, whose slot is never freed, so
+ * fewer samples are taken.
+ */
+static void bench_cap_transfer(struct ipc_struct *icb)
+{
+        struct ipc_msg *ipc_msg;
+        int pmo_cap;
+        u64 start;
+        int i, j;
+
+        pmo_cap = __chcore_sys_create_pmo(PAGE_SIZE, PMO_DATA);
+        chcore_assert(pmo_cap >= 0);
+
+        ipc_msg = ipc_create_msg(icb, 0, 1);
+        for (i = 0; i < BENCH_CAP_SAMPLES; i++) {
+                start = __chcore_sys_get_current_tick();
+                for (j = 0; j < BENCH_CALLS_PER_SAMPLE; j++) {
+                        /* ipc_return clears the slots of the reply */
+                        ipc_msg->cap_slot_number = 1;
+                        ipc_set_msg_cap(ipc_msg, 0, pmo_cap);
+                        ipc_call(icb, ipc_msg);
+                }
+                samples[i] = sample_end(start);
+        }
+        ipc_destroy_msg(icb, ipc_msg);
+        report("cap transfer", samples, BENCH_CAP_SAMPLES);
+}
+
+static volatile int thd_ready;
+static volatile int thd_start;
+static volatile int thd_finished;
+
+static void *bench_thread_routine(void *arg)
+{
+        struct ipc_struct *icb = arg;
+        int i;
+
+        __sync_fetch_and_add(&thd_ready, 1);
+        while (!thd_start)
+                ;
+        __chcore_sys_perf_start();
+        for (i = 0; i < BENCH_THD_CALLS; i++)
+                ipc_call(icb, NULL);
+        __chcore_sys_perf_end();
+        __sync_fetch_and_add(&thd_finished, 1);
+        return NULL;
+}
+
+/* Throughput of n clients, each with its own connection and CPU */
+static void bench_throughput(int n)
+{
+        struct ipc_struct *icbs[BENCH_THD_MAX];
+        int thread_cap;
+        u64 start, ticks;
+        int i;
+
+        for (i = 0; i < n; i++) {
+                icbs[i] = ipc_register_client(server_cap);
+                chcore_assert(icbs[i]);
+        }
+
+        thd_ready = 0;
+        thd_start = 0;
+        thd_finished = 0;
+        for (i = 0; i < n; i++) {
+                thread_cap = chcore_thread_create(
+                        bench_thread_routine, (u64)icbs[i], PRIO, TYPE_USER);
+                chcore_assert(thread_cap >= 0);
+                __chcore_sys_set_affinity(thread_cap, i % BENCH_CPU_NUM);
+        }
+        while (thd_ready != n)
+                __chcore_sys_yield();
+
+        start = __chcore_sys_get_current_tick();
+        thd_start = 1;
+        while (thd_finished != n)
+                __chcore_sys_yield();
+        ticks = __chcore_sys_get_current_tick() - start;
+
+        printf("throughput %d clients: %llu calls in %llu ticks,",
+               n,
+               (u64)n * BENCH_THD_CALLS,
+               ticks);
+        print_ticks("per call", ticks * 10 / (n * BENCH_THD_CALLS));
+        printf("\n");
+
+        /* Give the connections back so that the server is not exhausted */
+        for (i = 0; i < n; i++)
+                chcore_assert(ipc_client_close(icbs[i]) == 0);
+}
+
+int main(int argc, char *argv[])
+{
+        struct ipc_struct *icb;
+        int n;
+
+        printf("Hello from ipc_bench.bin!\n");
+        chcore_assert(chcore_procm_spawn("/ipc_bench_server.bin", &server_cap)
+                      > 0);
+
+        /* Room for the largest payload after the ipc_msg header */
+        icb = ipc_register_client_with_buf(server_cap, 2 * PAGE_SIZE);
+        chcore_assert(icb);
+
+        __chcore_sys_perf_start();
+        measure_tick_overhead();
+        bench_null_call(icb);
+        bench_payload(icb);
+        bench_cap_transfer(icb);
+        __chcore_sys_perf_end();
+
+        for (n = 1; n <= BENCH_THD_MAX; n *= 2)
+                bench_throughput(n);
+        return 0;
+}
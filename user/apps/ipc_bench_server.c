@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan PSL v1.
+ * You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v1 for more details.
+ */
+
+/*
+ * Server of ipc_bench.bin, which spawns it.
+ * Each request is answered right away, so that the cost measured by the
+ * client is that of the IPC path itself.
+ */
+
+#include <time.h>
+#include <chcore/ipc.h>
+#include <chcore/internal/raw_syscall.h>
+
+static const struct timespec server_idle = {.tv_sec = 3600};
+
+static void bench_dispatch(struct ipc_msg *ipc_msg, u64 client_pid)
+{
+        unsigned char *data;
+        int ret = 0;
+        u64 i;
+
+        /* Null call, either by ipc_call or ipc_call_regs */
+        if (!ipc_msg)
+                ipc_return(0, 0);
+
+        /* Touch the payload so that its size is reflected in the cost */
+        data = (unsigned char *)ipc_get_msg_data(ipc_msg);
+        for (i = 0; i < ipc_msg->data_len; i++)
+                ret += data[i];
+
+        ipc_return(ipc_msg, ret);
+}
+
+int main(int argc, char *argv[])
+{
+        ipc_register_server(bench_dispatch);
+
+        /* Server does not exit, and sleeps rather than spins */
+        while (1) {
+                nanosleep(&server_idle, NULL);
+        }
+        return 0;
+}
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan PSL v1.
+ * You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v1 for more details.
+ */
+
+/*
+ * Scheduler trace tool.
+ *
+ * Traces the scheduler while pairs of threads ping-pong by semaphores, and
+ * prints a histogram of the wakeup latency of each thread seen, i.e., the
+ * time from being put into a ready queue to being switched in. Buckets are
+ * powers of 2 in ticks of the system counter.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <chcore/thread.h>
+#include <chcore/assert.h>
+#include <chcore/internal/raw_syscall.h>
+
+#define TRACE_BATCH     256
+#define TRACE_THD_MAX   64
+#define TRACE_BUCKETS   24
+#define PINGPONG_PAIRS  2
+#define PINGPONG_ROUNDS 2000
+#define PRIO            255
+
+struct thread_lat {
+        u64 thread;
+        /* When it was enqueued, 0 if it is not ready */
+        u64 ready_ts;
+        u64 cnt;
+        u64 total;
+        u64 max;
+        u64 buckets[TRACE_BUCKETS];
+};
+
+static struct sched_trace_event events[TRACE_BATCH];
+static struct thread_lat lats[TRACE_THD_MAX];
+static int lat_num;
+static u64 event_num, lost_num;
+
+static const struct timespec drain_interval = {.tv_nsec = 10000000};
+
+static struct thread_lat *find_thread(u64 thread)
+{
+        int i;
+
+        for (i = 0; i < lat_num; i++)
+                if (lats[i].thread == thread)
+                        return &lats[i];
+        if (lat_num == TRACE_THD_MAX)
+                return NULL;
+        lats[lat_num].thread = thread;
+        return &lats[lat_num++];
+}
+
+static int lat_bucket(u64 lat)
+{
+        int b = 0;
+
+        while (lat > 1 && b < TRACE_BUCKETS - 1) {
+                lat >>= 1;
+                b++;
+        }
+        return b;
+}
+
+static void account_event(struct sched_trace_event *ev)
+{
+        struct thread_lat *lat;
+        u64 v;
+
+        if (ev->type != SCHED_TRACE_ENQUEUE && ev->type != SCHED_TRACE_SWITCH)
+                return;
+        lat = find_thread(ev->thread);
+        if (!lat)
+                return;
+
+        if (ev->type == SCHED_TRACE_ENQUEUE) {
+                lat->ready_ts = ev->ts;
+        } else if (lat->ready_ts) {
+                v = ev->ts - lat->ready_ts;
+                lat->ready_ts = 0;
+                lat->cnt++;
+                lat->total += v;
+                if (v > lat->max)
+                        lat->max = v;
+                lat->buckets[lat_bucket(v)]++;
+        }
+}
+
+/* Drain and account the events recorded so far */
+static void drain(void)
+{
+        u64 lost;
+        int i, n;
+
+        do {
+                n = __chcore_sys_sched_trace_drain(events, TRACE_BATCH, &lost);
+                chcore_assert(n >= 0);
+                for (i = 0; i < n; i++)
+                        account_event(&events[i]);
+                event_num += n;
+                lost_num += lost;
+        } while (n == TRACE_BATCH);
+}
+
+static void report(void)
+{
+        struct thread_lat *lat;
+        int i, b;
+
+        printf("%llu events, %llu lost\n", event_num, lost_num);
+        for (i = 0; i < lat_num; i++) {
+                lat = &lats[i];
+                if (lat->cnt == 0)
+                        continue;
+                printf("thread %llx: %llu wakeups, avg %llu max %llu ticks\n",
+                       lat->thread,
+                       lat->cnt,
+                       lat->total / lat->cnt,
+                       lat->max);
+                for (b = 0; b < TRACE_BUCKETS; b++) {
+                        if (lat->buckets[b])
+                                printf("  < %8llu: %llu\n",
+                                       1ULL << (b + 1),
+                                       lat->buckets[b]);
+                }
+        }
+}
+
+static int ping_sems[PINGPONG_PAIRS], pong_sems[PINGPONG_PAIRS];
+static volatile int pingpong_finished;
+
+static void *ping_routine(void *arg)
+{
+        int pair = (int)(u64)arg, i;
+
+        for (i = 0; i < PINGPONG_ROUNDS; i++) {
+                __chcore_sys_signal_sem(ping_sems[pair]);
+                __chcore_sys_wait_sem(pong_sems[pair], true);
+        }
+        __sync_fetch_and_add(&pingpong_finished, 1);
+        return NULL;
+}
+
+static void *pong_routine(void *arg)
+{
+        int pair = (int)(u64)arg, i;
+
+        for (i = 0; i < PINGPONG_ROUNDS; i++) {
+                __chcore_sys_wait_sem(ping_sems[pair], true);
+                __chcore_sys_signal_sem(pong_sems[pair]);
+        }
+        __sync_fetch_and_add(&pingpong_finished, 1);
+        return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+        int i;
+
+        printf("Hello from sched_trace.bin!\n");
+        for (i = 0; i < PINGPONG_PAIRS; i++) {
+                ping_sems[i] = __chcore_sys_create_sem();
+                pong_sems[i] = __chcore_sys_create_sem();
+                chcore_assert(ping_sems[i] >= 0 && pong_sems[i] >= 0);
+        }
+
+        chcore_assert(__chcore_sys_sched_trace_ctl(SCHED_TRACE_RESET) == 0);
+        chcore_assert(__chcore_sys_sched_trace_ctl(SCHED_TRACE_ON) == 0);
+
+        for (i = 0; i < PINGPONG_PAIRS; i++) {
+                chcore_assert(chcore_thread_create(
+                                      ping_routine, i, PRIO, TYPE_USER)
+                              >= 0);
+                chcore_assert(chcore_thread_create(
+                                      pong_routine, i, PRIO, TYPE_USER)
+                              >= 0);
+        }
+        /* Drain often enough that the rings do not wrap */
+        while (pingpong_finished != 2 * PINGPONG_PAIRS) {
+                nanosleep(&drain_interval, NULL);
+                drain();
+        }
+
+        chcore_assert(__chcore_sys_sched_trace_ctl(SCHED_TRACE_OFF) == 0);
+        drain();
+        report();
+        return 0;
+}
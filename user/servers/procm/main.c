@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <malloc.h>
 #include <string.h>
+#include <time.h>
 #include <chcore/thread.h>
 #include <chcore/ipc.h>
 #include <chcore/internal/raw_syscall.h>
@@ -25,6 +26,8 @@
 #include "elf.h"
 #include "spawn.h"
 
+static const struct timespec server_idle = {.tv_sec = 3600};
+
 static void ipc_dispatch(struct ipc_msg *ipc_msg, u64 client_pid)
 {
         int ret = 0;
@@ -82,9 +85,9 @@ static void *procm_main(void *arg)
         int shell_cap;
         spawn("/shell.srv", &shell_cap);
 
-        /* Server does not exit */
+        /* Server does not exit, and sleeps rather than spins */
         while (1) {
-                __chcore_sys_yield();
+                nanosleep(&server_idle, NULL);
         }
 }
 
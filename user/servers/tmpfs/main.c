@@ -11,6 +11,7 @@
  */
 
 #include <stdio.h>
+#include <time.h>
 #include <chcore/ipc.h>
 #include <chcore/memory.h>
 #include <chcore/internal/raw_syscall.h>
@@ -25,12 +26,15 @@ int tfs_load_image(const char *start);
 extern const char __binary_ramdisk_cpio_start;
 extern u64 __binary_ramdisk_cpio_size;
 
-void fs_server_dispatch(struct ipc_msg *ipc_msg, u64 client_badge);
+void fs_server_dispatch(struct ipc_msg *ipc_msg, u64 client_badge, u64 reg0,
+                        u64 reg1, u64 reg2, u64 reg3);
 
 #ifdef TMPFS_TEST
 void tfs_test();
 #endif
 
+static const struct timespec server_idle = {.tv_sec = 3600};
+
 int main()
 {
         init_tmpfs();
@@ -43,8 +47,9 @@ int main()
 
         ipc_register_server(fs_server_dispatch);
 
+        /* Server does not exit, and sleeps rather than spins */
         while (1) {
-                __chcore_sys_yield();
+                nanosleep(&server_idle, NULL);
         }
         return 0;
 }
@@ -16,6 +16,7 @@
 
 #include <libc/sys/stat.h>
 #include <chcore/fs/defs.h>
+#include <chcore/ipc_async.h>
 
 /* fs server private data */
 struct list_head server_entry_mapping;
@@ -115,12 +116,99 @@ void translate_fd_to_fid(u64 client_badge, struct fs_request *fr)
         }
 }
 
-void fs_server_dispatch(struct ipc_msg *ipc_msg, u64 client_badge)
+/*
+ * Requests small enough to be sent by ipc_call_regs or an async ring.
+ * reg0 is the request type and the rest are its arguments.
+ */
+static int fs_server_handle_regs(u64 client_badge, u64 reg0, u64 reg1,
+                                 u64 reg2, u64 reg3)
+{
+        struct fs_request fr;
+        int ret;
+
+        fr.req = reg0;
+        switch (fr.req) {
+        case FS_REQ_CLOSE:
+                fr.close.fd = reg1;
+                break;
+        case FS_REQ_LSEEK:
+                fr.lseek.fd = reg1;
+                fr.lseek.offset = reg2;
+                fr.lseek.whence = reg3;
+                break;
+        default:
+                printf("[Error] Strange FS Server register request %d\n",
+                       fr.req);
+                return -EINVAL;
+        }
+
+        spinlock_lock(&fs_wrapper_meta_lock);
+        translate_fd_to_fid(client_badge, &fr);
+        if (fr.req == FS_REQ_CLOSE)
+                ret = fs_wrapper_close(NULL, &fr);
+        else
+                ret = fs_wrapper_lseek(NULL, &fr);
+        spinlock_unlock(&fs_wrapper_meta_lock);
+
+        return ret;
+}
+
+static void fs_server_dispatch_regs(u64 client_badge, u64 reg0, u64 reg1,
+                                    u64 reg2, u64 reg3)
+{
+        ipc_return_regs(
+                fs_server_handle_regs(client_badge, reg0, reg1, reg2, reg3),
+                NULL);
+}
+
+/*
+ * Requests posted to an async ring, in the same layout as the register
+ * ones. FS_REQ_READ reads into the data area of the ring:
+ * reg1 is the fd, reg2 the count and reg3 the offset in the data area.
+ */
+static s64 fs_server_async_handler(struct ipc_async_ring *ring,
+                                   const ipc_regs_t *args, ipc_regs_t *rets)
+{
+        struct fs_request fr;
+        u64 data_size = ring->data_size;
+        int ret;
+
+        if (args->reg[0] != FS_REQ_READ)
+                return fs_server_handle_regs(ring->client_badge,
+                                             args->reg[0],
+                                             args->reg[1],
+                                             args->reg[2],
+                                             args->reg[3]);
+
+        if (args->reg[3] > data_size || args->reg[2] > data_size - args->reg[3])
+                return -EINVAL;
+
+        fr.req = FS_REQ_READ;
+        fr.read.fd = args->reg[1];
+        fr.read.count = args->reg[2];
+
+        spinlock_lock(&fs_wrapper_meta_lock);
+        translate_fd_to_fid(ring->client_badge, &fr);
+        ret = fs_wrapper_read_buf(&fr,
+                                  (char *)ipc_async_data(ring) + args->reg[3]);
+        spinlock_unlock(&fs_wrapper_meta_lock);
+
+        return ret;
+}
+
+void fs_server_dispatch(struct ipc_msg *ipc_msg, u64 client_badge, u64 reg0,
+                        u64 reg1, u64 reg2, u64 reg3)
 {
         struct fs_request *fr;
         int ret;
         bool ret_with_cap = false;
 
+        /* ipc_return_regs does not return unless it fails */
+        if (!ipc_msg) {
+                fs_server_dispatch_regs(client_badge, reg0, reg1, reg2, reg3);
+                return;
+        }
+
         fr = (struct fs_request *)ipc_get_msg_data(ipc_msg);
 
         spinlock_lock(&fs_wrapper_meta_lock);
@@ -141,11 +229,12 @@ void fs_server_dispatch(struct ipc_msg *ipc_msg, u64 client_badge)
         case FS_REQ_OPEN:
                 ret = fs_wrapper_open(client_badge, ipc_msg, fr);
                 break;
+        /* For an ipc_msg, reg0 and reg1 are the window granted in the call */
         case FS_REQ_READ:
-                ret = fs_wrapper_read(ipc_msg, fr);
+                ret = fs_wrapper_read(ipc_msg, fr, (void *)reg0, reg1);
                 break;
         case FS_REQ_WRITE:
-                ret = fs_wrapper_write(ipc_msg, fr);
+                ret = fs_wrapper_write(ipc_msg, fr, (void *)reg0, reg1);
                 break;
         case FS_REQ_UNLINK:
                 ret = fs_wrapper_unlink(ipc_msg, fr);
@@ -171,6 +260,10 @@ void fs_server_dispatch(struct ipc_msg *ipc_msg, u64 client_badge)
         case FS_REQ_LSEEK: /*LSEEK is handled in fs_wrapper_ops.*/
                 ret = fs_wrapper_lseek(ipc_msg, fr);
                 break;
+        case FS_REQ_ASYNC_SETUP:
+                ret = ipc_async_ring_accept(
+                        ipc_msg, 0, client_badge, fs_server_async_handler);
+                break;
         default:
                 printf("[Error] Strange FS Server request number %d\n",
                        fr->req);
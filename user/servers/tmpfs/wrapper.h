@@ -73,8 +73,11 @@ int default_server_operation(struct ipc_msg *ipc_msg, struct fs_request *fr);
 int fs_wrapper_open(u64 client_badge, struct ipc_msg *ipc_msg,
                     struct fs_request *fr);
 int fs_wrapper_close(struct ipc_msg *ipc_msg, struct fs_request *fr);
-int fs_wrapper_read(struct ipc_msg *ipc_msg, struct fs_request *fr);
-int fs_wrapper_write(struct ipc_msg *ipc_msg, struct fs_request *fr);
+int fs_wrapper_read(struct ipc_msg *ipc_msg, struct fs_request *fr,
+                    void *window, u64 window_len);
+int fs_wrapper_read_buf(struct fs_request *fr, char *buf);
+int fs_wrapper_write(struct ipc_msg *ipc_msg, struct fs_request *fr,
+                     void *window, u64 window_len);
 int fs_wrapper_lseek(struct ipc_msg *ipc_msg, struct fs_request *fr);
 int fs_wrapper_unlink(struct ipc_msg *ipc_msg, struct fs_request *fr);
 int fs_wrapper_rmdir(struct ipc_msg *ipc_msg, struct fs_request *fr);
@@ -83,4 +86,5 @@ int fs_wrapper_creat(struct ipc_msg *ipc_msg, struct fs_request *fr);
 int fs_wrapper_getdents64(struct ipc_msg *ipc_msg, struct fs_request *fr);
 int fs_wrapper_get_size(struct ipc_msg *ipc_msg, struct fs_request *fr);
 
-void fs_server_dispatch(struct ipc_msg *ipc_msg, u64 client_badge);
+void fs_server_dispatch(struct ipc_msg *ipc_msg, u64 client_badge, u64 reg0,
+                        u64 reg1, u64 reg2, u64 reg3);
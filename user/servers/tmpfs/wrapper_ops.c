@@ -151,23 +151,20 @@ int fs_wrapper_close(struct ipc_msg *ipc_msg, struct fs_request *fr)
         return 0;
 }
 
-int fs_wrapper_read(struct ipc_msg *ipc_msg, struct fs_request *fr)
+/* Read fr->read.count bytes from the file offset of fr->read.fd into @buf */
+int fs_wrapper_read_buf(struct fs_request *fr, char *buf)
 {
         int fd;
-        char *buf;
         unsigned long long offset;
         size_t size;
         void *operator;
         int ret;
         struct fs_vnode *vnode;
-        char *page_buf;
-        int fptr, page_idx, page_off, copy_size;
 
         ret = 0;
         fd = fr->read.fd;
-        buf = (void *)fr;
-
         size = (size_t)fr->read.count;
+
         offset = (unsigned long long)server_entrys[fd]->offset;
         vnode = server_entrys[fd]->vnode;
         operator = server_entrys[fd]->vnode->private;
@@ -203,7 +200,24 @@ out:
         return ret;
 }
 
-int fs_wrapper_write(struct ipc_msg *ipc_msg, struct fs_request *fr)
+int fs_wrapper_read(struct ipc_msg *ipc_msg, struct fs_request *fr,
+                    void *window, u64 window_len)
+{
+        char *buf;
+
+        buf = (void *)fr;
+
+        /* Copy into the client's pmo window directly if it grants one */
+        if (window) {
+                buf = window;
+                if (fr->read.count > window_len)
+                        fr->read.count = window_len;
+        }
+        return fs_wrapper_read_buf(fr, buf);
+}
+
+int fs_wrapper_write(struct ipc_msg *ipc_msg, struct fs_request *fr,
+                     void *window, u64 window_len)
 {
         int fd;
         char *buf;
@@ -220,6 +234,13 @@ int fs_wrapper_write(struct ipc_msg *ipc_msg, struct fs_request *fr)
         buf = (void *)fr + sizeof(struct fs_request);
 
         size = (size_t)fr->write.count;
+
+        /* Copy from the client's pmo window directly if it grants one */
+        if (window) {
+                buf = window;
+                if (size > window_len)
+                        size = window_len;
+        }
         offset = (unsigned long long)server_entrys[fd]->offset;
         vnode = server_entrys[fd]->vnode;
         operator = server_entrys[fd]->vnode->private;